@@ -0,0 +1,120 @@
+// Benchmarks of the I/O engines of the kmtricks partition files (muset --io-engine): one
+// iteration writes 16 k-mer files of 200000 k-mers as the count step does (KmerWriter,
+// k = 31, 32-bit counts), or reads them back one after the other as a merge does
+// (KmerReader), with the fstream, pread and uring engines, uncompressed and with lz4. The
+// files go to --io-dir, by blocks of --io-block-kb; with --io-cold, they are synced and
+// dropped from the page cache (posix_fadvise DONTNEED) before each read.
+
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include <kmtricks/io/kmer_file.hpp>
+
+#include "bench.h"
+
+namespace fs = std::filesystem;
+using count_t = typename km::selectC<4294967295>::type;
+
+static constexpr size_t nb_files = 16;
+static constexpr size_t nb_kmers = 200000;
+
+static void drop_cache(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) { return; }
+  fdatasync(fd);
+#ifdef POSIX_FADV_DONTNEED
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+  close(fd);
+}
+
+static std::vector<std::string> file_paths(const bench_options& opt) {
+  fs::path dir = opt.io_dir.empty() ? fs::temp_directory_path() : fs::path(opt.io_dir);
+  dir /= fmt::format("kmat_bench.{}.io", getpid());
+  fs::create_directories(dir);
+  std::vector<std::string> paths;
+  for (size_t f = 0; f < nb_files; f++) { paths.push_back((dir / fmt::format("{}.kmer", f)).string()); }
+  return paths;
+}
+
+static void write_files(const std::vector<std::string>& paths, const std::vector<uint64_t>& kmers, bool lz4) {
+  for (size_t f = 0; f < paths.size(); f++) {
+    km::KmerWriter<8192> writer(paths[f], 31, sizeof(count_t), 0, f, lz4);
+    for (size_t i = 0; i < kmers.size(); i++) { writer.write_raw<4294967295>(&kmers[i], static_cast<count_t>(i + f)); }
+  }
+}
+
+// returns false when the engine is not available
+static bool set_engine(benchmark::State& state, const bench_options& opt, km::IO_ENGINE engine) {
+  if (engine == km::IO_ENGINE::URING && !km::Uring::available()) {
+    state.SkipWithError("io_uring is not available");
+    return false;
+  }
+  km::AsyncIO::get().set(engine, opt.io_block_kb << 10);
+  return true;
+}
+
+static void BM_KmerWriter(benchmark::State& state, const bench_options& opt, km::IO_ENGINE engine, bool lz4) {
+  if (!set_engine(state, opt, engine)) { return; }
+  std::mt19937_64 rng(42);
+  std::vector<uint64_t> kmers(nb_kmers);
+  for (auto& kmer : kmers) { kmer = rng() >> 2; }
+  auto paths = file_paths(opt);
+
+  for (auto _ : state) { write_files(paths, kmers, lz4); }
+  state.SetBytesProcessed(state.iterations() * nb_files * nb_kmers * (sizeof(uint64_t) + sizeof(count_t)));
+  state.counters["file_bytes"] = fs::file_size(paths[0]) * nb_files;
+  fs::remove_all(fs::path(paths[0]).parent_path());
+  km::AsyncIO::get().set(km::IO_ENGINE::FSTREAM);
+}
+
+static void BM_KmerReader(benchmark::State& state, const bench_options& opt, km::IO_ENGINE engine, bool lz4) {
+  if (!set_engine(state, opt, engine)) { return; }
+  std::mt19937_64 rng(42);
+  std::vector<uint64_t> kmers(nb_kmers);
+  for (auto& kmer : kmers) { kmer = rng() >> 2; }
+  auto paths = file_paths(opt);
+  write_files(paths, kmers, lz4);
+
+  km::Kmer<32> kmer;
+  kmer.set_k(31);
+  count_t count;
+  uint64_t check = 0;
+  for (auto _ : state) {
+    if (opt.io_cold) {
+      state.PauseTiming();
+      for (const auto& path : paths) { drop_cache(path); }
+      state.ResumeTiming();
+    }
+    for (const auto& path : paths) {
+      km::KmerReader<8192> reader(path);
+      while (reader.read<32, 4294967295>(kmer, count)) { check += kmer.get_data64()[0] ^ count; }
+    }
+  }
+  benchmark::DoNotOptimize(check);
+  state.SetBytesProcessed(state.iterations() * nb_files * nb_kmers * (sizeof(uint64_t) + sizeof(count_t)));
+  fs::remove_all(fs::path(paths[0]).parent_path());
+  km::AsyncIO::get().set(km::IO_ENGINE::FSTREAM);
+}
+
+void register_async_io_benchmarks(const bench_options& opt) {
+  for (auto engine : {km::IO_ENGINE::FSTREAM, km::IO_ENGINE::PREAD, km::IO_ENGINE::URING}) {
+    for (bool lz4 : {false, true}) {
+      std::string suffix = fmt::format("{}/lz4:{:d}", km::io_engine_to_str(engine), lz4);
+      benchmark::RegisterBenchmark(("KmerWriter/" + suffix).c_str(), [=](benchmark::State& state) {
+        BM_KmerWriter(state, opt, engine, lz4);
+      })->Unit(benchmark::kMillisecond)->UseRealTime();
+      benchmark::RegisterBenchmark(("KmerReader/" + suffix).c_str(), [=](benchmark::State& state) {
+        BM_KmerReader(state, opt, engine, lz4);
+      })->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+  }
+}
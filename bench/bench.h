@@ -0,0 +1,30 @@
+// Shared declarations of the kmat_bench benchmarks (google benchmark). Each bench/*.cpp
+// registers its benchmarks from the options parsed in bench/kmat_bench.cpp.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct bench_options
+{
+  std::vector<int64_t> samples{10, 100, 1000}; // matrix row kernels
+  std::vector<int64_t> threads;                // task pool workers {1, 4, hardware concurrency}
+  int64_t lookup_unitigs{100000};              // sshash dictionary of the lookup benchmarks
+  std::string io_dir;                          // partition files {temporary directory}
+  int64_t io_block_kb{1024};
+  bool io_cold{false};                         // drop the files from the page cache before reading
+  std::string socket;                          // a running muset serve instance, with queries
+  std::string queries;
+  int64_t batch_size{16};
+  std::vector<int64_t> clients{1, 4};
+};
+
+void register_kmat_benchmarks(const bench_options& opt);
+void register_kmer_compare_benchmarks(const bench_options& opt);
+void register_revcomp_benchmarks(const bench_options& opt);
+void register_task_pool_benchmarks(const bench_options& opt);
+void register_numa_benchmarks(const bench_options& opt);
+void register_async_io_benchmarks(const bench_options& opt);
+void register_query_server_benchmarks(const bench_options& opt);
@@ -0,0 +1,149 @@
+#!/bin/bash
+# Offline benchmark of muset and of the kmat_tools stages on synthetic cohorts generated by
+# cohort_gen (bench/cohort_gen.cpp), at several cohort sizes. Writes one JSON file with the
+# wall time, CPU time and peak RSS of every command, plus the stage report of each muset run
+# (muset_report.json). Failed commands are marked in the results, the commands depending on
+# them are skipped, and the script exits with status 1.
+# Usage: bench/cohort_bench.sh [-b bin_dir] [-o work_dir] [-t threads] [-d depth] [-e error_rate]
+#                              [-g genome_size] [-s seed] [sizes...]    (sizes default: 10 100 1000)
+
+set -euo pipefail
+
+BIN_DIR="$(cd "$(dirname "$0")/.." && pwd)/bin"
+WORK_DIR="cohort_bench"
+THREADS=4
+DEPTH=4
+ERROR_RATE=0.005
+GENOME_SIZE=200000
+SEED=42
+
+while getopts "b:o:t:d:e:g:s:h" opt; do
+  case $opt in
+    b) BIN_DIR=$OPTARG ;;
+    o) WORK_DIR=$OPTARG ;;
+    t) THREADS=$OPTARG ;;
+    d) DEPTH=$OPTARG ;;
+    e) ERROR_RATE=$OPTARG ;;
+    g) GENOME_SIZE=$OPTARG ;;
+    s) SEED=$OPTARG ;;
+    *) sed -n '2,8p' "$0"; exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+SIZES=("$@")
+if [[ ${#SIZES[@]} -eq 0 ]]; then
+  SIZES=(10 100 1000)
+fi
+
+for tool in cohort_gen muset kmat_tools; do
+  if [[ ! -x "$BIN_DIR/$tool" ]]; then
+    echo "missing $BIN_DIR/$tool (cohort_gen is built with -DBUILD_BENCHMARKS=ON)" >&2
+    exit 1
+  fi
+done
+
+mkdir -p "$WORK_DIR"
+WORK_DIR=$(cd "$WORK_DIR" && pwd)
+RESULTS="$WORK_DIR/bench_results.json"
+
+# GNU time gives the peak RSS, otherwise only times are recorded
+GNU_TIME=""
+if [[ -x /usr/bin/time ]] && /usr/bin/time -f "%M" true 2>/dev/null; then
+  GNU_TIME=/usr/bin/time
+fi
+
+RUNS=()
+FAILED=0
+
+# measure <size> <name> <input bytes> <command...>: runs a command and records one JSON object,
+# with "failed": true and the exit status of the command when it fails
+measure() {
+  local size=$1 name=$2 input_bytes=$3
+  shift 3
+  local file="$WORK_DIR/$size/${name//[^a-zA-Z0-9]/_}"
+  local log="$file.log" stats="$file.time"
+  local start end status=0 peak_rss=null user=null sys=null
+  echo "[$size samples] $name" >&2
+  start=$(date +%s.%N)
+  if [[ -n "$GNU_TIME" ]]; then
+    "$GNU_TIME" -o "$stats" -f "%M %U %S" "$@" >"$log" 2>&1 || status=$?
+    # a failed command adds a first line to the GNU time output
+    read -r peak_rss user sys < <(tail -1 "$stats") || true
+    peak_rss=$((peak_rss * 1024))
+  else
+    "$@" >"$log" 2>&1 || status=$?
+  fi
+  end=$(date +%s.%N)
+  RUNS+=("$(awk -v s="$size" -v n="$name" -v a="$start" -v b="$end" -v st="$status" -v rss="$peak_rss" \
+                -v u="$user" -v y="$sys" -v ib="$input_bytes" -v t="$THREADS" 'BEGIN {
+      wall = b - a
+      printf "{\"samples\": %d, \"command\": \"%s\", \"threads\": %d, \"exit_status\": %d, \"failed\": %s, \"wall_s\": %.3f, ", s, n, t, st, st ? "true" : "false", wall
+      printf "\"user_s\": %s, \"sys_s\": %s, \"peak_rss_bytes\": %s, \"input_bytes\": %d", u, y, rss, ib
+      if (wall > 0) printf ", \"input_mb_per_s\": %.2f", ib / 1048576 / wall
+      printf "}"
+    }')")
+  if [[ $status -ne 0 ]]; then
+    echo "  failed with status $status, see $log" >&2
+    FAILED=$((FAILED + 1))
+  fi
+  return $status
+}
+
+bytes() { du -cb "$@" 2>/dev/null | tail -1 | cut -f1; }
+
+REPORTS=()
+for size in "${SIZES[@]}"; do
+  dir="$WORK_DIR/$size"
+  rm -rf "$dir"
+  mkdir -p "$dir"
+
+  # the commands depending on a failed one are skipped
+  measure "$size" cohort_gen 0 "$BIN_DIR/cohort_gen" "$dir/reads" "$size" "$DEPTH" "$ERROR_RATE" "$GENOME_SIZE" 8 150 "$SEED" || continue
+  measure "$size" muset "$(bytes "$dir"/reads/*.fastq)" \
+    "$BIN_DIR/muset" --file "$dir/reads/fof.txt" -o "$dir/muset" -t "$THREADS" --keep-temp || true
+  if [[ -f "$dir/muset/muset_report.json" ]]; then
+    REPORTS+=("{\"samples\": $size, \"report\": $(cat "$dir/muset/muset_report.json")}")
+  fi
+
+  mat="$dir/muset/matrix.filtered.mat"
+  if [[ ! -f "$mat" ]]; then
+    echo "no filtered matrix for $size samples, skipping the kmat stages" >&2
+    continue
+  fi
+  mat_bytes=$(bytes "$mat")
+  kmat="$BIN_DIR/kmat_tools"
+  mkdir -p "$dir/tmp"
+  if measure "$size" "kmat sort" "$mat_bytes" "$kmat" sort -t "$THREADS" --tmp-dir "$dir/tmp" -o "$dir/sorted.mat" "$mat"; then
+    measure "$size" "kmat merge" "$((2 * mat_bytes))" \
+      "$kmat" merge -t "$THREADS" --tmp-dir "$dir/tmp" -o "$dir/merged.mat" "$dir/sorted.mat" "$dir/sorted.mat" || true
+    measure "$size" "kmat diff" "$((2 * mat_bytes))" \
+      "$kmat" diff -t "$THREADS" --tmp-dir "$dir/tmp" -o "$dir/diff.mat" "$dir/sorted.mat" "$dir/sorted.mat" || true
+    measure "$size" "kmat select" "$((2 * mat_bytes))" \
+      "$kmat" select -t "$THREADS" --tmp-dir "$dir/tmp" -o "$dir/select.mat" "$dir/sorted.mat" "$dir/sorted.mat" || true
+  fi
+  measure "$size" "kmat reverse" "$mat_bytes" "$kmat" reverse -c -o "$dir/reverse.mat" "$mat" || true
+  measure "$size" "kmat fasta" "$mat_bytes" "$kmat" fasta -o "$dir/kmers.fasta" "$mat" || true
+  if [[ -f "$dir/muset/unitigs.fa" ]]; then
+    for engine in kmer unitig; do
+      measure "$size" "kmat unitig ($engine)" "$mat_bytes" \
+        "$kmat" unitig -t "$THREADS" --engine "$engine" -p "$dir/unitig_$engine" "$dir/muset/unitigs.fa" "$mat" || true
+    done
+  fi
+  rm -rf "$dir/tmp"
+done
+
+join() { local IFS=","; echo "$*"; }
+{
+  echo "{"
+  echo "  \"host\": \"$(hostname)\", \"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\","
+  echo "  \"depth\": $DEPTH, \"error_rate\": $ERROR_RATE, \"genome_size\": $GENOME_SIZE, \"seed\": $SEED,"
+  echo "  \"peak_rss_available\": $([[ -n "$GNU_TIME" ]] && echo true || echo false),"
+  echo "  \"runs\": [$(join "${RUNS[@]}")],"
+  echo "  \"muset_reports\": [$(join "${REPORTS[@]}")]"
+  echo "}"
+} >"$RESULTS"
+echo "results written to $RESULTS" >&2
+if [[ $FAILED -gt 0 ]]; then
+  echo "$FAILED commands failed" >&2
+  exit 1
+fi
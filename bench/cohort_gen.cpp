@@ -0,0 +1,139 @@
+// Synthetic cohort generator for the offline benchmarks (bench/cohort_bench.sh): a random
+// core genome, nb_strains strains carrying SNPs on the core and a strain-specific region,
+// and nb_samples FASTQ samples, each one a mix of 1 to 3 strains sequenced at the given
+// depth with substitution errors. Writes <out_dir>/S<i>.fastq and a kmtricks file of files
+// <out_dir>/fof.txt.
+//
+// The generator only draws raw 64-bit values from std::mt19937_64, whose sequence is
+// fixed by the standard, so a seed gives the same cohort on every platform.
+//
+//   cohort_gen <out_dir> <nb_samples> [depth {4}] [error_rate {0.005}] [genome_size {200000}]
+//              [nb_strains {8}] [read_length {150}] [seed {42}]
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+
+class Random {
+ public:
+  explicit Random(uint64_t seed) : m_rng(seed) {}
+
+  // uniform in [0, n)
+  uint64_t below(uint64_t n) { return static_cast<uint64_t>((static_cast<__uint128_t>(m_rng()) * n) >> 64); }
+
+  // uniform in [0, 1)
+  double unit() { return (m_rng() >> 11) * 0x1.0p-53; }
+
+  char base() { return "ACGT"[m_rng() >> 62]; }
+
+  std::string sequence(size_t n) {
+    std::string seq(n, 'A');
+    for (auto& c : seq) { c = base(); }
+    return seq;
+  }
+
+ private:
+  std::mt19937_64 m_rng;
+};
+
+static char complement(char c) {
+  switch (c) {
+    case 'A': return 'T';
+    case 'C': return 'G';
+    case 'G': return 'C';
+    default: return 'A';
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fmt::print(stderr, "usage: {} <out_dir> <nb_samples> [depth] [error_rate] [genome_size] [nb_strains] [read_length] [seed]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  fs::path out_dir = argv[1];
+  size_t nb_samples = std::strtoull(argv[2], nullptr, 10);
+  double depth = argc > 3 ? std::strtod(argv[3], nullptr) : 4;
+  double error_rate = argc > 4 ? std::strtod(argv[4], nullptr) : 0.005;
+  size_t genome_size = argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 200000;
+  size_t nb_strains = argc > 6 ? std::strtoull(argv[6], nullptr, 10) : 8;
+  size_t read_length = argc > 7 ? std::strtoull(argv[7], nullptr, 10) : 150;
+  uint64_t seed = argc > 8 ? std::strtoull(argv[8], nullptr, 10) : 42;
+
+  if (nb_samples == 0 || nb_strains == 0 || genome_size < read_length) {
+    fmt::print(stderr, "need at least one sample and one strain, and a genome longer than the reads\n");
+    return EXIT_FAILURE;
+  }
+  fs::create_directories(out_dir);
+  Random random(seed);
+
+  // strains: the core with 0.5% SNPs, followed by their own region of 10% of the core
+  const double snp_rate = 0.005;
+  const size_t specific_size = genome_size / 10;
+  std::string core = random.sequence(genome_size);
+  std::vector<std::string> strains;
+  for (size_t s = 0; s < nb_strains; s++) {
+    std::string strain = core;
+    for (auto& c : strain) {
+      if (random.unit() < snp_rate) { c = "ACGT"[(std::string_view("ACGT").find(c) + 1 + random.below(3)) % 4]; }
+    }
+    strain += random.sequence(specific_size);
+    strains.push_back(std::move(strain));
+  }
+
+  std::ofstream fof(out_dir / "fof.txt");
+  std::string read, quality(read_length, 'I');
+  uint64_t total_reads = 0;
+  for (size_t i = 0; i < nb_samples; i++) {
+    // 1 to 3 distinct strains with random relative abundances
+    size_t nb_mixed = 1 + random.below(std::min<size_t>(3, nb_strains));
+    std::vector<size_t> mixed;
+    while (mixed.size() < nb_mixed) {
+      size_t s = random.below(nb_strains);
+      if (std::find(mixed.begin(), mixed.end(), s) == mixed.end()) { mixed.push_back(s); }
+    }
+    std::vector<double> weights;
+    double total_weight = 0;
+    for (size_t j = 0; j < nb_mixed; j++) {
+      weights.push_back(0.1 + random.unit());
+      total_weight += weights.back();
+    }
+
+    std::string name = fmt::format("S{}", i + 1);
+    fs::path path = out_dir / (name + ".fastq");
+    std::ofstream out(path);
+    size_t nb_reads = static_cast<size_t>(depth * strains[0].size() / read_length);
+    for (size_t r = 0; r < nb_reads; r++) {
+      double pick = random.unit() * total_weight;
+      size_t j = 0;
+      while (j + 1 < nb_mixed && pick >= weights[j]) { pick -= weights[j++]; }
+      const std::string& strain = strains[mixed[j]];
+
+      size_t pos = random.below(strain.size() - read_length + 1);
+      read.assign(strain, pos, read_length);
+      if (random.below(2)) {
+        std::reverse(read.begin(), read.end());
+        for (auto& c : read) { c = complement(c); }
+      }
+      for (auto& c : read) {
+        if (random.unit() < error_rate) { c = "ACGT"[(std::string_view("ACGT").find(c) + 1 + random.below(3)) % 4]; }
+      }
+      out << '@' << name << '.' << r << '\n' << read << "\n+\n" << quality << '\n';
+    }
+    total_reads += nb_reads;
+    fof << name << " : " << fs::absolute(path).string() << '\n';
+  }
+
+  fmt::print("{} samples, {} strains of {} bp, {} reads of {} bp, depth {}, error rate {}\n",
+             nb_samples, nb_strains, strains[0].size(), total_reads, read_length, depth, error_rate);
+  return 0;
+}
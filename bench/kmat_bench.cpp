@@ -0,0 +1,365 @@
+// Microbenchmarks (google benchmark) of the muset hot paths: matrix row parsing, mean/median
+// aggregation, matrix writers and sshash lookups (this file), k-mer comparisons and merges
+// (kmer_compare.cpp), reverse complement (revcomp.cpp), the kmtricks task pool (task_pool.cpp)
+// and its NUMA placement (numa.cpp), the I/O engines of the partition files (async_io.cpp)
+// and, given a running server, muset serve (query_server.cpp). Kernels working on matrix
+// rows are run for each sample count of --samples, the task pools for each worker count of
+// --threads, the sshash lookups on a dictionary of --lookup-unitigs random unitigs.
+//
+//   kmat_bench [--samples=10,100,1000] [--threads=1,4,<cores>] [--lookup-unitigs=100000]
+//              [--io-dir=<tmp dir>] [--io-block-kb=1024] [--io-cold]
+//              [--socket=<muset serve socket> --queries=<fasta> --batch-size=16 --clients=1,4]
+//              [google benchmark flags, e.g. --benchmark_filter=Median
+//               --benchmark_format=json --benchmark_out=results.json]
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include <kmat_tools/aggregator.h>
+#include <kmat_tools/matrix.h>
+#include <kmat_tools/matrix_writer.h>
+#include <kmat_tools/utils.h>
+
+#include "../external/sshash/dictionary.hpp"
+#include "bench.h"
+
+namespace fs = std::filesystem;
+using namespace kmat;
+
+static const char nt[4] = {'A', 'C', 'G', 'T'};
+
+static std::string random_sequence(std::mt19937_64& rng, size_t n) {
+  std::string seq(n, 'A');
+  for (auto& c : seq) { c = nt[rng() & 3]; }
+  return seq;
+}
+
+// k-mer count rows with about half of the counts zero, as in a filtered matrix
+static std::vector<std::vector<uint32_t>> random_rows(size_t nb_rows, size_t nb_samples) {
+  std::mt19937_64 rng(42);
+  std::vector<std::vector<uint32_t>> rows(nb_rows, std::vector<uint32_t>(nb_samples));
+  for (auto& row : rows) {
+    for (auto& count : row) { count = (rng() & 1) ? 0 : 1 + rng() % 50; }
+  }
+  return rows;
+}
+
+static fs::path temp_path(const std::string& name) {
+  return fs::temp_directory_path() / fmt::format("kmat_bench.{}.{}", getpid(), name);
+}
+
+// one row per iteration
+static void BM_TextMatrixReader_read_kmer_counts(benchmark::State& state) {
+  const size_t nb_samples = state.range(0);
+  const size_t nb_rows = 20000;
+  std::mt19937_64 rng(42);
+  fs::path path = temp_path("read.mat");
+  {
+    std::ofstream out(path);
+    for (const auto& row : random_rows(nb_rows, nb_samples)) {
+      out << random_sequence(rng, 31);
+      for (auto count : row) { out << ' ' << count; }
+      out << '\n';
+    }
+  }
+
+  std::string kmer;
+  std::vector<uint32_t> counts;
+  auto reader = std::make_unique<TextMatrixReader<>>(path.string());
+  for (auto _ : state) {
+    if (!reader->read_kmer_counts(kmer, counts)) {
+      state.PauseTiming();
+      reader = std::make_unique<TextMatrixReader<>>(path.string());
+      state.ResumeTiming();
+      reader->read_kmer_counts(kmer, counts);
+    }
+    benchmark::DoNotOptimize(counts.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * fs::file_size(path) / nb_rows);
+  reader.reset();
+  fs::remove(path);
+}
+
+// one dense k-mer row per iteration, into 10000 unitigs
+static void BM_MeanAggregator_process_kmer(benchmark::State& state) {
+  const size_t nb_samples = state.range(0);
+  const size_t nb_unitigs = 10000;
+  auto rows = random_rows(1024, nb_samples);
+  MeanAggregator<uint32_t> aggregator(nb_samples, nb_unitigs, 0.0);
+  size_t i = 0;
+  for (auto _ : state) {
+    aggregator.process_kmer((i * 7919) % nb_unitigs, rows[i & 1023]);
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// the abundance and fraction of one (unitig, sample) per iteration, unitigs of 1 to 64 k-mers
+static void BM_MedianAggregator_get_abundance_fraction(benchmark::State& state) {
+  const size_t nb_samples = state.range(0);
+  const size_t nb_unitigs = 1000;
+  std::mt19937_64 rng(42);
+  auto rows = random_rows(1024, nb_samples);
+  MedianAggregator<uint32_t> aggregator(nb_samples, nb_unitigs, 0.0);
+  std::vector<size_t> nb_kmers(nb_unitigs);
+  for (size_t u = 0; u < nb_unitigs; u++) {
+    nb_kmers[u] = 1 + rng() % 64;
+    for (size_t j = 0; j < nb_kmers[u]; j++) { aggregator.process_kmer(u, rows[rng() & 1023]); }
+  }
+
+  size_t u = 0, s = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(aggregator.get_abundance_fraction(u, s, nb_kmers[u]));
+    if (++s == nb_samples) {
+      s = 0;
+      u = (u + 1) % nb_unitigs;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// one unitig row per iteration, abundances and fractions
+template<typename Writer>
+static void write_rows(benchmark::State& state, Writer& writer, size_t nb_samples) {
+  std::mt19937_64 rng(42);
+  std::vector<std::vector<double>> abundances(64, std::vector<double>(nb_samples));
+  std::vector<std::vector<double>> fractions(64, std::vector<double>(nb_samples));
+  for (size_t r = 0; r < 64; r++) {
+    for (size_t s = 0; s < nb_samples; s++) {
+      abundances[r][s] = (rng() & 1) ? 0.0 : (rng() % 5000) / 100.0;
+      fractions[r][s] = abundances[r][s] > 0 ? (rng() % 101) / 100.0 : 0.0;
+    }
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    writer.write_row(std::to_string(i), abundances[i & 63], fractions[i & 63]);
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_TextMatrixWriter_write_row(benchmark::State& state) {
+  const size_t nb_samples = state.range(0);
+  fs::path prefix = temp_path("text");
+  {
+    TextMatrixWriter writer(prefix.string(), true);
+    write_rows(state, writer, nb_samples);
+  }
+  fs::remove(prefix.string() + ".abundance.mat");
+  fs::remove(prefix.string() + ".frac.mat");
+}
+
+static void BM_CompressedTSVMatrixWriter_write_row(benchmark::State& state) {
+  const size_t nb_samples = state.range(0);
+  fs::path prefix = temp_path("tsv");
+  {
+    CompressedTSVMatrixWriter writer(prefix.string(), true, nb_samples);
+    write_rows(state, writer, nb_samples);
+  }
+  fs::remove(prefix.string() + ".abundance.tsv.gz");
+  fs::remove(prefix.string() + ".frac.tsv.gz");
+}
+
+// Canonical k-mers of random unitigs (all of their k-mers, as in a filtered matrix) and the
+// sshash dictionary of the unitigs (k = 31, m = 15), built once per unitig count
+struct lookup_data
+{
+  static constexpr size_t k = 31;
+  sshash::dictionary dict;
+  std::vector<uint64_t> kmers; // 2-bit A < C < G < T, first base in the high bits: matrix order
+};
+
+static const lookup_data& lookup_dataset(size_t nb_unitigs) {
+  static std::map<size_t, std::unique_ptr<lookup_data>> datasets;
+  auto& data = datasets[nb_unitigs];
+  if (data) { return *data; }
+  data = std::make_unique<lookup_data>();
+  const size_t k = lookup_data::k;
+
+  std::mt19937_64 rng(42);
+  fs::path fasta = temp_path("unitigs.fa");
+  {
+    std::ofstream out(fasta);
+    for (size_t u = 0; u < nb_unitigs; u++) {
+      std::string unitig = random_sequence(rng, k + rng() % 240);
+      out << '>' << u << '\n' << unitig << '\n';
+      for (size_t i = 0; i + k <= unitig.size(); i++) {
+        uint64_t fwd = 0, rev = 0;
+        for (size_t j = 0; j < k; j++) {
+          uint64_t c = std::find(nt, nt + 4, unitig[i + j]) - nt;
+          fwd = fwd << 2 | c;
+          rev |= (3 - c) << (2 * j);
+        }
+        data->kmers.push_back(std::min(fwd, rev));
+      }
+    }
+  }
+
+  std::streambuf* coutbuf = std::cout.rdbuf(nullptr);
+  sshash::build_configuration build_config;
+  build_config.k = k;
+  build_config.m = 15;
+  build_config.canonical_parsing = true;
+  build_config.verbose = false;
+  data->dict.build(fasta.string(), build_config);
+  std::cout.rdbuf(coutbuf);
+  fs::remove(fasta);
+  return *data;
+}
+
+static sshash::kmer_t to_sshash(uint64_t kmer) {
+  char str[lookup_data::k];
+  for (size_t j = 0; j < lookup_data::k; j++) { str[j] = nt[(kmer >> (2 * (lookup_data::k - 1 - j))) & 3]; }
+  return sshash::util::string_to_uint_kmer(str, lookup_data::k);
+}
+
+// the minimizer of a canonical k-mer in the dictionary, whose bucket holds the k-mer
+static uint64_t sshash_minimizer(const sshash::dictionary& dict, sshash::kmer_t kmer) {
+  sshash::kmer_t rc = sshash::util::compute_reverse_complement(kmer, dict.k());
+  return std::min(sshash::util::compute_minimizer(kmer, dict.k(), dict.m(), dict.seed()),
+                  sshash::util::compute_minimizer(rc, dict.k(), dict.m(), dict.seed()));
+}
+
+// the k-mers of a sorted matrix, in sshash form, grouped by minimizer (matrix order within a group)
+static std::vector<sshash::kmer_t> group_by_minimizer(const sshash::dictionary& dict, const std::vector<sshash::kmer_t>& kmers) {
+  std::vector<std::pair<uint64_t, uint32_t>> keys(kmers.size());
+  for (size_t i = 0; i < kmers.size(); i++) { keys[i] = {sshash_minimizer(dict, kmers[i]), static_cast<uint32_t>(i)}; }
+  std::sort(keys.begin(), keys.end());
+  std::vector<sshash::kmer_t> grouped(kmers.size());
+  for (size_t i = 0; i < keys.size(); i++) { grouped[i] = kmers[keys[i].second]; }
+  return grouped;
+}
+
+enum class lookup_order { matrix, minimizer, shuffled };
+
+// one lookup_advanced per iteration, of the k-mers of a sorted matrix in the given order;
+// same_minimizer is the share of lookups in the bucket of the previous one
+static void BM_sshash_lookup_advanced(benchmark::State& state, const bench_options& opt, lookup_order order) {
+  const lookup_data& data = lookup_dataset(opt.lookup_unitigs);
+  std::vector<uint64_t> sorted = data.kmers;
+  std::sort(sorted.begin(), sorted.end());
+  std::vector<sshash::kmer_t> kmers(sorted.size());
+  std::transform(sorted.begin(), sorted.end(), kmers.begin(), to_sshash);
+  sorted = std::vector<uint64_t>();
+  if (order == lookup_order::minimizer) {
+    kmers = group_by_minimizer(data.dict, kmers);
+  } else if (order == lookup_order::shuffled) {
+    std::shuffle(kmers.begin(), kmers.end(), std::mt19937_64(42));
+  }
+  size_t same_minimizer = 0;
+  for (size_t i = 1; i < kmers.size(); i++) {
+    same_minimizer += sshash_minimizer(data.dict, kmers[i]) == sshash_minimizer(data.dict, kmers[i - 1]);
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(data.dict.lookup_advanced_uint(kmers[i]));
+    if (++i == kmers.size()) { i = 0; }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["kmers"] = kmers.size();
+  state.counters["same_minimizer"] = static_cast<double>(same_minimizer) / std::max<size_t>(kmers.size(), 1);
+}
+
+// the grouping itself, per k-mer: what a lookup in minimizer order has to save to pay off
+static void BM_sshash_group_by_minimizer(benchmark::State& state, const bench_options& opt) {
+  const lookup_data& data = lookup_dataset(opt.lookup_unitigs);
+  std::vector<uint64_t> sorted = data.kmers;
+  std::sort(sorted.begin(), sorted.end());
+  std::vector<sshash::kmer_t> kmers(sorted.size());
+  std::transform(sorted.begin(), sorted.end(), kmers.begin(), to_sshash);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(group_by_minimizer(data.dict, kmers).data());
+  }
+  state.SetItemsProcessed(state.iterations() * kmers.size());
+}
+
+void register_kmat_benchmarks(const bench_options& opt) {
+  auto per_samples = [&](const char* name, void (*fn)(benchmark::State&)) {
+    auto* b = benchmark::RegisterBenchmark(name, fn);
+    b->ArgName("samples");
+    for (auto n : opt.samples) { b->Arg(n); }
+  };
+  per_samples("TextMatrixReader::read_kmer_counts", BM_TextMatrixReader_read_kmer_counts);
+  per_samples("MeanAggregator::process_kmer", BM_MeanAggregator_process_kmer);
+  per_samples("MedianAggregator::get_abundance_fraction", BM_MedianAggregator_get_abundance_fraction);
+  per_samples("TextMatrixWriter::write_row", BM_TextMatrixWriter_write_row);
+  per_samples("CompressedTSVMatrixWriter::write_row", BM_CompressedTSVMatrixWriter_write_row);
+  for (auto [order, name] : {std::pair(lookup_order::matrix, "matrix"), std::pair(lookup_order::minimizer, "minimizer"),
+                             std::pair(lookup_order::shuffled, "shuffled")}) {
+    benchmark::RegisterBenchmark(fmt::format("sshash::dictionary::lookup_advanced/{}", name).c_str(), [=, &opt](benchmark::State& state) {
+      BM_sshash_lookup_advanced(state, opt, order);
+    });
+  }
+  benchmark::RegisterBenchmark("sshash::group_by_minimizer", [&opt](benchmark::State& state) {
+    BM_sshash_group_by_minimizer(state, opt);
+  })->Unit(benchmark::kMillisecond);
+}
+
+// comma-separated integers
+static std::vector<int64_t> parse_list(const char* value) {
+  std::vector<int64_t> values;
+  while (*value) {
+    char* end;
+    values.push_back(std::strtoll(value, &end, 10));
+    if (*end != ',') { break; }
+    value = end + 1;
+  }
+  return values;
+}
+
+int main(int argc, char** argv) {
+  // --<option>=<value> options are ours, the other flags go to google benchmark
+  bench_options opt;
+  opt.threads = {1, 4, std::max<int64_t>(1, std::thread::hardware_concurrency())};
+  std::vector<char*> args;
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(0, eq);
+    const char* value = eq == std::string::npos ? "" : argv[i] + eq + 1;
+    if (name == "--samples") { opt.samples = parse_list(value); }
+    else if (name == "--threads") { opt.threads = parse_list(value); }
+    else if (name == "--lookup-unitigs") { opt.lookup_unitigs = std::strtoll(value, nullptr, 10); }
+    else if (name == "--io-dir") { opt.io_dir = value; }
+    else if (name == "--io-block-kb") { opt.io_block_kb = std::strtoll(value, nullptr, 10); }
+    else if (name == "--io-cold") { opt.io_cold = true; }
+    else if (name == "--socket") { opt.socket = value; }
+    else if (name == "--queries") { opt.queries = value; }
+    else if (name == "--batch-size") { opt.batch_size = std::strtoll(value, nullptr, 10); }
+    else if (name == "--clients") { opt.clients = parse_list(value); }
+    else { args.push_back(argv[i]); }
+  }
+  std::sort(opt.threads.begin(), opt.threads.end());
+  opt.threads.erase(std::unique(opt.threads.begin(), opt.threads.end()), opt.threads.end());
+
+  register_kmat_benchmarks(opt);
+  register_kmer_compare_benchmarks(opt);
+  register_revcomp_benchmarks(opt);
+  register_task_pool_benchmarks(opt);
+  register_numa_benchmarks(opt);
+  register_async_io_benchmarks(opt);
+  register_query_server_benchmarks(opt);
+
+  int nb_args = static_cast<int>(args.size());
+  benchmark::Initialize(&nb_args, args.data());
+  if (benchmark::ReportUnrecognizedArguments(nb_args, args.data())) { return EXIT_FAILURE; }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,135 @@
+// Benchmarks of k-mer comparisons: actg_compare on neighbouring k-mers, and a heap merge of
+// sorted inputs as done by kmat merge (and diff/select for two inputs), with string compare
+// or actg_compare against 2-bit packed compare, the packing cost included (once per k-mer,
+// as the matrix readers do).
+
+#include <algorithm>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <kmat_tools/packed_kmer.h>
+#include <kmat_tools/utils.h>
+
+#include "bench.h"
+
+using namespace kmat;
+
+static const char nt[4] = {'A', 'C', 'G', 'T'};
+
+static std::string random_kmer(std::mt19937_64& rng, size_t k) {
+  std::string kmer(k, 'A');
+  for (auto& c : kmer) { c = nt[rng() & 3]; }
+  return kmer;
+}
+
+// one comparison per iteration, of k-mers sharing a random-length prefix (as neighbours in a sorted matrix)
+static void BM_actg_compare(benchmark::State& state) {
+  const size_t k = state.range(0);
+  std::mt19937_64 rng(42);
+  std::vector<std::string> a(1024), b(1024);
+  for (size_t i = 0; i < 1024; i++) {
+    a[i] = random_kmer(rng, k);
+    b[i] = a[i].substr(0, rng() % k) + random_kmer(rng, k);
+    b[i].resize(k);
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(actg_compare(a[i & 1023], b[i & 1023]));
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// nb_inputs sorted lists sharing about half of their k-mers, contiguous in memory like lines read from a file
+static std::vector<std::vector<std::string>> random_inputs(size_t nb_kmers, size_t nb_inputs, size_t k, bool actg_order) {
+  std::mt19937_64 rng(42);
+  std::vector<std::string> pool(nb_kmers / nb_inputs * 2);
+  for (auto& kmer : pool) { kmer = random_kmer(rng, k); }
+
+  auto less = [actg_order](const std::string& x, const std::string& y) {
+    return (actg_order ? actg_compare(x, y) : x.compare(y)) < 0;
+  };
+  std::vector<std::vector<std::string>> inputs(nb_inputs);
+  for (auto& input : inputs) {
+    std::vector<std::string> kmers;
+    for (const auto& kmer : pool) {
+      if (rng() & 1) { kmers.push_back(kmer); }
+    }
+    std::sort(kmers.begin(), kmers.end(), less);
+    input = std::vector<std::string>(kmers.begin(), kmers.end());
+  }
+  return inputs;
+}
+
+// heap merge, returns the number of distinct k-mers
+static size_t heap_merge(const std::vector<std::vector<std::string>>& inputs, bool actg_order, bool packed) {
+  std::vector<size_t> pos(inputs.size(), 0);
+  std::vector<PackedKmer> keys(inputs.size());
+  auto load = [&](size_t i) {
+    if (packed && pos[i] < inputs[i].size()) { keys[i].assign(inputs[i][pos[i]], actg_order); }
+  };
+  auto compare = [&](size_t a, size_t b) {
+    const auto& x = inputs[a][pos[a]];
+    const auto& y = inputs[b][pos[b]];
+    if (packed) { return compare_kmers(x, keys[a], y, keys[b], actg_order); }
+    return actg_order ? actg_compare(x, y) : x.compare(y);
+  };
+  auto greater = [&](size_t a, size_t b) {
+    int cmp = compare(a, b);
+    return cmp == 0 ? a > b : cmp > 0;
+  };
+
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+  for (size_t i = 0; i < inputs.size(); i++) {
+    load(i);
+    if (!inputs[i].empty()) { heap.push(i); }
+  }
+
+  size_t distinct = 0;
+  std::vector<size_t> popped;
+  while (!heap.empty()) {
+    size_t top = heap.top();
+    while (!heap.empty() && (heap.top() == top || compare(heap.top(), top) == 0)) {
+      popped.push_back(heap.top());
+      heap.pop();
+    }
+    for (auto i : popped) {
+      pos[i]++;
+      load(i);
+      if (pos[i] < inputs[i].size()) { heap.push(i); }
+    }
+    popped.clear();
+    distinct++;
+  }
+  return distinct;
+}
+
+// one merge of 200000 k-mers (k = 31) per iteration; "distinct" is the same with and without packing
+static void BM_heap_merge(benchmark::State& state) {
+  const bool actg_order = state.range(0);
+  const size_t nb_inputs = state.range(1);
+  const bool packed = state.range(2);
+  auto inputs = random_inputs(200000, nb_inputs, 31, actg_order);
+  size_t total = 0;
+  for (const auto& input : inputs) { total += input.size(); }
+
+  size_t distinct = 0;
+  for (auto _ : state) {
+    distinct = heap_merge(inputs, actg_order, packed);
+    benchmark::DoNotOptimize(distinct);
+  }
+  state.SetItemsProcessed(state.iterations() * total);
+  state.counters["distinct"] = distinct;
+}
+
+void register_kmer_compare_benchmarks(const bench_options&) {
+  benchmark::RegisterBenchmark("actg_compare", BM_actg_compare)->ArgName("k")->Arg(31)->Arg(63);
+  benchmark::RegisterBenchmark("heap_merge", BM_heap_merge)
+    ->ArgNames({"actg", "inputs", "packed"})
+    ->ArgsProduct({{0, 1}, {2, 8, 64}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+}
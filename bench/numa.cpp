@@ -0,0 +1,99 @@
+// Benchmark of the NUMA placement of km::TaskPool (muset --numa) on a count-then-merge
+// workload shaped like kmtricks: a count task per partition fills and sorts a buffer it
+// allocates itself (as CountTask does with its MemAllocator pool), then a merge task per
+// partition streams 4 times over that buffer. Without placement the workers float and a
+// partition is merged wherever a worker is free; with placement the workers are pinned and
+// both tasks of a partition run on its node, so the merge reads node-local memory.
+// KMTRICKS_NUMA_NODES=<n> emulates n nodes on a single-node machine (no gain expected).
+// One iteration counts and merges 32 partitions of 4 MB, with the largest worker count of
+// --threads.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <kmtricks/numa.hpp>
+#include <kmtricks/task_pool.hpp>
+
+#include "bench.h"
+
+class LambdaTask : public km::ITask
+{
+ public:
+  LambdaTask(uint32_t level, std::function<void()> f) : ITask(level), m_f(std::move(f)) {}
+  void preprocess() {}
+  void postprocess() { this->m_finish = true; }
+  void exec() { m_f(); }
+
+ private:
+  std::function<void()> m_f;
+};
+
+static void BM_numa_count_merge(benchmark::State& state, size_t nb_threads) {
+  const bool numa = state.range(0);
+  const size_t nb_partitions = 32;
+  const size_t partition_words = (4 << 20) / sizeof(uint64_t);
+  const size_t passes = 4;
+  const km::NumaTopology* topology = numa ? &km::NumaTopology::get() : nullptr;
+  auto place = [&](km::task_t& task, size_t p) {
+    if (topology) task->set_node(topology->node_of_partition(p));
+  };
+
+  double count_s = 0, merge_s = 0;
+  for (auto _ : state) {
+    std::vector<std::unique_ptr<uint64_t[]>> buffers(nb_partitions);
+    std::atomic<uint64_t> check{0};
+    km::TaskPool pool(nb_threads, topology);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t p = 0; p < nb_partitions; p++) {
+      km::task_t task = std::make_shared<LambdaTask>(3, [&, p]() {
+        // allocated and first touched by the worker
+        std::unique_ptr<uint64_t[]> buffer(new uint64_t[partition_words]);
+        std::mt19937_64 rng(p);
+        for (size_t i = 0; i < partition_words; i++) buffer[i] = rng();
+        std::sort(buffer.get(), buffer.get() + partition_words);
+        buffers[p] = std::move(buffer);
+      });
+      place(task, p);
+      pool.add_task(task);
+    }
+    pool.wait_idle();
+    auto middle = std::chrono::steady_clock::now();
+
+    for (size_t p = 0; p < nb_partitions; p++) {
+      km::task_t task = std::make_shared<LambdaTask>(4, [&, p]() {
+        uint64_t sum = 0;
+        for (size_t r = 0; r < passes; r++)
+          for (size_t i = 0; i < partition_words; i++) sum += buffers[p][i] >> (r & 7);
+        check.fetch_add(sum, std::memory_order_relaxed);
+      });
+      place(task, p);
+      pool.add_task(task);
+    }
+    pool.join_all();
+    auto end = std::chrono::steady_clock::now();
+    benchmark::DoNotOptimize(check.load());
+
+    count_s += std::chrono::duration<double>(middle - start).count();
+    merge_s += std::chrono::duration<double>(end - middle).count();
+  }
+
+  double merged_gb = static_cast<double>(state.iterations()) * nb_partitions * partition_words * sizeof(uint64_t) * passes / 1e9;
+  state.counters["merge_gb_per_s"] = merge_s > 0 ? merged_gb / merge_s : 0;
+  state.counters["count_s"] = benchmark::Counter(count_s, benchmark::Counter::kAvgIterations);
+  state.counters["merge_s"] = benchmark::Counter(merge_s, benchmark::Counter::kAvgIterations);
+  state.counters["nodes"] = km::NumaTopology::get().nb_nodes();
+}
+
+void register_numa_benchmarks(const bench_options& opt) {
+  size_t nb_threads = opt.threads.empty() ? 1 : opt.threads.back();
+  benchmark::RegisterBenchmark("TaskPool count-merge", [nb_threads](benchmark::State& state) {
+    BM_numa_count_merge(state, nb_threads);
+  })->ArgName("numa")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+}
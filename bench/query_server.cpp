@@ -0,0 +1,89 @@
+// Throughput benchmark of a running muset serve instance (--socket=<path> --queries=<fasta>):
+// each benchmark thread is a client with its own connection, sending one request of
+// --batch-size queries per iteration, cycling over the records of a FASTA/FASTQ file, for
+// each client count of --clients. Reports requests (iterations) and queries (items) per
+// second and the client-side request latency percentiles, averaged over the clients.
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include <kseq++/seqio.hpp>
+
+#include "../src/muset_socket.h"
+#include "bench.h"
+
+using namespace muset;
+
+struct server_request
+{
+  std::string text;
+  size_t nb_queries;
+};
+
+static void BM_query_server(benchmark::State& state, const std::string& socket, const std::vector<server_request>& requests) {
+  int fd = serve_connect(socket);
+  SocketLineReader reader(fd);
+  std::string line;
+  std::vector<double> latencies;
+  uint64_t nb_queries = 0;
+
+  // client c starts at request c
+  size_t r = state.thread_index();
+  for (auto _ : state) {
+    const server_request& request = requests[r++ % requests.size()];
+    auto t0 = std::chrono::steady_clock::now();
+    write_all(fd, request.text.data(), request.text.size());
+    while (reader.getline(line) && line != SERVE_END) {}
+    latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+    nb_queries += request.nb_queries;
+  }
+  ::close(fd);
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+  };
+  state.SetItemsProcessed(nb_queries);
+  state.counters["p50_latency_us"] = benchmark::Counter(percentile(0.50), benchmark::Counter::kAvgThreads);
+  state.counters["p99_latency_us"] = benchmark::Counter(percentile(0.99), benchmark::Counter::kAvgThreads);
+}
+
+void register_query_server_benchmarks(const bench_options& opt) {
+  if (opt.socket.empty() || opt.queries.empty()) { return; }
+
+  // the requests are formatted once
+  std::vector<server_request> requests;
+  {
+    klibpp::KSeq record;
+    klibpp::SeqStreamIn ssi(opt.queries.c_str());
+    server_request request{"", 0};
+    while (ssi >> record) {
+      request.text += fmt::format(">{}\n{}\n", record.name, record.seq);
+      if (++request.nb_queries == static_cast<size_t>(opt.batch_size)) {
+        request.text += fmt::format("{}\n", SERVE_END);
+        requests.push_back(std::move(request));
+        request = {"", 0};
+      }
+    }
+    if (request.nb_queries > 0) {
+      request.text += fmt::format("{}\n", SERVE_END);
+      requests.push_back(std::move(request));
+    }
+  }
+  if (requests.empty()) {
+    throw std::runtime_error(fmt::format("no query in {}", opt.queries));
+  }
+
+  std::string name = fmt::format("muset serve/batch:{}", opt.batch_size);
+  auto* b = benchmark::RegisterBenchmark(name.c_str(), [socket = opt.socket, requests](benchmark::State& state) {
+    BM_query_server(state, socket, requests);
+  });
+  b->Unit(benchmark::kMicrosecond)->UseRealTime();
+  for (auto nb_clients : opt.clients) { b->Threads(nb_clients); }
+}
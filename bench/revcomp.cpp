@@ -0,0 +1,105 @@
+// Benchmarks of the reverse-complement and canonical kernels used by kmat reverse, against
+// the byte-at-a-time versions (std::reverse then rctable, and a scalar canonical check), and
+// of their 2-bit packed counterparts.
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <kmat_tools/packed_kmer.h>
+#include <kmat_tools/revcomp.h>
+#include <kmat_tools/utils.h>
+
+#include "bench.h"
+
+using namespace kmat;
+
+static void scalar_reverse_complement(std::string& seq) {
+  std::reverse(seq.begin(), seq.end());
+  std::for_each(seq.begin(), seq.end(), [](char& c) { c = rctable[static_cast<unsigned char>(c)]; });
+}
+
+static bool scalar_is_canonical(const std::string& seq) {
+  for (size_t i = 0; i < seq.size(); i++) {
+    unsigned char fc = seq[i];
+    unsigned char rc = rctable[static_cast<unsigned char>(seq[seq.size() - i - 1])];
+    if (fc != rc) { return fc < rc; }
+  }
+  return true;
+}
+
+static std::string random_sequence(std::mt19937_64& rng, size_t n) {
+  static const char nt[4] = {'A', 'C', 'G', 'T'};
+  std::string seq(n, 'A');
+  for (auto& c : seq) { c = nt[rng() & 3]; }
+  return seq;
+}
+
+// 1024 k-mers, half of them sharing a long prefix with their reverse complement
+static std::vector<std::string> random_kmers(size_t k) {
+  std::mt19937_64 rng(42);
+  std::vector<std::string> kmers(1024);
+  for (size_t i = 0; i < kmers.size(); i++) {
+    kmers[i] = random_sequence(rng, k);
+    if (i % 2) { continue; }
+    for (size_t j = 0; j < k / 2 - 1; j++) {
+      kmers[i][k - j - 1] = rctable[static_cast<unsigned char>(kmers[i][j])];
+    }
+  }
+  return kmers;
+}
+
+template<void (*reverse_complement)(std::string&)>
+static void BM_reverse_complement(benchmark::State& state) {
+  const size_t n = state.range(0);
+  std::mt19937_64 rng(42);
+  std::string seq = random_sequence(rng, n);
+  for (auto _ : state) {
+    reverse_complement(seq);
+    benchmark::DoNotOptimize(seq.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * n);
+}
+
+// one k-mer per iteration
+template<bool scalar>
+static void BM_is_canonical(benchmark::State& state) {
+  auto kmers = random_kmers(state.range(0));
+  size_t i = 0;
+  for (auto _ : state) {
+    const std::string& kmer = kmers[i & 1023];
+    benchmark::DoNotOptimize(scalar ? scalar_is_canonical(kmer) : is_canonical(kmer));
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// one packed k-mer per iteration
+template<bool canonical_only>
+static void BM_packed_reverse_complement(benchmark::State& state) {
+  auto kmers = random_kmers(state.range(0));
+  std::vector<PackedKmer> packed(kmers.size());
+  for (size_t i = 0; i < kmers.size(); i++) { packed[i].assign(kmers[i], false); }
+  size_t i = 0;
+  for (auto _ : state) {
+    const PackedKmer& kmer = packed[i & 1023];
+    benchmark::DoNotOptimize(canonical_only ? canonical(kmer, false) : reverse_complement(kmer, false));
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void register_revcomp_benchmarks(const bench_options&) {
+  benchmark::RegisterBenchmark("reverse_complement_inplace", BM_reverse_complement<reverse_complement_inplace>)
+    ->ArgName("length")->Arg(31)->Arg(63)->Arg(1000);
+  benchmark::RegisterBenchmark("reverse_complement_inplace/scalar", BM_reverse_complement<scalar_reverse_complement>)
+    ->ArgName("length")->Arg(31)->Arg(63)->Arg(1000);
+  benchmark::RegisterBenchmark("is_canonical", BM_is_canonical<false>)->ArgName("k")->Arg(31)->Arg(63);
+  benchmark::RegisterBenchmark("is_canonical/scalar", BM_is_canonical<true>)->ArgName("k")->Arg(31)->Arg(63);
+  benchmark::RegisterBenchmark("PackedKmer reverse_complement", BM_packed_reverse_complement<false>)->ArgName("k")->Arg(31)->Arg(63);
+  benchmark::RegisterBenchmark("PackedKmer canonical", BM_packed_reverse_complement<true>)->ArgName("k")->Arg(31)->Arg(63);
+}
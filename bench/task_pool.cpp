@@ -0,0 +1,109 @@
+// Benchmarks of the scheduling overhead of km::TaskPool (work-stealing, per-worker deques)
+// against km::GlobalQueueTaskPool (one priority queue under one mutex), on 20000 small tasks
+// per iteration:
+//  - flat: all tasks added from the main thread, as the count and merge steps do
+//  - spawn: level-5 tasks adding level-3 tasks from their callback, as the SuperKTask
+//    callbacks of kmtricks do; the global queue pool waits for the parents with the former
+//    20 ms polling loop of the scheduler, TaskPool with join_all
+// Each task spins for `work` iterations of a xorshift generator.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <kmtricks/task_pool.hpp>
+
+#include "bench.h"
+
+class SpinTask : public km::ITask
+{
+ public:
+  SpinTask(uint32_t level, size_t work, std::atomic<uint64_t>& sink)
+    : ITask(level), m_work(work), m_sink(sink) {}
+
+  void preprocess() {}
+
+  void postprocess()
+  {
+    this->exec_callback();
+    this->m_finish = true;
+  }
+
+  void exec()
+  {
+    uint64_t x = 88172645463325252ull + m_work;
+    for (size_t i = 0; i < m_work; i++) { x ^= x << 13; x ^= x >> 7; x ^= x << 17; }
+    m_sink.fetch_add(x & 1, std::memory_order_relaxed);
+  }
+
+ private:
+  size_t m_work;
+  std::atomic<uint64_t>& m_sink;
+};
+
+static constexpr size_t nb_tasks = 20000;
+
+template<typename Pool>
+static void run_flat(size_t nb_threads, size_t work, std::atomic<uint64_t>& sink) {
+  Pool pool(nb_threads);
+  for (size_t i = 0; i < nb_tasks; i++) { pool.add_task(std::make_shared<SpinTask>(3, work, sink)); }
+  pool.join_all();
+}
+
+template<typename Pool>
+static void run_spawn(size_t nb_threads, size_t work, std::atomic<uint64_t>& sink, bool poll) {
+  const size_t nb_children = 64;
+  Pool pool(nb_threads);
+  std::vector<km::task_t> parents;
+  for (size_t i = 0; i < nb_tasks / nb_children; i++) {
+    auto parent = std::make_shared<SpinTask>(5, work, sink);
+    parent->set_callback([&pool, &sink, work]() {
+      for (size_t c = 0; c < nb_children; c++) { pool.add_task(std::make_shared<SpinTask>(3, work, sink)); }
+    });
+    parents.push_back(parent);
+    pool.add_task(parent);
+  }
+  if (poll) {
+    while (!std::all_of(parents.begin(), parents.end(), [](const km::task_t& t) { return t->finish(); })) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+  pool.join_all();
+}
+
+// the pool is created and joined in each iteration
+template<typename Pool, bool spawn>
+static void BM_task_pool(benchmark::State& state) {
+  const size_t nb_threads = state.range(0);
+  const size_t work = state.range(1);
+  std::atomic<uint64_t> sink{0};
+  for (auto _ : state) {
+    if (spawn) {
+      run_spawn<Pool>(nb_threads, work, sink, std::is_same_v<Pool, km::GlobalQueueTaskPool>);
+    } else {
+      run_flat<Pool>(nb_threads, work, sink);
+    }
+  }
+  benchmark::DoNotOptimize(sink.load());
+  state.SetItemsProcessed(state.iterations() * nb_tasks);
+}
+
+void register_task_pool_benchmarks(const bench_options& opt) {
+  auto add = [&](const char* name, void (*fn)(benchmark::State&)) {
+    benchmark::RegisterBenchmark(name, fn)
+      ->ArgNames({"workers", "work"})
+      ->ArgsProduct({opt.threads, {0, 1000}})
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  };
+  add("GlobalQueueTaskPool/flat", BM_task_pool<km::GlobalQueueTaskPool, false>);
+  add("TaskPool/flat", BM_task_pool<km::TaskPool, false>);
+  add("GlobalQueueTaskPool/spawn", BM_task_pool<km::GlobalQueueTaskPool, true>);
+  add("TaskPool/spawn", BM_task_pool<km::TaskPool, true>);
+}
@@ -1,6 +1,8 @@
 #ifndef AGGREGATOR_H
 #define AGGREGATOR_H
 
+#include <algorithm>
+#include <map>
 #include <vector>
 #include <stdint.h>
 #include <iostream>
@@ -12,39 +14,61 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
-// This interface is used to abstract the possible aggregating statistics for per-sample k-mer count in unitigs
+// This interface is used to abstract the possible aggregating statistics for per-sample k-mer count in unitigs.
+// count_type is the width of the input counts (see --count-width), which saturate at its maximum when read;
+// the width of the per-sample accumulators follows from it (see mean_accumulator).
+template<typename count_type = uint32_t>
 class Aggregator {
 public:
     virtual ~Aggregator() = default;
     // Process the counts for a single k-mer belonging to a unitig
-    virtual void process_kmer(size_t unitig_id, const std::vector<uint32_t>& kmer_counts) = 0;
+    virtual void process_kmer(size_t unitig_id, const std::vector<count_type>& kmer_counts) = 0;
+    // Same for a sparse row: only the non-zero counts, with their (increasing) sample indices
+    virtual void process_kmer(size_t unitig_id, const std::vector<uint32_t>& sample_ids, const std::vector<count_type>& kmer_counts) = 0;
     // Calculate the final abundance for a given unitig and sample
     virtual std::pair<double, double> get_abundance_fraction(size_t unitig_id, size_t sample_id, size_t unitig_num_kmers) const = 0;
 };
 
+// Widths of the mean accumulators, from the width of the counts. 8 and 16-bit counts are summed
+// on 32 bits, which is exact up to 2^24 and 2^16 k-mers per unitig, with a 16-bit presence count;
+// 32-bit counts keep 32-bit sums and presence counts. Past their maximum, accumulators saturate.
+template<typename count_type>
+struct mean_accumulator {
+    using presence_type = uint16_t;
+    using sum_type = uint32_t;
+};
+
+template<>
+struct mean_accumulator<uint32_t> {
+    using presence_type = uint32_t;
+    using sum_type = uint32_t;
+};
+
 // Reimplementation of Riccardo's mean computation logic
-class MeanAggregator: public Aggregator {
+template<typename count_type = uint32_t>
+class MeanAggregator: public Aggregator<count_type> {
+  using presence_type = typename mean_accumulator<count_type>::presence_type;
+  using sum_type = typename mean_accumulator<count_type>::sum_type;
+
   private:
-  std::vector<std::vector<std::pair<uint32_t,uint32_t>>> m_samples_count;
+  // nb_present and abundance_sum of (unitig, sample), at unitig * num_samples + sample
+  std::vector<presence_type> m_present;
+  std::vector<sum_type> m_sums;
+  size_t m_num_utgs;
   size_t m_num_samples;
   double m_min_fraction;
-  // the pair contains <nb_present, abundance_sum>
 
   public:
 
   MeanAggregator(size_t num_samples, size_t num_utgs, double min_fraction):
-  m_num_samples(num_samples), m_min_fraction(min_fraction) {
-    m_samples_count.resize(num_utgs);
-    for(size_t i {0}; i < num_utgs; i++){
-      m_samples_count[i].resize(m_num_samples, {0,0});
-    }
-  }
+  m_present(num_utgs * num_samples, 0), m_sums(num_utgs * num_samples, 0),
+  m_num_utgs(num_utgs), m_num_samples(num_samples), m_min_fraction(min_fraction) {}
 
   ~MeanAggregator() override = default;
 
-  void process_kmer(size_t unitig_id, const std::vector<uint32_t>& kmer_counts) override {
-    if (unitig_id >= m_samples_count.size()) {
-      spdlog::debug(fmt::format("ERROR: GOT UTG ID {} BUT MAX POSSIBLE IS {}", unitig_id, m_samples_count.size()));
+  void process_kmer(size_t unitig_id, const std::vector<count_type>& kmer_counts) override {
+    if (unitig_id >= m_num_utgs) {
+      spdlog::debug(fmt::format("ERROR: GOT UTG ID {} BUT MAX POSSIBLE IS {}", unitig_id, m_num_utgs));
       return;
     }
     if (kmer_counts.size() != m_num_samples) {
@@ -52,38 +76,60 @@ class MeanAggregator: public Aggregator {
         return;
     }
 
-    auto& samples = m_samples_count[unitig_id];
-    size_t idx{0};
-    for(auto& [nb_present,abundance_sum]: samples) {
-        uint32_t num = kmer_counts[idx];
-        // std::cout << "[INSIDE-" << unitig_id << "]: I see " << num << " and report " << uint32_t{num > 0} << ". old sum: " << nb_present << "\t";
-        nb_present = kmat::add_sat(nb_present, uint32_t{num > 0});
-        // std::cout << "New sum:" << nb_present << std::endl;
-        abundance_sum = kmat::add_sat(abundance_sum, num);
-        idx++;
+    presence_type* present = m_present.data() + unitig_id * m_num_samples;
+    sum_type* sums = m_sums.data() + unitig_id * m_num_samples;
+    for(size_t idx{0}; idx < m_num_samples; idx++) {
+        count_type num = kmer_counts[idx];
+        present[idx] = kmat::add_sat(present[idx], presence_type{num > 0});
+        sums[idx] = kmat::add_sat(sums[idx], sum_type{num});
+    }
+  }
+
+  void process_kmer(size_t unitig_id, const std::vector<uint32_t>& sample_ids, const std::vector<count_type>& kmer_counts) override {
+    if (unitig_id >= m_num_utgs) {
+      spdlog::debug(fmt::format("ERROR: GOT UTG ID {} BUT MAX POSSIBLE IS {}", unitig_id, m_num_utgs));
+      return;
+    }
+    if (!sample_ids.empty() && sample_ids.back() >= m_num_samples) {
+      spdlog::debug(fmt::format("ERROR: GOT SAMPLE ID {}. EXPECTED LESS THAN {}", sample_ids.back(), m_num_samples));
+        return;
+    }
+
+    // absent samples contribute nothing to either the presence count or the sum
+    presence_type* present = m_present.data() + unitig_id * m_num_samples;
+    sum_type* sums = m_sums.data() + unitig_id * m_num_samples;
+    for(size_t i{0}; i < sample_ids.size(); i++) {
+        uint32_t s = sample_ids[i];
+        count_type num = kmer_counts[i];
+        present[s] = kmat::add_sat(present[s], presence_type{num > 0});
+        sums[s] = kmat::add_sat(sums[s], sum_type{num});
     }
   }
 
   std::pair<double,double> get_abundance_fraction(size_t unitig_id, size_t sample_id, size_t unitig_num_kmers) const override{
-    if (unitig_id >= m_samples_count.size() || sample_id >= m_num_samples || unitig_num_kmers == 0) {
+    if (unitig_id >= m_num_utgs || sample_id >= m_num_samples || unitig_num_kmers == 0) {
             return std::pair(0.0,0.0);
         }
 
-    const auto& [nb_present, abundance_sum] = m_samples_count[unitig_id][sample_id];
-    // std::cout << "[INSIDE] GOT " << nb_present << " present out of " << unitig_num_kmers << std::endl;
-    // return std::pair(static_cast<double>(abundance_sum) / unitig_num_kmers,static_cast<double>(nb_present)/ unitig_num_kmers);
-    double fraction = static_cast<double>(nb_present) / unitig_num_kmers;
-    double abundance = fraction >= m_min_fraction ? static_cast<double>(abundance_sum) / unitig_num_kmers : 0.0;
+    size_t cell = unitig_id * m_num_samples + sample_id;
+    double fraction = static_cast<double>(m_present[cell]) / unitig_num_kmers;
+    double abundance = fraction >= m_min_fraction ? static_cast<double>(m_sums[cell]) / unitig_num_kmers : 0.0;
     return std::pair(abundance, fraction);
   }
 
+  // bytes held by the accumulators of all unitigs and samples
+  size_t memory_bytes() const {
+    return m_present.size() * sizeof(presence_type) + m_sums.size() * sizeof(sum_type);
+  }
+
 };
 
 
 // Median computation logic
-class MedianAggregator: public Aggregator {
+template<typename count_type = uint32_t>
+class MedianAggregator: public Aggregator<count_type> {
   private:
-  std::vector<std::vector<std::map<uint32_t, uint32_t>>> m_samples_count;
+  std::vector<std::vector<std::map<count_type, uint32_t>>> m_samples_count;
   size_t m_num_samples;
   double m_min_fraction;
   // trying to reduce memory footprint, instead of having a vector of counts, I store the possible counts in a dictionary
@@ -101,7 +147,7 @@ class MedianAggregator: public Aggregator {
 
   ~MedianAggregator() override = default;
 
-  void process_kmer(size_t unitig_id, const std::vector<uint32_t>& kmer_counts) override {
+  void process_kmer(size_t unitig_id, const std::vector<count_type>& kmer_counts) override {
     if (unitig_id >= m_samples_count.size()) {
       spdlog::debug(fmt::format("ERROR: GOT UTG ID {} BUT MAX POSSIBLE IS {}", unitig_id, m_samples_count.size()));
       return;
@@ -117,6 +163,25 @@ class MedianAggregator: public Aggregator {
     }
   }
 
+  void process_kmer(size_t unitig_id, const std::vector<uint32_t>& sample_ids, const std::vector<count_type>& kmer_counts) override {
+    if (unitig_id >= m_samples_count.size()) {
+      spdlog::debug(fmt::format("ERROR: GOT UTG ID {} BUT MAX POSSIBLE IS {}", unitig_id, m_samples_count.size()));
+      return;
+    }
+    if (!sample_ids.empty() && sample_ids.back() >= m_num_samples) {
+      spdlog::debug(fmt::format("ERROR: GOT SAMPLE ID {}. EXPECTED LESS THAN {}", sample_ids.back(), m_num_samples));
+        return;
+    }
+
+    // zero counts are never looked up in get_abundance_fraction, so absent samples are not recorded
+    auto& samples = m_samples_count[unitig_id];
+    for(size_t i {0}; i < sample_ids.size(); i++) {
+        if (kmer_counts[i] > 0) {
+            samples[sample_ids[i]][kmer_counts[i]]++;
+        }
+    }
+  }
+
   std::pair<double, double> get_abundance_fraction(size_t unitig_id, size_t sample_id, size_t unitig_num_kmers) const override{
 
     const auto& sample_map = m_samples_count[unitig_id][sample_id];
@@ -164,4 +229,75 @@ class MedianAggregator: public Aggregator {
 
 };
 
+// Aggregation of one unitig at a time, for k-mer rows fetched in unitig order (kmat unitig
+// --engine unitig): a unitig is finalised before the next one starts, so only the samples
+// of the current unitig are held. Results are those of MeanAggregator and MedianAggregator,
+// medians being taken exactly on the counts of the unitig.
+template<typename count_type = uint32_t>
+class UnitigAggregator {
+  using presence_type = typename mean_accumulator<count_type>::presence_type;
+  using sum_type = typename mean_accumulator<count_type>::sum_type;
+
+  private:
+  bool m_median;
+  double m_min_fraction;
+  std::vector<uint32_t> m_touched;
+  // mean: nb_present and abundance_sum per sample, median: the positive counts
+  std::vector<presence_type> m_present;
+  std::vector<sum_type> m_sums;
+  std::vector<std::vector<count_type>> m_counts;
+
+  public:
+
+  UnitigAggregator(size_t num_samples, bool median, double min_fraction):
+  m_median(median), m_min_fraction(min_fraction), m_present(num_samples, 0), m_sums(num_samples, 0),
+  m_counts(median ? num_samples : 0) {}
+
+  void process_kmer(const uint32_t* sample_ids, const count_type* kmer_counts, size_t size) {
+    for(size_t i {0}; i < size; i++) {
+        uint32_t s = sample_ids[i];
+        count_type num = kmer_counts[i];
+        if (num == 0 || s >= m_present.size()) { continue; }
+        if (m_present[s] == 0) { m_touched.push_back(s); }
+        m_present[s] = kmat::add_sat(m_present[s], presence_type{1});
+        if (m_median) {
+            m_counts[s].push_back(num);
+        } else {
+            m_sums[s] = kmat::add_sat(m_sums[s], sum_type{num});
+        }
+    }
+  }
+
+  // Fill the abundances and fractions of all samples (of size num_samples) for the current
+  // unitig, and reset for the next one
+  void finish_unitig(size_t unitig_num_kmers, std::vector<double>& abundances, std::vector<double>& fractions) {
+    std::fill(abundances.begin(), abundances.end(), 0.0);
+    std::fill(fractions.begin(), fractions.end(), 0.0);
+    for (auto s : m_touched) {
+        double abundance {0.0};
+        double fraction {0.0};
+        if (m_median) {
+            auto& counts = m_counts[s];
+            const size_t idx1 = (counts.size() - 1) / 2;
+            const size_t idx2 = counts.size() / 2;
+            std::nth_element(counts.begin(), counts.begin() + idx2, counts.end());
+            double m2 = counts[idx2];
+            double m1 = idx1 == idx2 ? m2 : *std::max_element(counts.begin(), counts.begin() + idx2);
+            abundance = (m1 + m2) / 2.0;
+            fraction = static_cast<double>(counts.size()) / unitig_num_kmers;
+            counts.clear();
+        } else if (unitig_num_kmers > 0) {
+            abundance = static_cast<double>(m_sums[s]) / unitig_num_kmers;
+            fraction = static_cast<double>(m_present[s]) / unitig_num_kmers;
+        }
+        abundances[s] = fraction >= m_min_fraction ? abundance : 0.0;
+        fractions[s] = fraction;
+        m_present[s] = 0;
+        m_sums[s] = 0;
+    }
+    m_touched.clear();
+  }
+
+};
+
 #endif
\ No newline at end of file
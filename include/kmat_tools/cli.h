@@ -16,6 +16,7 @@
 #include <kmat_tools/cli/merge.h>
 #include <kmat_tools/cli/reverse.h>
 #include <kmat_tools/cli/select.h>
+#include <kmat_tools/cli/sort.h>
 #include <kmat_tools/cli/unitig.h>
 
 
@@ -46,6 +47,7 @@ private:
     merge_opt_t   merge_opt {nullptr};
     reverse_opt_t reverse_opt {nullptr};
     select_opt_t  select_opt {nullptr};
+    sort_opt_t    sort_opt {nullptr};
     unitig_opt_t  unitig_opt {nullptr};
 };
 
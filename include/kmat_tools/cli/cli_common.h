@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <sstream>
@@ -23,6 +24,7 @@ enum class COMMAND
   MERGE,
   REVERSE,
   SELECT,
+  SORT,
   UNITIG,
   UNKNOWN
 };
@@ -47,6 +49,8 @@ inline COMMAND str_to_cmd(const std::string& s)
     return COMMAND::REVERSE;
   else if (s == "select")
     return COMMAND::SELECT;
+  else if (s == "sort")
+    return COMMAND::SORT;
   else if (s == "unitig")
     return COMMAND::UNITIG;
   else 
@@ -73,16 +77,31 @@ inline std::string cmd_to_str(COMMAND cmd)
     return "reverse";
   else if (cmd == COMMAND::SELECT)
     return "select";
+  else if (cmd == COMMAND::SORT)
+    return "sort";
   else if (cmd == COMMAND::UNITIG)
     return "unitig";
   else // (cmd == COMMAND::UNKNOWN)
     return "unknown";
 }
 
+// Runs a named step of a command, e.g. to measure it (muset stage report)
+using step_runner_t = std::function<void(const std::string&, const std::function<void()>&)>;
+
 struct kmat_options {
   std::vector<std::string> inputs;
+  step_runner_t step_runner;
 };
 
+inline void run_step(const kmat_options& opt, const std::string& name, const std::function<void()>& step)
+{
+  if (opt.step_runner) {
+    opt.step_runner(name, step);
+  } else {
+    step();
+  }
+}
+
 using kmat_opt_t = std::shared_ptr<struct kmat_options>;
 
 using cli_t = std::shared_ptr<bc::Parser<1>>;
@@ -14,6 +14,13 @@ struct convert_options : kmat_options
     bool out_write_seq{false};
     bool no_header{false};
     bool out_csv{false};
+    std::string output_format{"txt"};
+
+    // compute color fractions from the unitig annotations (C:<subset>:<count>) and the
+    // color subsets of the dump, instead of reading a ggcat query output
+    bool from_annotations{false};
+
+    size_t nb_threads{1};
 };
 
 using convert_opt_t = std::shared_ptr<struct convert_options>;
@@ -10,6 +10,8 @@ struct diff_options : kmat_options
 
     uint32_t kmer_size{31};
     bool actg_order{false};
+    size_t nb_threads{1};
+    std::string tmp_dir;
 };
 
 using diff_opt_t = std::shared_ptr<struct diff_options>;
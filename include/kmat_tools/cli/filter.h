@@ -16,6 +16,7 @@ struct filter_options : kmat_options {
     fs::path output;
     
     uint32_t min_abundance{0};
+    uint32_t count_width{32};
 
     double min_frac_absent{0.1};
     double min_frac_present{0.1};
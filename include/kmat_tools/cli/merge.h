@@ -9,6 +9,11 @@ struct merge_options : kmat_options
   uint32_t kmer_size{31};
   std::string output;
   bool actg_order{false};
+
+  std::string input_list;
+  size_t fanin{64};
+  std::string tmp_dir;
+  size_t nb_threads{1};
 };
 
 using merge_opt_t = std::shared_ptr<struct merge_options>;
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <kmat_tools/cli/cli_common.h>
+
+namespace kmat {
+
+struct sort_options : kmat_options
+{
+  std::string output;
+
+  bool actg_order{false};
+  bool canonicalize{false};
+  bool sum_duplicates{false};
+
+  size_t max_memory{2048};
+  size_t nb_threads{1};
+  size_t fanin{64};
+  std::string tmp_dir;
+};
+
+using sort_opt_t = std::shared_ptr<struct sort_options>;
+
+kmat_opt_t sort_cli(std::shared_ptr<bc::Parser<1>> cli, sort_opt_t options);
+
+};
@@ -19,10 +19,13 @@ struct unitig_options : kmat_options {
     std::string prefix;
     std::string abundance_metric;
     std::string output_format;
+    std::string engine{"kmer"};
 
     double min_frac{0.0};
+    uint32_t count_width{32};
     bool write_seq{false};
     bool write_frac_matrix{false};
+    bool write_index{false};
     size_t nb_threads{1};
 };
 
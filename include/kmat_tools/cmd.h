@@ -9,4 +9,5 @@
 #include <kmat_tools/cmd/merge.h>
 #include <kmat_tools/cmd/reverse.h>
 #include <kmat_tools/cmd/select.h>
+#include <kmat_tools/cmd/sort.h>
 #include <kmat_tools/cmd/unitig.h>
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <kmat_tools/cli/sort.h>
+
+
+namespace kmat {
+
+int main_sort(sort_opt_t opt);
+
+};
\ No newline at end of file
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace kmat {
+
+// Binary CSR unitig matrix
+//
+//   header : CsrMatrixHeader
+//   rows   : for each unitig, uint32 nnz, uint32 color[nnz], float value[nnz]
+//            (values are omitted in presence-absence matrices, every stored entry is 1)
+//
+// A text index "<file>.idx" gives, for each row in order, the unitig identifier and
+// the byte offset of the row in the matrix file.
+
+constexpr uint64_t CSR_MAGIC = 0x0031727363746d6b; // "kmtcsr1\0"
+constexpr uint32_t CSR_VERSION = 1;
+constexpr uint32_t CSR_PRESENCE_ABSENCE = 1 << 0;
+
+struct CsrMatrixHeader
+{
+    uint64_t magic{CSR_MAGIC};
+    uint32_t version{CSR_VERSION};
+    uint32_t flags{0};
+    uint64_t nb_colors{0};
+    uint64_t nb_rows{0};
+    uint64_t nnz{0};
+
+    bool presence_absence() const { return flags & CSR_PRESENCE_ABSENCE; }
+};
+
+inline std::string csr_index_path(const std::string& path) {
+    return path + ".idx";
+}
+
+// Append one row to a CSR buffer, colors must be increasing
+template<typename Buffer>
+void append_csr_row(Buffer& buffer, const std::vector<uint32_t>& colors, const std::vector<float>& values, bool presence_absence) {
+    auto append = [&buffer](const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        buffer.append(p, p + size);
+    };
+    uint32_t nnz = colors.size();
+    append(&nnz, sizeof(nnz));
+    append(colors.data(), nnz * sizeof(uint32_t));
+    if (!presence_absence) {
+        append(values.data(), nnz * sizeof(float));
+    }
+}
+
+class CsrMatrixReader {
+
+  public:
+    CsrMatrixReader(const std::string& path) : m_path(path), m_stream(path, std::ios::binary) {
+        if (!m_stream.good()) {
+            throw std::runtime_error(fmt::format("cannot open {}", path));
+        }
+        m_stream.read(reinterpret_cast<char*>(&m_header), sizeof(m_header));
+        if (!m_stream || m_header.magic != CSR_MAGIC || m_header.version != CSR_VERSION) {
+            throw std::runtime_error(fmt::format("{} is not a CSR unitig matrix", path));
+        }
+    }
+
+    const CsrMatrixHeader& header() const {
+        return m_header;
+    }
+
+    // position the reader on the row starting at offset (taken from the index)
+    void seek(uint64_t offset) {
+        m_stream.clear();
+        m_stream.seekg(offset);
+    }
+
+    // read the next row, values are set to 1 for presence-absence matrices
+    bool read(std::vector<uint32_t>& colors, std::vector<float>& values) {
+        uint32_t nnz;
+        if (!m_stream.read(reinterpret_cast<char*>(&nnz), sizeof(nnz))) {
+            return false;
+        }
+        colors.resize(nnz);
+        values.resize(nnz);
+        m_stream.read(reinterpret_cast<char*>(colors.data()), nnz * sizeof(uint32_t));
+        if (m_header.presence_absence()) {
+            std::fill(values.begin(), values.end(), 1.0f);
+        } else {
+            m_stream.read(reinterpret_cast<char*>(values.data()), nnz * sizeof(float));
+        }
+        if (!m_stream) {
+            throw std::runtime_error(fmt::format("truncated row in {}", m_path));
+        }
+        return true;
+    }
+
+  private:
+    std::string m_path;
+    std::ifstream m_stream;
+    CsrMatrixHeader m_header;
+};
+
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace kmat {
+
+namespace detail {
+
+inline void skip_ws(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) { ++p; }
+}
+
+inline bool consume(const char*& p, const char* end, char c) {
+    skip_ws(p, end);
+    if (p < end && *p == c) { ++p; return true; }
+    return false;
+}
+
+inline bool consume_key(const char*& p, const char* end, std::string_view key) {
+    skip_ws(p, end);
+    if (static_cast<size_t>(end - p) < key.size() + 2 || *p != '"') { return false; }
+    if (std::string_view(p + 1, key.size()) != key || p[key.size() + 1] != '"') { return false; }
+    p += key.size() + 2;
+    return consume(p, end, ':');
+}
+
+inline bool parse_uint(const char*& p, const char* end, uint64_t& value) {
+    const char* start = p;
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + static_cast<uint64_t>(*p - '0');
+        ++p;
+    }
+    return p != start;
+}
+
+inline bool parse_hex(const char*& p, const char* end, uint64_t& value) {
+    const char* start = p;
+    value = 0;
+    for (; p < end; ++p) {
+        uint64_t d;
+        if (*p >= '0' && *p <= '9') { d = *p - '0'; }
+        else if (*p >= 'a' && *p <= 'f') { d = *p - 'a' + 10; }
+        else if (*p >= 'A' && *p <= 'F') { d = *p - 'A' + 10; }
+        else { break; }
+        value = value * 16 + d;
+    }
+    return p != start;
+}
+
+};
+
+// Zero-allocation scanner for one line of the ggcat colored query output,
+//     {"query_index":12,"matches":{"0":1.0,"3":0.5}}
+// calling on_match(color_index, fraction) for each entry of "matches".
+// The line must be null-terminated past its end (e.g. the buffer of a std::string).
+// Returns false as soon as the line deviates from this shape; the caller should then
+// reset its state and fall back to a general JSON parser.
+template<typename Callback>
+bool scan_ggcat_query_line(std::string_view line, Callback&& on_match) {
+    using namespace detail;
+    const char* p = line.data();
+    const char* end = p + line.size();
+
+    uint64_t query_index;
+    if (!consume(p, end, '{') || !consume_key(p, end, "query_index")) { return false; }
+    skip_ws(p, end);
+    if (!parse_uint(p, end, query_index)) { return false; }
+    if (!consume(p, end, ',') || !consume_key(p, end, "matches") || !consume(p, end, '{')) { return false; }
+
+    if (!consume(p, end, '}')) {
+        do {
+            uint64_t color;
+            if (!consume(p, end, '"') || !parse_uint(p, end, color) || !consume(p, end, '"') || !consume(p, end, ':')) {
+                return false;
+            }
+            skip_ws(p, end);
+            char* num_end;
+            float value = std::strtof(p, &num_end);
+            if (num_end == p || num_end > end) { return false; }
+            p = num_end;
+            on_match(color, value);
+        } while (consume(p, end, ','));
+        if (!consume(p, end, '}')) { return false; }
+    }
+
+    if (!consume(p, end, '}')) { return false; }
+    skip_ws(p, end);
+    return p == end;
+}
+
+// Scan the color annotations of a unitig header from a ggcat colored graph,
+//     LN:i:61 C:3a:20 C:0:11
+// calling on_run(subset_index, kmer_count) for each "C:<subset, hex>:<count>" entry.
+// Returns the number of entries found.
+template<typename Callback>
+size_t scan_ggcat_color_annotations(std::string_view comment, Callback&& on_run) {
+    using namespace detail;
+    size_t nb_runs = 0;
+    size_t pos = 0;
+    while ((pos = comment.find("C:", pos)) != std::string_view::npos) {
+        const char* p = comment.data() + pos + 2;
+        const char* end = comment.data() + comment.size();
+        uint64_t subset, count;
+        bool token_start = pos == 0 || comment[pos - 1] == ' ' || comment[pos - 1] == '\t';
+        if (token_start && parse_hex(p, end, subset) && p < end && *p++ == ':' && parse_uint(p, end, count)) {
+            on_run(subset, count);
+            nb_runs++;
+        }
+        pos += 2;
+    }
+    return nb_runs;
+}
+
+// Color subsets of a ggcat colormap (the set of colors shared by a run of k-mers),
+// as listed by ggcat dump-colors next to the color names:
+//     {"subset_index":3,"colors":[0,2,5]}
+class GgcatColorSubsets {
+  public:
+    void add(uint64_t subset, std::vector<uint32_t> colors) {
+        if (subset >= m_subsets.size()) {
+            m_subsets.resize(subset + 1);
+        }
+        m_subsets[subset] = std::move(colors);
+        m_nb_loaded++;
+    }
+
+    bool empty() const {
+        return m_nb_loaded == 0;
+    }
+
+    const std::vector<uint32_t>& colors(uint64_t subset) const {
+        if (subset >= m_subsets.size()) {
+            throw std::runtime_error(fmt::format("unknown ggcat color subset {}", subset));
+        }
+        return m_subsets[subset];
+    }
+
+  private:
+    std::vector<std::vector<uint32_t>> m_subsets;
+    size_t m_nb_loaded{0};
+};
+
+// Whether a dump-colors output lists the color subsets (required to compute color
+// fractions from the unitig annotations instead of running ggcat query)
+inline bool ggcat_dump_has_subsets(const std::string& path) {
+    std::ifstream stream(path);
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (line.find("\"subset_index\"") != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Append a matrix value, formatted like the default std::ostream float formatting ("%g").
+inline void append_value(fmt::memory_buffer& buffer, float value) {
+    if (value == 0.0f) {
+        buffer.push_back('0');
+    } else if (value == 1.0f) {
+        buffer.push_back('1');
+    } else {
+        fmt::format_to(std::back_inserter(buffer), "{:g}", value);
+    }
+}
+
+};
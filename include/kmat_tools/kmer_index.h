@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace kmat {
+
+// Canonical k-mer on 2 bits per nucleotide (A=0 C=1 G=2 T=3), right-aligned, k <= 63
+using kmer_key = __uint128_t;
+
+namespace detail {
+
+// 2-bit code of a nucleotide in either case, 4 for any other character
+inline uint8_t nt_2bit(char c) {
+  switch (c) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return 4;
+  }
+}
+
+};
+
+// Calls f(key, valid) for the k-mers of seq in order, key being the smaller of the forward
+// and reverse-complement encodings, rolled one nucleotide at a time. K-mers with a non-ACGT
+// character are reported with valid = false.
+template<typename F>
+inline void for_each_canonical_kmer(std::string_view seq, size_t k, F&& f) {
+  const kmer_key mask = (kmer_key{1} << (2 * k)) - 1;
+  const size_t rc_shift = 2 * (k - 1);
+  kmer_key fwd = 0, rc = 0;
+  size_t nb_valid = 0; // trailing ACGT characters
+  for (size_t i = 0; i < seq.size(); i++) {
+    uint8_t c = detail::nt_2bit(seq[i]);
+    if (c > 3) {
+      nb_valid = 0;
+      c = 0;
+    } else {
+      nb_valid++;
+    }
+    fwd = ((fwd << 2) | c) & mask;
+    rc = (rc >> 2) | (kmer_key{3u - c} << rc_shift);
+    if (i + 1 >= k) { f(std::min(fwd, rc), nb_valid >= k); }
+  }
+}
+
+// The rows of a sparse k-mer matrix held in memory, sorted by canonical 2-bit k-mer. A
+// table on the top bits of the keys narrows each binary search to a few entries.
+template<typename count_type = uint32_t>
+class KmerRowIndex {
+  public:
+  struct Row {
+    const uint32_t* sample_ids;
+    const count_type* counts;
+    size_t size;
+  };
+
+  explicit KmerRowIndex(size_t kmer_size) : m_kmer_size(kmer_size) {}
+
+  // rows of k-mers with a non-ACGT character are not indexed
+  bool add_row(std::string_view kmer, const std::vector<uint32_t>& sample_ids, const std::vector<count_type>& counts) {
+    if (kmer.size() != m_kmer_size) { return false; }
+    kmer_key key = 0;
+    bool valid = false;
+    for_each_canonical_kmer(kmer, m_kmer_size, [&](kmer_key k, bool v) { key = k; valid = v; });
+    if (!valid) { return false; }
+
+    m_entries.push_back({key, m_sample_ids.size(), static_cast<uint32_t>(sample_ids.size())});
+    m_sample_ids.insert(m_sample_ids.end(), sample_ids.begin(), sample_ids.end());
+    m_counts.insert(m_counts.end(), counts.begin(), counts.end());
+    return true;
+  }
+
+  // to call once all rows are added, before find
+  void build() {
+    std::sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) { return a.key < b.key; });
+
+    size_t bits = 1;
+    while (bits < 2 * m_kmer_size && bits < 28 && (size_t{1} << bits) < m_entries.size()) { bits++; }
+    bits = std::min(bits, 2 * m_kmer_size);
+    m_shift = 2 * m_kmer_size - bits;
+    m_table.assign((size_t{1} << bits) + 1, 0);
+    for (const auto& entry : m_entries) { m_table[static_cast<size_t>(entry.key >> m_shift) + 1]++; }
+    for (size_t p = 1; p < m_table.size(); p++) { m_table[p] += m_table[p - 1]; }
+  }
+
+  bool find(kmer_key key, Row& row) const {
+    size_t p = static_cast<size_t>(key >> m_shift);
+    auto first = m_entries.begin() + m_table[p];
+    auto last = m_entries.begin() + m_table[p + 1];
+    auto it = std::lower_bound(first, last, key, [](const Entry& e, kmer_key k) { return e.key < k; });
+    if (it == last || it->key != key) { return false; }
+    row = {m_sample_ids.data() + it->offset, m_counts.data() + it->offset, it->size};
+    return true;
+  }
+
+  size_t size() const { return m_entries.size(); }
+
+  private:
+  struct Entry {
+    kmer_key key;
+    uint64_t offset;
+    uint32_t size;
+  };
+
+  size_t m_kmer_size;
+  size_t m_shift{0};
+  std::vector<Entry> m_entries;
+  std::vector<uint64_t> m_table;
+  std::vector<uint32_t> m_sample_ids;
+  std::vector<count_type> m_counts;
+};
+
+};
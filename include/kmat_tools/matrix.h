@@ -2,10 +2,12 @@
 
 #include <algorithm>
 #include <array>
+#include <charconv>
 #include <cstddef>
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -13,6 +15,7 @@
 
 #include <fmt/format.h>
 
+#include <kmat_tools/packed_kmer.h>
 #include <kmat_tools/utils.h>
 
 namespace kmat {
@@ -37,6 +40,15 @@ class TextMatrixReader {
       m_stream->rdbuf()->pubsetbuf(m_buf.data(), m_buf.size());
     }
 
+    // read only the lines starting in [begin, end), begin must be the start of a line
+    TextMatrixReader (const std::string& path, uint64_t begin, uint64_t end)
+      : TextMatrixReader(path)
+    {
+      m_stream->seekg(begin);
+      m_pos = begin;
+      m_end = end;
+    }
+
     TextMatrixReader (TextMatrixReader const &) = delete;
     TextMatrixReader (TextMatrixReader&&) = delete;
     TextMatrixReader& operator= (TextMatrixReader const &) = delete;
@@ -103,6 +115,19 @@ class TextMatrixReader {
       return true;
     }
 
+    // read_kmer and read_kmer_and_line also packing the k-mer, for compare_kmers
+    inline bool read_kmer(std::string &kmer, PackedKmer &packed, bool actg_order) {
+      if (!this->read_kmer(kmer)) { return false; }
+      packed.assign(kmer, actg_order);
+      return true;
+    }
+
+    inline bool read_kmer_and_line(std::string &kmer, std::string &line, PackedKmer &packed, bool actg_order) {
+      if (!this->read_kmer_and_line(kmer, line)) { return false; }
+      packed.assign(kmer, actg_order);
+      return true;
+    }
+
     template<typename count_type>
     inline bool read_kmer_counts(std::string &kmer, std::vector<count_type> &counts) {
 
@@ -128,7 +153,9 @@ class TextMatrixReader {
 
         count_type value{0};
         auto [ptr, ec] = std::from_chars(m_line.data()+idx, m_line.data()+m_line.size(), value);
-        if (ec != std::errc()) {
+        if (ec == std::errc::result_out_of_range) {
+          value = std::numeric_limits<count_type>::max(); // saturate
+        } else if (ec != std::errc()) {
           throw std::runtime_error(fmt::format("{}: error loading counts at line {}", this->m_path, this->line_count()));
         }
 
@@ -139,18 +166,70 @@ class TextMatrixReader {
       return kmer.length() > 0;
     }
 
-    
+    // same as read_kmer_counts but only keep non-zero counts along with their sample indices,
+    // zero columns are skipped without being parsed. nb_counts receives the number of columns.
+    template<typename count_type>
+    inline bool read_kmer_sparse_counts(std::string &kmer, std::vector<uint32_t> &indices, std::vector<count_type> &counts, size_t &nb_counts) {
+
+      if (!this->get_nonempty_line()) { return false; }
+
+      indices.clear();
+      counts.clear();
+      nb_counts = 0;
+
+      auto idx = m_line.find_first_of(" \t");
+      kmer = idx == std::string::npos ? 
+        std::string_view{ m_line } : 
+        std::string_view{ m_line.data(), idx };
+
+      if(!is_valid_kmer(kmer)) {
+        throw std::runtime_error(
+          fmt::format("bad character found in k-mer \"{}\" at line {}", kmer, this->line_count())
+        );
+      }
+
+      while (idx != std::string::npos) {
+
+        idx = m_line.find_first_not_of(" \t", idx); // skip whitespaces
+        if (idx == std::string::npos) { break; }
+
+        const size_t end = std::min(m_line.find_first_of(" \t", idx), m_line.size());
+        if (end - idx == 1 && m_line[idx] == '0') {
+          nb_counts++;
+          idx = end;
+          continue;
+        }
+
+        count_type value{0};
+        auto [ptr, ec] = std::from_chars(m_line.data()+idx, m_line.data()+end, value); (void)ptr;
+        if (ec == std::errc::result_out_of_range) {
+          value = std::numeric_limits<count_type>::max(); // saturate
+        } else if (ec != std::errc()) {
+          throw std::runtime_error(fmt::format("{}: error loading counts at line {}", this->m_path, this->line_count()));
+        }
+
+        if (value) {
+          indices.push_back(nb_counts);
+          counts.push_back(value);
+        }
+        nb_counts++;
+        idx = end;
+      }
+
+      return kmer.length() > 0;
+    }
 
   private:
 
     inline bool get_nonempty_line() {
 
       do {
-        if (!m_stream->good()) {
+        if (!m_stream->good() || m_pos >= m_end) {
           return false;
         }
 
         std::getline(*m_stream, m_line);
+        m_pos += m_line.size() + 1;
 
         if (m_stream->eof()) {
           return false;
@@ -171,6 +250,9 @@ class TextMatrixReader {
 
     std::string m_line;
     size_t      m_line_count{0};
+
+    uint64_t    m_pos{0};
+    uint64_t    m_end{std::numeric_limits<uint64_t>::max()};
 };
 
 };
\ No newline at end of file
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <kmtricks/bitmatrix.hpp>
+
+namespace kmat {
+
+// Bit-packed presence-absence unitig matrix
+//
+//   header : PaMatrixHeader
+//   rows   : nb_rows rows of row_bytes bytes, column j is bit (j % 64) of the
+//            little-endian 64-bit word j / 64; padding bits are 0
+//
+// The unitig-major file "<file>" has one row per unitig (columns are colors), with a
+// text index "<file>.idx" as for csr matrices. The color-major file "<file>.T" has one
+// row per color (columns are unitigs, in the order of the index).
+
+constexpr uint64_t PA_MAGIC = 0x0031626170746d6b; // "kmtpab1\0"
+constexpr uint32_t PA_VERSION = 1;
+constexpr uint32_t PA_TRANSPOSED = 1 << 0;
+
+struct PaMatrixHeader
+{
+    uint64_t magic{PA_MAGIC};
+    uint32_t version{PA_VERSION};
+    uint32_t flags{0};
+    uint64_t nb_rows{0};
+    uint64_t nb_cols{0};
+    uint64_t row_bytes{0};
+
+    bool transposed() const { return flags & PA_TRANSPOSED; }
+};
+
+inline uint64_t pa_row_bytes(uint64_t nb_cols) {
+    return (nb_cols + 63) / 64 * sizeof(uint64_t);
+}
+
+inline std::string pa_transposed_path(const std::string& path) {
+    return path + ".T";
+}
+
+// Append one row to a buffer, colors are the columns set to 1
+template<typename Buffer>
+void append_pa_row(Buffer& buffer, std::vector<uint64_t>& words, const std::vector<uint32_t>& colors) {
+    std::fill(words.begin(), words.end(), 0);
+    for (auto c : colors) {
+        words[c / 64] |= uint64_t{1} << (c % 64);
+    }
+    const char* p = reinterpret_cast<const char*>(words.data());
+    buffer.append(p, p + words.size() * sizeof(uint64_t));
+}
+
+inline PaMatrixHeader read_pa_header(std::istream& stream, const std::string& path) {
+    PaMatrixHeader header;
+    stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!stream || header.magic != PA_MAGIC || header.version != PA_VERSION) {
+        throw std::runtime_error(fmt::format("{} is not a presence-absence bit matrix", path));
+    }
+    return header;
+}
+
+// Write the color-major copy of a unitig-major matrix, transposing blocks of block_rows
+// unitigs with km::BitMatrix and scattering each color's slice into its row.
+inline void transpose_pa_matrix(const std::string& path, uint64_t block_rows = 65536) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.good()) {
+        throw std::runtime_error(fmt::format("cannot open {}", path));
+    }
+    PaMatrixHeader in_header = read_pa_header(in, path);
+
+    PaMatrixHeader out_header;
+    out_header.flags = PA_TRANSPOSED;
+    out_header.nb_rows = in_header.nb_cols;
+    out_header.nb_cols = in_header.nb_rows;
+    out_header.row_bytes = pa_row_bytes(in_header.nb_rows);
+
+    std::string out_path = pa_transposed_path(path);
+    {
+        std::ofstream out(out_path, std::ios::binary);
+        if (!out.good()) {
+            throw std::runtime_error(fmt::format("cannot open output file \"{}\"", out_path));
+        }
+        out.write(reinterpret_cast<const char*>(&out_header), sizeof(out_header));
+    }
+    std::filesystem::resize_file(out_path, sizeof(out_header) + out_header.nb_rows * out_header.row_bytes);
+    std::fstream out(out_path, std::ios::binary | std::ios::in | std::ios::out);
+
+    block_rows = std::max<uint64_t>(64, block_rows / 64 * 64);
+    for (uint64_t start = 0; start < in_header.nb_rows; start += block_rows) {
+        // rows are padded to a multiple of 64 so that each slice is a whole number of words
+        uint64_t nb = std::min(block_rows, in_header.nb_rows - start);
+        uint64_t padded = (nb + 63) / 64 * 64;
+
+        km::BitMatrix block(padded, in_header.row_bytes, true);
+        in.read(reinterpret_cast<char*>(block.matrix), nb * in_header.row_bytes);
+        if (!in) {
+            throw std::runtime_error(fmt::format("truncated matrix {}", path));
+        }
+        std::unique_ptr<km::BitMatrix> trp(block.transpose());
+
+        uint64_t slice_bytes = padded / 8;
+        for (uint64_t c = 0; c < out_header.nb_rows; c++) {
+            out.seekp(sizeof(out_header) + c * out_header.row_bytes + start / 8);
+            out.write(reinterpret_cast<const char*>(trp->matrix + c * slice_bytes), slice_bytes);
+        }
+    }
+    if (!out) {
+        throw std::runtime_error(fmt::format("cannot write {}", out_path));
+    }
+}
+
+class PaMatrixReader {
+
+  public:
+    PaMatrixReader(const std::string& path) : m_stream(path, std::ios::binary) {
+        if (!m_stream.good()) {
+            throw std::runtime_error(fmt::format("cannot open {}", path));
+        }
+        m_header = read_pa_header(m_stream, path);
+    }
+
+    const PaMatrixHeader& header() const {
+        return m_header;
+    }
+
+    void seek_row(uint64_t i) {
+        m_stream.clear();
+        m_stream.seekg(sizeof(m_header) + i * m_header.row_bytes);
+    }
+
+    bool read(std::vector<uint64_t>& words) {
+        words.resize(m_header.row_bytes / sizeof(uint64_t));
+        return static_cast<bool>(m_stream.read(reinterpret_cast<char*>(words.data()), m_header.row_bytes));
+    }
+
+  private:
+    std::ifstream m_stream;
+    PaMatrixHeader m_header;
+};
+
+};
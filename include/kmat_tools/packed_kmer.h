@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include <kmat_tools/utils.h>
+
+namespace kmat {
+
+namespace detail {
+
+// 2-bit code of an upper-case nucleotide, (c >> 1) & 3 gives A=0 C=1 T=2 G=3 (kmtricks
+// order), flipping the low bit of T and G with bit 2 of the character gives A<C<G<T.
+inline uint64_t nt_code(uint8_t c, bool actg_order) {
+  return ((c >> 1) & 3) ^ (actg_order ? 0 : (c >> 2) & 1);
+}
+
+// 2-bit codes of 8 nucleotides loaded in a word, first nucleotide in the upper bits
+inline uint64_t pack_8(uint64_t x, bool actg_order) {
+  uint64_t codes = ((x >> 1) & 0x0303030303030303ULL) ^ (actg_order ? 0 : (x >> 2) & 0x0101010101010101ULL);
+  codes = __builtin_bswap64(codes);
+#ifdef __BMI2__
+  return _pext_u64(codes, 0x0303030303030303ULL);
+#else
+  codes = (codes | (codes >> 6)) & 0x000F000F000F000FULL;
+  codes = (codes | (codes >> 12)) & 0x000000FF000000FFULL;
+  return (codes | (codes >> 24)) & 0xFFFF;
+#endif
+}
+
+// pack n <= 32 nucleotides left-aligned in a word. Lower-case nucleotides and N (the other
+// characters accepted by is_valid_kmer) set bit 0x20 or 0x08 of invalid.
+inline uint64_t pack_word(const char* p, size_t n, bool actg_order, uint64_t& invalid) {
+  uint64_t word = 0;
+  uint64_t x;
+  if (n < 8) {
+    for (size_t i = 0; i < n; i++) {
+      uint8_t c = static_cast<uint8_t>(p[i]);
+      invalid |= c & 0x28;
+      word = (word << 2) | nt_code(c, actg_order);
+    }
+    return n ? word << (64 - 2 * n) : 0;
+  }
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    std::memcpy(&x, p + i, sizeof(x));
+    invalid |= x & 0x2828282828282828ULL;
+    word = (word << 16) | pack_8(x, actg_order);
+  }
+  if (size_t rest = n - i; rest) {
+    // the last 8 nucleotides, of which the first 8 - rest are already packed
+    std::memcpy(&x, p + n - 8, sizeof(x));
+    invalid |= x & 0x2828282828282828ULL;
+    word = (word << (2 * rest)) | (pack_8(x, actg_order) & ((uint64_t{1} << (2 * rest)) - 1));
+  }
+  return word << (64 - 2 * n);
+}
+
+};
+
+// K-mer packed on 2 bits per nucleotide, left-aligned in 128 bits, so that comparing
+// (hi, lo, size) orders k-mers like their strings in the chosen nucleotide order.
+// K-mers must have passed is_valid_kmer; those longer than 64 or with other characters
+// than upper-case ACGT are not packed.
+struct PackedKmer {
+  static constexpr size_t max_size = 64;
+
+  uint64_t hi{0};
+  uint64_t lo{0};
+  uint32_t size{0};
+  bool packed{false};
+
+  void assign(std::string_view kmer, bool actg_order) {
+    size = kmer.size();
+    packed = size <= max_size;
+    if (!packed) { return; }
+
+    uint64_t invalid = 0;
+    size_t n_hi = std::min<size_t>(size, 32);
+    hi = detail::pack_word(kmer.data(), n_hi, actg_order, invalid);
+    lo = detail::pack_word(kmer.data() + n_hi, size - n_hi, actg_order, invalid);
+    packed = !invalid;
+  }
+
+  // both k-mers must be packed in the same order
+  int compare(const PackedKmer& other) const {
+    if (hi != other.hi) { return hi < other.hi ? -1 : 1; }
+    if (lo != other.lo) { return lo < other.lo ? -1 : 1; }
+    return size == other.size ? 0 : (size < other.size ? -1 : 1);
+  }
+};
+
+// Compare two k-mers on their packed forms, or on their strings when one is not packed
+inline int compare_kmers(std::string_view a, const PackedKmer& packed_a, std::string_view b, const PackedKmer& packed_b, bool actg_order) {
+  if (packed_a.packed && packed_b.packed) {
+    return packed_a.compare(packed_b);
+  }
+  if (!actg_order) {
+    return a.compare(b);
+  }
+  int cmp = actg_compare(a.data(), b.data(), std::min(a.size(), b.size()));
+  return cmp != 0 ? cmp : (a.size() == b.size() ? 0 : a.size() < b.size() ? -1 : 1);
+}
+
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <kmat_tools/utils.h>
+
+namespace kmat {
+
+// Byte range of a k-mer sorted text matrix, [begin, end) on line boundaries
+struct byte_range {
+  uint64_t begin{0};
+  uint64_t end{std::numeric_limits<uint64_t>::max()};
+};
+
+namespace detail {
+
+// offset of the first line starting at or after offset
+inline uint64_t next_line_start(std::ifstream& in, uint64_t offset, uint64_t size) {
+  if (offset == 0 || offset >= size) { return std::min(offset, size); }
+  in.clear();
+  in.seekg(offset - 1);
+  in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  return in ? static_cast<uint64_t>(in.tellg()) : size;
+}
+
+// k-mer of the first non-blank line at or after a line start, empty at the end of the file
+inline std::string kmer_at(std::ifstream& in, uint64_t line_start, uint64_t size) {
+  std::string line;
+  in.clear();
+  in.seekg(line_start);
+  while (line_start < size && std::getline(in, line)) {
+    if (line.find_first_not_of(" \t") != std::string::npos) {
+      return line.substr(0, line.find_first_of(" \t"));
+    }
+  }
+  return {};
+}
+
+};
+
+// Offset of the first line whose k-mer is not less than key, by binary search over byte offsets
+inline uint64_t kmer_lower_bound(const std::string& path, const std::string& key, bool actg_order) {
+  std::ifstream in(path);
+  if (!in.good()) { throw std::runtime_error(fmt::format("cannot open {}", path)); }
+  uint64_t size = fs::file_size(path);
+
+  auto less = [&](const std::string& kmer) {
+    return (actg_order ? actg_compare(kmer, key) : kmer.compare(key)) < 0;
+  };
+
+  uint64_t lo = 0, hi = size;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    std::string kmer = detail::kmer_at(in, detail::next_line_start(in, mid, size), size);
+    if (kmer.empty() || !less(kmer)) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return detail::next_line_start(in, lo, size);
+}
+
+// Split k-mer sorted matrices into at most nb_parts aligned key ranges. The split k-mers are
+// quantiles of k-mers sampled at regular offsets of every input. Returns ranges[part][input].
+inline std::vector<std::vector<byte_range>> partition_matrices(const std::vector<std::string>& paths, size_t nb_parts, bool actg_order, size_t samples_per_input = 256) {
+  std::vector<std::string> samples;
+  for (const auto& path : paths) {
+    std::ifstream in(path);
+    if (!in.good()) { throw std::runtime_error(fmt::format("cannot open {}", path)); }
+    uint64_t size = fs::file_size(path);
+    for (size_t i = 1; i <= samples_per_input; i++) {
+      std::string kmer = detail::kmer_at(in, detail::next_line_start(in, size * i / (samples_per_input + 1), size), size);
+      if (!kmer.empty()) { samples.push_back(std::move(kmer)); }
+    }
+  }
+
+  auto less = [actg_order](const std::string& a, const std::string& b) {
+    return (actg_order ? actg_compare(a, b) : a.compare(b)) < 0;
+  };
+  std::sort(samples.begin(), samples.end(), less);
+  samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
+
+  std::vector<std::string> splits;
+  for (size_t p = 1; p < nb_parts && !samples.empty(); p++) {
+    const std::string& kmer = samples[samples.size() * p / nb_parts];
+    if (splits.empty() || less(splits.back(), kmer)) { splits.push_back(kmer); }
+  }
+
+  std::vector<std::vector<byte_range>> ranges(splits.size() + 1, std::vector<byte_range>(paths.size()));
+  for (size_t i = 0; i < paths.size(); i++) {
+    for (size_t p = 0; p < splits.size(); p++) {
+      uint64_t offset = kmer_lower_bound(paths[i], splits[p], actg_order);
+      ranges[p][i].end = offset;
+      ranges[p + 1][i].begin = offset;
+    }
+  }
+  return ranges;
+}
+
+// Run process(ranges, out) on key ranges of the inputs with nb_threads workers. Each range is
+// written to a part file in tmp_dir, and the parts are appended to out in key order.
+template<typename Process>
+void run_partitioned(const std::vector<std::string>& paths, size_t nb_threads, bool actg_order, std::ostream& out, const fs::path& tmp_dir, Process&& process) {
+  if (nb_threads <= 1) {
+    process(std::vector<byte_range>(paths.size()), out);
+    return;
+  }
+
+  auto ranges = partition_matrices(paths, nb_threads, actg_order);
+  spdlog::debug(fmt::format("processing {} key ranges", ranges.size()));
+
+  std::vector<std::string> parts;
+  for (size_t p = 0; p < ranges.size(); p++) {
+    parts.push_back((tmp_dir / fmt::format("kmat_part.{}.{}.mat", getpid(), p)).string());
+  }
+
+  std::vector<std::future<void>> pending;
+  for (size_t p = 0; p < ranges.size(); p++) {
+    pending.push_back(std::async(std::launch::async, [&, p]() {
+      std::ofstream part(parts[p]);
+      if (!part.good()) { throw std::runtime_error(fmt::format("cannot open {}", parts[p])); }
+      process(ranges[p], part);
+    }));
+  }
+
+  std::exception_ptr error;
+  for (size_t p = 0; p < parts.size(); p++) {
+    try {
+      pending[p].get();
+      if (!error) {
+        std::ifstream part(parts[p]);
+        if (part.peek() != std::ifstream::traits_type::eof()) { out << part.rdbuf(); }
+      }
+    } catch (...) {
+      if (!error) { error = std::current_exception(); }
+    }
+    remove_file(parts[p]);
+  }
+  if (error) { std::rethrow_exception(error); }
+}
+
+// Directory for temporary files: tmp_dir if set, otherwise that of the output (or the current one)
+inline fs::path get_tmp_dir(const std::string& tmp_dir, const std::string& output) {
+  if (!tmp_dir.empty()) { return tmp_dir; }
+  return output.empty() ? fs::current_path() : fs::absolute(output).parent_path();
+}
+
+};
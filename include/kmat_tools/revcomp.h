@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include <kmat_tools/packed_kmer.h>
+#include <kmat_tools/utils.h>
+
+namespace kmat {
+
+namespace detail {
+
+#if defined(__SSSE3__)
+// Reverse complement of 16 characters, with the same result as rctable on every byte:
+// A/T and C/G (in both cases) differ by 0x15 and 0x04, indexed by their low nibble.
+inline __m128i reverse_complement_16(__m128i x) {
+  const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  const __m128i flip = _mm_setr_epi8(0, 0x15, 0, 0x04, 0x15, 0, 0, 0x04, 0, 0, 0, 0, 0, 0, 0, 0);
+  x = _mm_shuffle_epi8(x, reverse);
+  __m128i folded = _mm_or_si128(x, _mm_set1_epi8(0x20));
+  __m128i is_acgt = _mm_or_si128(
+    _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('a')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('c'))),
+    _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('g')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('t'))));
+  __m128i mask = _mm_shuffle_epi8(flip, _mm_and_si128(x, _mm_set1_epi8(0x0F)));
+  return _mm_xor_si128(x, _mm_and_si128(mask, is_acgt));
+}
+#endif
+
+// reverse the order of the 32 2-bit fields of a word
+inline uint64_t reverse_2bit(uint64_t x) {
+  x = __builtin_bswap64(x);
+  x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  return ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+}
+
+};
+
+// Reverse complement n characters of in into out (the ranges must not overlap)
+inline void reverse_complement(const char* in, size_t n, char* out) {
+  size_t i = 0;
+#if defined(__SSSE3__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + n - i - 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), detail::reverse_complement_16(x));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = rctable[static_cast<unsigned char>(in[n - i - 1])];
+  }
+}
+
+// Reverse complement a sequence in place, swapping 16-character blocks from both ends
+inline void reverse_complement_inplace(char* seq, size_t n) {
+  char* left = seq;
+  char* right = seq + n;
+#if defined(__SSSE3__)
+  for (; right - left >= 32; left += 16, right -= 16) {
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right - 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(left), detail::reverse_complement_16(r));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(right - 16), detail::reverse_complement_16(l));
+  }
+  if (right - left >= 16) {
+    // both blocks are loaded before storing, their overlap receives the same characters
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right - 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(left), detail::reverse_complement_16(r));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(right - 16), detail::reverse_complement_16(l));
+    return;
+  }
+#endif
+  for (; right - left >= 2; ++left, --right) {
+    char c = *left;
+    *left = rctable[static_cast<unsigned char>(right[-1])];
+    right[-1] = rctable[static_cast<unsigned char>(c)];
+  }
+  if (left != right) {
+    *left = rctable[static_cast<unsigned char>(*left)];
+  }
+}
+
+// Compare a sequence with its reverse complement, at the first differing character:
+// negative if the sequence is canonical, 0 if it is its own reverse complement.
+inline int canonical_compare(const char* seq, size_t n, bool actg_order = false) {
+  auto compare = [actg_order](unsigned char fc, unsigned char rc) {
+    int cmp = actg_order ? n2kt[fc] - n2kt[rc] : 0;
+    return cmp != 0 ? cmp : int(fc) - int(rc);
+  };
+
+  // past the first half, the reverse complement mirrors the compared part
+  const size_t half = (n + 1) / 2;
+  size_t i = 0;
+#if defined(__SSSE3__)
+  for (; i + 16 <= half; i += 16) {
+    __m128i fw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(seq + i));
+    __m128i rc = detail::reverse_complement_16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(seq + n - i - 16)));
+    unsigned diff = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(fw, rc))) & 0xFFFF;
+    if (diff) {
+      size_t j = i + __builtin_ctz(diff);
+      return compare(seq[j], rctable[static_cast<unsigned char>(seq[n - j - 1])]);
+    }
+  }
+#endif
+  for (; i < half; i++) {
+    unsigned char fc = seq[i];
+    unsigned char rc = rctable[static_cast<unsigned char>(seq[n - i - 1])];
+    if (fc != rc) {
+      return compare(fc, rc);
+    }
+  }
+  return 0;
+}
+
+inline void reverse_complement_inplace(std::string& seq) {
+  reverse_complement_inplace(seq.data(), seq.size());
+}
+
+inline bool is_canonical(const std::string& seq, bool actg_order = false) {
+  return canonical_compare(seq.data(), seq.size(), actg_order) <= 0;
+}
+
+// Reverse complement of a packed k-mer, in the nucleotide order it was packed with:
+// complementing is code ^ 3 in A<C<G<T and code ^ 2 in A<C<T<G.
+inline PackedKmer reverse_complement(const PackedKmer& kmer, bool actg_order) {
+  const uint64_t flip = actg_order ? 0xAAAAAAAAAAAAAAAAULL : ~uint64_t{0};
+  PackedKmer rc = kmer;
+  rc.hi = detail::reverse_2bit(kmer.lo ^ flip);
+  rc.lo = detail::reverse_2bit(kmer.hi ^ flip);
+
+  // the k-mer now ends at the lowest bit, left-align it again (the complemented padding is shifted out)
+  size_t shift = 128 - 2 * static_cast<size_t>(kmer.size);
+  if (shift >= 128) {
+    rc.hi = rc.lo = 0;
+  } else if (shift >= 64) {
+    rc.hi = rc.lo << (shift - 64);
+    rc.lo = 0;
+  } else if (shift > 0) {
+    rc.hi = (rc.hi << shift) | (rc.lo >> (64 - shift));
+    rc.lo <<= shift;
+  }
+  return rc;
+}
+
+// Smallest of a packed k-mer and its reverse complement
+inline PackedKmer canonical(const PackedKmer& kmer, bool actg_order) {
+  PackedKmer rc = reverse_complement(kmer, actg_order);
+  return rc.compare(kmer) < 0 ? rc : kmer;
+}
+
+};
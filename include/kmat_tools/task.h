@@ -37,7 +37,28 @@ public:
             nb_samples,
             reader.infos().id,
             reader.infos().partition,
-            m_compress);
+            m_compress,
+            reader.infos().sparse());
+
+        if (reader.infos().sparse()) {
+            // only the non-zero entries are visited, zeros are absent unless min_abundance is 0
+            std::vector<uint32_t> indices;
+            while (reader.template read<MAX_K, DMAX_C>(kmer, indices, counts)) {
+                m_nb_kmers++;
+                std::size_t nb_present{m_opts->min_abundance == 0 ? nb_samples - counts.size() : 0};
+                for (auto c : counts) {
+                    if(c >= m_opts->min_abundance){ 
+                        nb_present++;
+                    }
+                }
+
+                if(keep(nb_samples - nb_present, nb_present, nb_samples)) {
+                    m_nb_retained++;
+                    writer.template write<MAX_K, DMAX_C>(kmer, indices, counts);
+                }
+            }
+            return;
+        }
 
         while (reader.template read<MAX_K, DMAX_C>(kmer, counts)) {
             m_nb_kmers++;
@@ -51,12 +72,7 @@ public:
                 }
             }
 
-            bool enough_absent = (!m_opts->min_nb_absent_set && nb_absent >= m_opts->min_frac_absent * nb_samples)
-                || (m_opts->min_nb_absent_set && nb_absent >= m_opts->min_nb_absent);    
-            bool enough_present = (!m_opts->min_nb_present_set && nb_present >= m_opts->min_frac_present * nb_samples)
-                || (m_opts->min_nb_present_set && nb_present >= m_opts->min_nb_present);
-            
-            if(enough_absent && enough_present) {
+            if(keep(nb_absent, nb_present, nb_samples)) {
                 m_nb_retained++;
                 writer.template write<MAX_K, DMAX_C>(kmer,counts);
             }
@@ -65,6 +81,15 @@ public:
 
 private:
 
+    bool keep(std::size_t nb_absent, std::size_t nb_present, std::size_t nb_samples) const
+    {
+        bool enough_absent = (!m_opts->min_nb_absent_set && nb_absent >= m_opts->min_frac_absent * nb_samples)
+            || (m_opts->min_nb_absent_set && nb_absent >= m_opts->min_nb_absent);    
+        bool enough_present = (!m_opts->min_nb_present_set && nb_present >= m_opts->min_frac_present * nb_samples)
+            || (m_opts->min_nb_present_set && nb_present >= m_opts->min_nb_present);
+        return enough_absent && enough_present;
+    }
+
     std::string& m_input;
     std::string& m_output;
     std::size_t& m_nb_kmers;
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace kmat {
+
+// Queryable unitig index, written by kmat unitig --index and read by muset query
+//
+//   "<prefix>.index.sshash"    : the sshash dictionary of the unitigs (essentials format)
+//   "<prefix>.index.abundance" : the sparse unitig abundances
+//
+//   header  : AbundanceStoreHeader
+//   offsets : uint64 offset[nb_unitigs + 1], row i has offset[i+1] - offset[i] entries
+//   entries : for each unitig, uint32 sample[nnz] then float abundance[nnz], samples
+//             increasing; row i starts at byte 8 * offset[i] of the entries
+//
+// Unitig i is contig i of the dictionary, zero abundances are not stored.
+
+constexpr uint64_t UIX_MAGIC = 0x0031786975746d6b; // "kmtuix1\0"
+constexpr uint32_t UIX_VERSION = 1;
+
+struct AbundanceStoreHeader
+{
+    uint64_t magic{UIX_MAGIC};
+    uint32_t version{UIX_VERSION};
+    uint32_t kmer_size{0};
+    uint64_t nb_unitigs{0};
+    uint64_t nb_samples{0};
+    uint64_t nnz{0};
+};
+
+inline std::string index_dictionary_path(const std::string& prefix) {
+    return prefix + ".index.sshash";
+}
+
+inline std::string index_abundance_path(const std::string& prefix) {
+    return prefix + ".index.abundance";
+}
+
+// Writes the rows in unitig order, the offsets are filled in by close()
+class AbundanceStoreWriter {
+
+  public:
+    AbundanceStoreWriter(const std::string& path, uint32_t kmer_size, uint64_t nb_unitigs, uint64_t nb_samples)
+      : m_path(path), m_stream(path, std::ios::binary) {
+        if (!m_stream.good()) {
+            throw std::runtime_error(fmt::format("cannot open output file \"{}\" for writing", path));
+        }
+        m_header.kmer_size = kmer_size;
+        m_header.nb_unitigs = nb_unitigs;
+        m_header.nb_samples = nb_samples;
+        m_offsets.reserve(nb_unitigs + 1);
+        m_offsets.push_back(0);
+
+        m_stream.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+        std::vector<uint64_t> placeholder(nb_unitigs + 1, 0);
+        m_stream.write(reinterpret_cast<const char*>(placeholder.data()), placeholder.size() * sizeof(uint64_t));
+    }
+
+    void write_row(const std::vector<double>& abundances) {
+        m_samples.clear();
+        m_values.clear();
+        for (size_t s = 0; s < abundances.size(); s++) {
+            if (abundances[s] > 0) {
+                m_samples.push_back(s);
+                m_values.push_back(abundances[s]);
+            }
+        }
+        m_stream.write(reinterpret_cast<const char*>(m_samples.data()), m_samples.size() * sizeof(uint32_t));
+        m_stream.write(reinterpret_cast<const char*>(m_values.data()), m_values.size() * sizeof(float));
+        m_header.nnz += m_samples.size();
+        m_offsets.push_back(m_header.nnz);
+    }
+
+    void close() {
+        if (m_offsets.size() != m_header.nb_unitigs + 1) {
+            throw std::runtime_error(fmt::format("{}: {} unitig rows written, expected {}", m_path, m_offsets.size() - 1, m_header.nb_unitigs));
+        }
+        m_stream.seekp(0);
+        m_stream.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+        m_stream.write(reinterpret_cast<const char*>(m_offsets.data()), m_offsets.size() * sizeof(uint64_t));
+        m_stream.close();
+        if (!m_stream) {
+            throw std::runtime_error(fmt::format("cannot write {}", m_path));
+        }
+    }
+
+  private:
+    std::string m_path;
+    std::ofstream m_stream;
+    AbundanceStoreHeader m_header;
+    std::vector<uint64_t> m_offsets;
+    std::vector<uint32_t> m_samples;
+    std::vector<float> m_values;
+};
+
+// Read-only view of an abundance store mapped in memory, shared by the query threads
+class AbundanceStore {
+
+  public:
+    struct row_t {
+        const uint32_t* samples;
+        const float* abundances;
+        uint64_t size;
+    };
+
+    AbundanceStore(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error(fmt::format("cannot open {}", path));
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(AbundanceStoreHeader)) {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("{} is not a unitig abundance index", path));
+        }
+        m_size = st.st_size;
+        void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error(fmt::format("cannot map {}", path));
+        }
+        // rows are visited in the order of the queried unitigs
+        ::madvise(data, m_size, MADV_RANDOM);
+        m_data = static_cast<const char*>(data);
+
+        m_header = reinterpret_cast<const AbundanceStoreHeader*>(m_data);
+        uint64_t entries_offset = sizeof(AbundanceStoreHeader) + (m_header->nb_unitigs + 1) * sizeof(uint64_t);
+        if (m_header->magic != UIX_MAGIC || m_header->version != UIX_VERSION || entries_offset + m_header->nnz * 8 != m_size) {
+            ::munmap(const_cast<char*>(m_data), m_size);
+            throw std::runtime_error(fmt::format("{} is not a unitig abundance index", path));
+        }
+        m_offsets = reinterpret_cast<const uint64_t*>(m_data + sizeof(AbundanceStoreHeader));
+        m_entries = m_data + entries_offset;
+    }
+
+    ~AbundanceStore() {
+        ::munmap(const_cast<char*>(m_data), m_size);
+    }
+
+    AbundanceStore(const AbundanceStore&) = delete;
+    AbundanceStore& operator=(const AbundanceStore&) = delete;
+
+    const AbundanceStoreHeader& header() const { return *m_header; }
+    uint64_t nb_unitigs() const { return m_header->nb_unitigs; }
+    uint64_t nb_samples() const { return m_header->nb_samples; }
+
+    row_t row(uint64_t unitig_id) const {
+        uint64_t begin = m_offsets[unitig_id];
+        uint64_t size = m_offsets[unitig_id + 1] - begin;
+        const char* p = m_entries + 8 * begin;
+        return {reinterpret_cast<const uint32_t*>(p), reinterpret_cast<const float*>(p + size * sizeof(uint32_t)), size};
+    }
+
+  private:
+    const char* m_data{nullptr};
+    size_t m_size{0};
+    const AbundanceStoreHeader* m_header{nullptr};
+    const uint64_t* m_offsets{nullptr};
+    const char* m_entries{nullptr};
+};
+
+};
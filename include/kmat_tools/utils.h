@@ -2,7 +2,11 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <limits>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <type_traits>
@@ -75,6 +79,13 @@ static const unsigned char kt2n[4] = { 'A', 'C', 'T', 'G' };
 
 
 static inline int actg_compare(const char *a, const char *b, size_t n) {
+  // skip the common prefix 8 bytes at a time
+  for (; n >= 8; a += 8, b += 8, n -= 8) {
+    uint64_t x, y;
+    std::memcpy(&x, a, sizeof(x));
+    std::memcpy(&y, b, sizeof(y));
+    if (x != y) break;
+  }
   for (; n != 0; ++a, ++b, --n) {
     int r = n2kt[*a] - n2kt[*b];
     if (r != 0) return r;
@@ -96,26 +107,6 @@ static inline bool is_valid_kmer(const std::string& kmer) {
 }
 
 
-static inline void reverse_complement_inplace(std::string &seq) {
-    std::reverse(seq.begin(), seq.end());
-    std::for_each(seq.begin(), seq.end(), [](char& c){ c = rctable[c]; });
-}
-
-
-static inline bool is_canonical(const std::string &seq, bool actg_order=false) {
-
-  auto left = seq.cbegin();
-  for (auto right = seq.crbegin(); right != seq.crend(); ++right) {
-      auto fc = (unsigned char) *left++;
-      auto rc = (unsigned char) rctable[*right++];
-      if (fc != rc) {
-        return actg_order ? (n2kt[fc] < n2kt[rc]) : (fc < rc);
-      }
-  }
-  return true;
-}
-
-
 static size_t get_nb_samples(const std::string_view line, bool skip_first = false) {
   size_t nb_samples{0};
   size_t idx = line.find_first_not_of(" \t");
@@ -160,4 +151,18 @@ inline T add_sat(T a, T b) noexcept {
 	return res;
 }
 
+
+// Runtime selection of the count type from its width in bits (--count-width),
+// the counterpart of km::const_loop_executor for k-mer sizes.
+template<template<typename> typename Functor, typename... Args>
+inline auto count_width_exec(uint32_t width, Args&&... args) {
+  switch (width) {
+    case 8:  return Functor<uint8_t>()(std::forward<Args>(args)...);
+    case 16: return Functor<uint16_t>()(std::forward<Args>(args)...);
+    case 32: return Functor<uint32_t>()(std::forward<Args>(args)...);
+    default:
+      throw std::runtime_error(fmt::format("unsupported count width {}, expected 8, 16 or 32", width));
+  }
+}
+
 }; // namespace kmat
@@ -245,6 +245,12 @@ struct main_merge
 
     HashWindow hw(KmDir::get().m_hash_win);
 
+    uint32_t fanin = opt->merge_fanin;
+    if (fanin == 0)
+    {
+      fanin = get_merge_fanin(opt->nb_threads, opt->max_memory, merge_stream_bytes(opt->lz4));
+    }
+
     TaskPool pool(opt->nb_threads);
 
     std::vector<uint32_t> ab_vec(KmDir::get().m_fof.size(), opt->m_ab_min);
@@ -257,7 +263,8 @@ struct main_merge
       {
         spdlog::debug("[push] - KmerMergeTask - P={}", i);
         pool.add_task(std::make_shared<KmerMergeTask<MAX_K, DMAX_C>>(
-          i, ab_vec, config._kmerSize, opt->r_min, opt->save_if, opt->lz4, opt->mode, opt->format));
+          i, ab_vec, config._kmerSize, opt->r_min, opt->save_if, opt->lz4, opt->mode, opt->format,
+          false, fanin, opt->sparse));
       }
       else
       {
@@ -359,7 +366,7 @@ struct main_dump
         hr.write_as_text(out);
       }
     }
-    else if (km_file == KM_FILE::MATRIX)
+    else if (km_file == KM_FILE::MATRIX || km_file == KM_FILE::SPARSE_MATRIX)
     {
       MatrixReader mr(opt->input);
       if (opt->output == "stdout")
@@ -17,6 +17,7 @@
  *****************************************************************************/
 
 #pragma once
+#include <functional>
 #include <memory>
 #include <thread>
 
@@ -60,6 +61,10 @@ struct all_options : km_options
   uint32_t bwidth {0};
 
   uint32_t max_memory {8000};
+  uint32_t merge_fanin {0};
+  bool sparse {false};
+  bool numa {false}; // pin workers to NUMA nodes, count and merge each partition on one node
+  std::string io_engine {"fstream"}; // file layer of the partition files: fstream, pread or uring
   double restrict_to;
   std::vector<uint32_t> restrict_to_list;
   std::vector<uint32_t> m_ab_min_vec;
@@ -74,6 +79,10 @@ struct all_options : km_options
   COUNT_FORMAT count_format;
   COMMAND until;
 
+  // optional wrapper of the pipeline steps (config, repart, count, merge, format),
+  // e.g. to measure them when kmtricks runs as a library
+  std::function<void(const std::string&, const std::function<void()>&)> step_runner;
+
 #ifdef WITH_PLUGIN
   std::string plugin;
   std::string plugin_config;
@@ -107,6 +116,11 @@ struct all_options : km_options
     RECORD(ss, focus);
     RECORD(ss, restrict_to);
     RECORD(ss, bwidth);
+    RECORD(ss, max_memory);
+    RECORD(ss, merge_fanin);
+    RECORD(ss, sparse);
+    RECORD(ss, numa);
+    RECORD(ss, io_engine);
 #ifdef WITH_PLUGIN
     RECORD(ss, use_plugin);
     RECORD(ss, plugin);
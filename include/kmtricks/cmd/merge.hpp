@@ -40,6 +40,10 @@ struct merge_options : km_options
   uint32_t save_if;
   std::vector<uint32_t> m_ab_min_vec;
 
+  uint32_t max_memory {8000};
+  uint32_t merge_fanin {0};
+  bool sparse {false};
+
   bool clear;
   bool lz4;
 
@@ -58,6 +62,9 @@ struct merge_options : km_options
     RECORD(ss, save_if);
     RECORD(ss, clear);
     RECORD(ss, lz4);
+    RECORD(ss, max_memory);
+    RECORD(ss, merge_fanin);
+    RECORD(ss, sparse);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
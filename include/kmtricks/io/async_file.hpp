@@ -0,0 +1,681 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+  #include <linux/io_uring.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+    #define KM_WITH_IO_URING
+  #endif
+#endif
+
+#include <spdlog/spdlog.h>
+
+#include <kmtricks/exceptions.hpp>
+
+namespace km
+{
+
+enum class IO_ENGINE
+{
+  FSTREAM, // std::fstream with the IFile buffer
+  PREAD,   // pread/pwrite of large aligned blocks, read-ahead hinted to the kernel
+  URING    // io_uring: the next block is read, or the last one written, while the current one is used
+};
+
+inline IO_ENGINE str_to_io_engine(const std::string& engine)
+{
+  if (engine == "fstream")
+    return IO_ENGINE::FSTREAM;
+  else if (engine == "pread")
+    return IO_ENGINE::PREAD;
+  else if (engine == "uring")
+    return IO_ENGINE::URING;
+  throw ConfigError("Unknown I/O engine: " + engine + " (fstream, pread or uring).");
+}
+
+inline std::string io_engine_to_str(IO_ENGINE engine)
+{
+  if (engine == IO_ENGINE::PREAD)
+    return "pread";
+  else if (engine == IO_ENGINE::URING)
+    return "uring";
+  return "fstream";
+}
+
+// Minimal io_uring instance on the raw syscalls (no liburing). A file owns its ring and
+// has at most two requests in flight; the ring is only used by the thread using the file.
+class Uring
+{
+ public:
+  explicit Uring(unsigned entries)
+  {
+#ifdef KM_WITH_IO_URING
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (m_fd < 0)
+      return;
+
+    m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+    m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+
+    m_sq = map(m_sq_size, IORING_OFF_SQ_RING);
+    m_cq = single ? m_sq : map(m_cq_size, IORING_OFF_CQ_RING);
+    void* sqes = map(m_sqes_size, IORING_OFF_SQES);
+    if (m_sq == MAP_FAILED || m_cq == MAP_FAILED || sqes == MAP_FAILED)
+    {
+      if (sqes != MAP_FAILED) munmap(sqes, m_sqes_size);
+      release();
+      return;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(m_sq);
+    m_sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    m_sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+    char* cq = static_cast<char*>(m_cq);
+    m_cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+#else
+    (void)entries;
+#endif
+  }
+
+  ~Uring()
+  {
+#ifdef KM_WITH_IO_URING
+    if (m_sqes) munmap(m_sqes, m_sqes_size);
+#endif
+    release();
+  }
+
+  Uring(const Uring&) = delete;
+  Uring& operator=(const Uring&) = delete;
+
+  bool ok() const { return m_fd >= 0; }
+
+  // io_uring may be missing (< 5.1), disabled (kernel.io_uring_disabled) or filtered out (seccomp)
+  static bool available()
+  {
+    static const bool available = Uring(2).ok();
+    return available;
+  }
+
+  // queue a readv/writev of one iovec and submit it, data is given back by wait()
+  void submit(bool write, int fd, const iovec* iov, uint64_t offset, void* data)
+  {
+#ifdef KM_WITH_IO_URING
+    unsigned tail = *m_sq_tail;
+    unsigned index = tail & m_sq_mask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(iov);
+    sqe->len = 1;
+    sqe->off = offset;
+    sqe->user_data = reinterpret_cast<uint64_t>(data);
+    m_sq_array[index] = index;
+    __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    for (int retry = 0; enter(1, 0) < 0; retry++)
+    {
+      if ((errno != EAGAIN && errno != EINTR) || retry == 1000)
+        throw IOError(std::string("io_uring_enter: ") + std::strerror(errno));
+      std::this_thread::yield();
+    }
+#else
+    (void)write; (void)fd; (void)iov; (void)offset; (void)data;
+#endif
+  }
+
+  // wait for the next completion, returns its data and sets res (bytes or -errno)
+  void* wait(int32_t& res)
+  {
+#ifdef KM_WITH_IO_URING
+    while (true)
+    {
+      unsigned head = *m_cq_head;
+      if (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+      {
+        const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+        void* data = reinterpret_cast<void*>(cqe.user_data);
+        res = cqe.res;
+        __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+        return data;
+      }
+      if (enter(0, 1) < 0 && errno != EINTR)
+        throw IOError(std::string("io_uring_enter: ") + std::strerror(errno));
+    }
+#else
+    res = -ENOSYS;
+    return nullptr;
+#endif
+  }
+
+ private:
+#ifdef KM_WITH_IO_URING
+  void* map(size_t size, off_t offset)
+  {
+    return mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+  }
+
+  int enter(unsigned to_submit, unsigned min_complete)
+  {
+    return static_cast<int>(syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete,
+                                    min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+  }
+#endif
+
+  void release()
+  {
+#ifdef KM_WITH_IO_URING
+    if (m_cq && m_cq != MAP_FAILED && m_cq != m_sq) munmap(m_cq, m_cq_size);
+    if (m_sq && m_sq != MAP_FAILED) munmap(m_sq, m_sq_size);
+    m_sq = m_cq = nullptr;
+#endif
+    if (m_fd >= 0) ::close(m_fd);
+    m_fd = -1;
+  }
+
+ private:
+  int m_fd {-1};
+#ifdef KM_WITH_IO_URING
+  void* m_sq {nullptr};
+  void* m_cq {nullptr};
+  size_t m_sq_size {0};
+  size_t m_cq_size {0};
+  size_t m_sqes_size {0};
+  io_uring_sqe* m_sqes {nullptr};
+  unsigned* m_sq_tail {nullptr};
+  unsigned* m_sq_array {nullptr};
+  unsigned m_sq_mask {0};
+  unsigned* m_cq_head {nullptr};
+  unsigned* m_cq_tail {nullptr};
+  unsigned m_cq_mask {0};
+  io_uring_cqe* m_cqes {nullptr};
+#endif
+};
+
+// Sequential file streambuf on two page-aligned blocks. Reading, the block after the one
+// being consumed is already requested (read-ahead); writing, a full block is handed to the
+// kernel and filling goes on in the other one (write-behind). With io_uring the requests run
+// asynchronously; with pread/pwrite the read-ahead is a posix_fadvise hint and writes are
+// synchronous. A file is opened either for reading or for writing.
+class async_filebuf : public std::streambuf
+{
+  struct Block
+  {
+    char* data {nullptr};
+    iovec iov;
+    uint64_t offset {0};
+    size_t len {0};
+    int32_t res {0};
+    bool pending {false};
+  };
+
+ public:
+  static constexpr size_t alignment = 4096;
+
+  async_filebuf() = default;
+  async_filebuf(const async_filebuf&) = delete;
+  async_filebuf& operator=(const async_filebuf&) = delete;
+
+  ~async_filebuf() { close(); }
+
+  async_filebuf* open(const std::string& path, std::ios_base::openmode mode, IO_ENGINE engine, size_t block_size)
+  {
+    if (is_open() || (mode & std::ios_base::in) == (mode & std::ios_base::out) || (mode & std::ios_base::app))
+      return nullptr;
+    m_write = mode & std::ios_base::out;
+    m_fd = ::open(path.c_str(), m_write ? O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0666);
+    if (m_fd < 0)
+      return nullptr;
+    m_path = path;
+    m_engine = engine;
+    m_block_size = round_up(std::max<size_t>(block_size, alignment));
+    m_next = 0;
+    if (m_write)
+    {
+      // the second block and the ring come with the first full block, small files do without
+      allocate(m_blocks[0]);
+      setp(m_blocks[0].data, m_blocks[0].data + m_block_size);
+    }
+    else
+    {
+      struct stat st;
+      m_size = fstat(m_fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : UINT64_MAX;
+      // a file holding in one block is read with a single pread
+      if (m_size < m_block_size)
+        m_block_size = round_up(std::max<size_t>(m_size, 1));
+      else if (m_engine == IO_ENGINE::URING)
+        start_ring();
+      allocate(m_blocks[0]);
+      allocate(m_blocks[1]);
+#ifdef POSIX_FADV_SEQUENTIAL
+      posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+      read_ahead(m_blocks[0]);
+      read_ahead(m_blocks[1]);
+    }
+    return this;
+  }
+
+  // waits for the requests in flight, returns nullptr if a write failed
+  async_filebuf* close()
+  {
+    if (!is_open())
+      return nullptr;
+    bool good = true;
+    try
+    {
+      if (m_write)
+        good = sync() == 0;
+      for (auto& block : m_blocks)
+        if (block.pending) wait(block);
+    }
+    catch (const km_exception& e)
+    {
+      // requests may still be in flight, their blocks are leaked rather than freed
+      spdlog::error("{}: {}", m_path, e.get_msg());
+      good = false;
+      for (auto& block : m_blocks)
+        if (block.pending) block.data = nullptr;
+    }
+    for (auto& block : m_blocks)
+    {
+      std::free(block.data);
+      block = Block();
+    }
+    m_ring.reset();
+    ::close(m_fd);
+    m_fd = -1;
+    m_cur = 0;
+    m_consuming = false;
+    setg(nullptr, nullptr, nullptr);
+    setp(nullptr, nullptr);
+    return good ? this : nullptr;
+  }
+
+  bool is_open() const { return m_fd >= 0; }
+  bool uring() const { return m_ring != nullptr; }
+  size_t block_size() const { return m_block_size; }
+
+ protected:
+  // the blocks are ours, IFile::set_second_layer would give its own buffer
+  std::streambuf* setbuf(char*, std::streamsize) override { return this; }
+
+  int_type underflow() override
+  {
+    if (!is_open() || m_write)
+      return traits_type::eof();
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    if (m_consuming)
+    {
+      // the current block is used up: it reads ahead after the other one, which becomes current
+      read_ahead(m_blocks[m_cur]);
+      m_cur ^= 1;
+      m_consuming = false;
+    }
+
+    Block& block = m_blocks[m_cur];
+    if (!block.pending)
+    {
+      m_pos = m_next;
+      return traits_type::eof();
+    }
+    int32_t res = wait(block);
+    if (res < 0)
+      throw IOError("Unable to read " + m_path + ": " + std::strerror(-res));
+
+    if (static_cast<size_t>(res) < block.len)
+    {
+      // the file is shorter than at opening (or a short read): read again after what we got
+      Block& other = m_blocks[m_cur ^ 1];
+      if (other.pending) wait(other);
+      other.pending = false;
+      m_next = block.offset + res;
+      m_size = res ? UINT64_MAX : m_next;
+      if (!res)
+      {
+        m_pos = m_next;
+        return traits_type::eof();
+      }
+      read_ahead(other);
+    }
+    m_consuming = true;
+    setg(block.data, block.data, block.data + res);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  int_type overflow(int_type c) override
+  {
+    if (!is_open() || !m_write)
+      return traits_type::eof();
+    if (!m_blocks[1].data)
+    {
+      allocate(m_blocks[1]);
+      if (m_engine == IO_ENGINE::URING)
+        start_ring();
+    }
+    if (!write_behind())
+      return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int sync() override
+  {
+    if (!is_open() || !m_write)
+      return 0;
+    if (!write_behind())
+      return -1;
+    Block& other = m_blocks[m_cur ^ 1];
+    return !other.pending || complete_write(other) ? 0 : -1;
+  }
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override
+  {
+    if (!is_open())
+      return pos_type(off_type(-1));
+    if (m_write)
+    {
+      // tellp only
+      if (off != 0 || dir != std::ios_base::cur)
+        return pos_type(off_type(-1));
+      return pos_type(static_cast<off_type>(m_next + (pptr() - pbase())));
+    }
+
+    uint64_t pos = m_consuming ? m_blocks[m_cur].offset + (gptr() - eback()) : m_pos;
+    if (dir == std::ios_base::beg)
+      pos = off;
+    else if (dir == std::ios_base::cur)
+      pos += off;
+    else
+    {
+      struct stat st;
+      if (fstat(m_fd, &st) != 0)
+        return pos_type(off_type(-1));
+      pos = st.st_size + off;
+    }
+    return seek_read(pos);
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+  {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+
+ private:
+  static size_t round_up(size_t size) { return (size + alignment - 1) / alignment * alignment; }
+
+  void allocate(Block& block)
+  {
+    void* data = nullptr;
+    if (posix_memalign(&data, alignment, m_block_size))
+      throw std::bad_alloc();
+    block.data = static_cast<char*>(data);
+  }
+
+  void start_ring()
+  {
+    m_ring = std::make_unique<Uring>(4);
+    if (!m_ring->ok())
+      m_ring.reset();
+  }
+
+  pos_type seek_read(uint64_t pos)
+  {
+    Block& block = m_blocks[m_cur];
+    if (m_consuming && pos >= block.offset && pos < block.offset + (egptr() - eback()))
+    {
+      setg(eback(), eback() + (pos - block.offset), egptr());
+      return pos_type(static_cast<off_type>(pos));
+    }
+    for (auto& b : m_blocks)
+    {
+      if (b.pending) wait(b);
+      b.pending = false;
+    }
+    struct stat st;
+    m_size = fstat(m_fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : UINT64_MAX;
+    m_cur = 0;
+    m_consuming = false;
+    setg(nullptr, nullptr, nullptr);
+    m_next = m_pos = pos;
+    read_ahead(m_blocks[0]);
+    read_ahead(m_blocks[1]);
+    return pos_type(static_cast<off_type>(pos));
+  }
+
+  // request the block at m_next, nothing past the end of the file
+  void read_ahead(Block& block)
+  {
+    if (m_next >= m_size)
+      return;
+    block.offset = m_next;
+    block.len = static_cast<size_t>(std::min<uint64_t>(m_block_size, m_size - m_next));
+    m_next += block.len;
+    submit(block);
+  }
+
+  // hand the filled block to the kernel and go on with the other one, once its own write is done
+  bool write_behind()
+  {
+    Block& block = m_blocks[m_cur];
+    size_t len = pptr() - pbase();
+    if (len)
+    {
+      block.offset = m_next;
+      block.len = len;
+      m_next += len;
+      submit(block);
+      // a file flushed before its first block is full has a single block
+      if (m_blocks[m_cur ^ 1].data)
+        m_cur ^= 1;
+    }
+    Block& next = m_blocks[m_cur];
+    if (next.pending && !complete_write(next))
+      return false;
+    setp(next.data, next.data + m_block_size);
+    return true;
+  }
+
+  bool complete_write(Block& block)
+  {
+    int32_t res = wait(block);
+    if (res >= 0 && static_cast<size_t>(res) < block.len)
+      res = pwrite_all(m_fd, block.data + res, block.len - res, block.offset + res);
+    if (res < 0)
+    {
+      spdlog::error("Unable to write {}: {}", m_path, std::strerror(-res));
+      return false;
+    }
+    return true;
+  }
+
+  void submit(Block& block)
+  {
+    block.iov.iov_base = block.data;
+    block.iov.iov_len = block.len;
+    block.pending = true;
+    if (m_ring)
+    {
+      m_ring->submit(m_write, m_fd, &block.iov, block.offset, &block);
+    }
+    else if (m_write)
+    {
+      // completed by wait()
+      block.res = pwrite_all(m_fd, block.data, block.len, block.offset);
+    }
+    else
+    {
+#ifdef POSIX_FADV_WILLNEED
+      posix_fadvise(m_fd, block.offset, block.len, POSIX_FADV_WILLNEED);
+#endif
+    }
+  }
+
+  int32_t wait(Block& block)
+  {
+    while (block.pending)
+    {
+      if (m_ring)
+      {
+        int32_t res = 0;
+        Block* done = static_cast<Block*>(m_ring->wait(res));
+        if (res == -EAGAIN || res == -EINTR)
+          res = m_write ? pwrite_all(m_fd, done->data, done->len, done->offset)
+                        : pread_all(m_fd, done->data, done->len, done->offset);
+        done->res = res;
+        done->pending = false;
+      }
+      else
+      {
+        if (!m_write)
+          block.res = pread_all(m_fd, block.data, block.len, block.offset);
+        block.pending = false;
+      }
+    }
+    return block.res;
+  }
+
+  // bytes read (less at the end of the file) or -errno
+  static int32_t pread_all(int fd, char* data, size_t len, uint64_t offset)
+  {
+    size_t done = 0;
+    while (done < len)
+    {
+      ssize_t n = pread(fd, data + done, len - done, offset + done);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        return done ? static_cast<int32_t>(done) : -errno;
+      if (n == 0)
+        break;
+      done += n;
+    }
+    return static_cast<int32_t>(done);
+  }
+
+  // bytes written (all of them) or -errno
+  static int32_t pwrite_all(int fd, const char* data, size_t len, uint64_t offset)
+  {
+    size_t done = 0;
+    while (done < len)
+    {
+      ssize_t n = pwrite(fd, data + done, len - done, offset + done);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return n < 0 ? -errno : -EIO;
+      done += n;
+    }
+    return static_cast<int32_t>(done);
+  }
+
+ private:
+  int m_fd {-1};
+  bool m_write {false};
+  IO_ENGINE m_engine {IO_ENGINE::PREAD};
+  std::string m_path;
+  size_t m_block_size {0};
+  Block m_blocks[2];
+  unsigned m_cur {0};
+  bool m_consuming {false};   // reading: get area on m_blocks[m_cur]
+  uint64_t m_next {0};        // file offset of the next request
+  uint64_t m_size {0};        // reading: file size, no read-ahead past it
+  uint64_t m_pos {0};         // reading: position when no block is consumed
+  std::unique_ptr<Uring> m_ring {nullptr};
+};
+
+class async_fstream : public std::iostream
+{
+ public:
+  async_fstream(const std::string& path, std::ios_base::openmode mode, IO_ENGINE engine, size_t block_size)
+    : std::iostream(nullptr)
+  {
+    this->init(&m_buf);
+    if (!m_buf.open(path, mode, engine, block_size))
+      this->setstate(std::ios_base::failbit);
+  }
+
+  async_filebuf* rdbuf() { return &m_buf; }
+  bool uring() const { return m_buf.uring(); }
+
+ private:
+  async_filebuf m_buf;
+};
+
+// File layer of the kmtricks binary files (IFile), process-wide: set once before the
+// pipeline runs, from the io_engine option.
+class AsyncIO
+{
+ public:
+  static constexpr size_t default_block_size = 1 << 20;
+
+  static AsyncIO& get()
+  {
+    static AsyncIO io;
+    return io;
+  }
+
+  IO_ENGINE engine() const { return m_engine; }
+  size_t block_size() const { return m_block_size; }
+
+  // the std::fstream layer stays when io_uring is not available
+  void set(IO_ENGINE engine, size_t block_size = default_block_size)
+  {
+    if (engine == IO_ENGINE::URING && !Uring::available())
+    {
+      spdlog::warn("io_uring is not available, falling back to the fstream I/O engine.");
+      engine = IO_ENGINE::FSTREAM;
+    }
+    m_engine = engine;
+    m_block_size = block_size;
+  }
+
+  // memory of the two blocks of an opened file, with the pread and uring engines
+  size_t stream_bytes() const { return m_engine == IO_ENGINE::FSTREAM ? 0 : 2 * m_block_size; }
+
+ private:
+  AsyncIO() = default;
+
+  IO_ENGINE m_engine {IO_ENGINE::FSTREAM};
+  size_t m_block_size {default_block_size};
+};
+
+};
@@ -24,6 +24,7 @@
 #include <map>
 
 #include <kmtricks/io/lz4_stream.hpp>
+#include <kmtricks/io/async_file.hpp>
 #include <kmtricks/exceptions.hpp>
 #include <kmtricks/utils.hpp>
 
@@ -37,6 +38,7 @@ enum class KM_FILE
   KMER,
   HASH,
   MATRIX,
+  SPARSE_MATRIX,
   MATRIX_HASH,
   PAMATRIX,
   PAMATRIX_HASH,
@@ -52,6 +54,7 @@ const std::map<KM_FILE, uint64_t> MAGICS = {
   {KM_FILE::KMER, 0x72656d6b},
   {KM_FILE::HASH, 0x68736168},
   {KM_FILE::MATRIX, 0x6b5f78697274616d},
+  {KM_FILE::SPARSE_MATRIX, 0x6b5f787274616d73},
   {KM_FILE::PAMATRIX, 0x6b5f74616d6170},
   {KM_FILE::VECTOR, 0x726f74636576},
   {KM_FILE::BITMATRIX, 0x74616d746962},
@@ -78,6 +81,8 @@ inline KM_FILE get_km_file_type(const std::string& path)
     return KM_FILE::HASH;
   else if (km_file == MAGICS.at(KM_FILE::MATRIX))
     return KM_FILE::MATRIX;
+  else if (km_file == MAGICS.at(KM_FILE::SPARSE_MATRIX))
+    return KM_FILE::SPARSE_MATRIX;
   else if (km_file == MAGICS.at(KM_FILE::MATRIX_HASH))
     return KM_FILE::MATRIX_HASH;
   else if (km_file == MAGICS.at(KM_FILE::PAMATRIX))
@@ -104,6 +109,8 @@ inline std::string km_file_to_str(KM_FILE f)
     return "hash";
   else if (f == KM_FILE::MATRIX)
     return "count matrix";
+  else if (f == KM_FILE::SPARSE_MATRIX)
+    return "sparse count matrix";
   else if (f == KM_FILE::MATRIX_HASH)
     return "hash matrix";
   else if (f == KM_FILE::PAMATRIX)
@@ -157,6 +164,22 @@ public:
   bool compressed;
 };
 
+// File layer of an IFile: a std::fstream, or with the pread and uring engines an async_fstream
+// (large blocks, read-ahead, write-behind), std::fstream again if the latter cannot be opened.
+template<typename stream>
+stream* open_file_layer(const std::string& path, std::ios_base::openmode mode, bool async_io)
+{
+  const AsyncIO& io = AsyncIO::get();
+  if (async_io && io.engine() != IO_ENGINE::FSTREAM)
+  {
+    auto* file = new async_fstream(path, mode, io.engine(), io.block_size());
+    if (file->good())
+      return file;
+    delete file;
+  }
+  return new std::fstream{path, mode};
+}
+
 template<typename header_t,
          typename stream,
          size_t   buf_size>
@@ -168,8 +191,8 @@ class IFile
 public:
   IFile () : m_first_layer(new std::fstream{}) {}
 
-  IFile (const std::string& path, std::ios_base::openmode mode)
-    : m_first_layer(new std::fstream{path, mode}), m_path(path)
+  IFile (const std::string& path, std::ios_base::openmode mode, bool async_io = true)
+    : m_first_layer(open_file_layer<stream>(path, mode, async_io)), m_path(path)
   {
     if (!this->m_first_layer->good())
       throw std::runtime_error("Unable to open " + path);
@@ -224,7 +247,7 @@ protected:
   }
 
 protected:
-  stream_t    m_first_layer  {nullptr}; // fstream layer
+  stream_t    m_first_layer  {nullptr}; // fstream or async_fstream layer
   stream_t    m_second_layer {nullptr}; // compression layer, must inherit from basic_xstream<char>
   buffer_t    m_buf;
   header_t    m_header;
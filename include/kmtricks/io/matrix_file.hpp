@@ -17,6 +17,7 @@
  *****************************************************************************/
 
 #pragma once
+#include <cstring>
 #include <kmtricks/io/io_common.hpp>
 #include <kmtricks/kmer.hpp>
 #include <kmtricks/utils.hpp>
@@ -76,10 +77,16 @@ public:
   void sanity_check()
   {
     _sanity_check();
-    if (matrix_magic != MAGICS.at(KM_FILE::MATRIX))
+    if (matrix_magic != MAGICS.at(KM_FILE::MATRIX) &&
+        matrix_magic != MAGICS.at(KM_FILE::SPARSE_MATRIX))
       throw IOError("Invalid file format.");
   }
 
+  bool sparse() const
+  {
+    return matrix_magic == MAGICS.at(KM_FILE::SPARSE_MATRIX);
+  }
+
 public:
   uint64_t matrix_magic {MAGICS.at(KM_FILE::MATRIX)};
   uint32_t kmer_size;
@@ -90,6 +97,46 @@ public:
   uint32_t partition;
 };
 
+// Sparse count matrices (KM_FILE::SPARSE_MATRIX) share the dense header but each row is
+// encoded adaptively after the k-mer:
+//   varint tag = (nnz << 1) | dense
+//   dense  -> nb_counts raw counts
+//   sparse -> varint idx_bytes, idx_bytes of varint sample index deltas, nnz raw counts
+// A row is stored dense as soon as its sparse form would not be smaller.
+
+inline uint8_t* varint_encode(uint32_t v, uint8_t* out)
+{
+  while (v >= 0x80)
+  {
+    *out++ = static_cast<uint8_t>(v | 0x80);
+    v >>= 7;
+  }
+  *out++ = static_cast<uint8_t>(v);
+  return out;
+}
+
+// Decodes a varint of at most 5 bytes, all of them before end. Returns nullptr on a varint
+// running past end or not fitting in 32 bits.
+inline const uint8_t* varint_decode(const uint8_t* in, const uint8_t* end, uint32_t& v)
+{
+  v = 0;
+  for (uint32_t shift = 0; shift < 35 && in < end; shift += 7)
+  {
+    uint8_t b = *in++;
+    if (shift == 28 && b > 0x0f)
+      return nullptr;
+    v |= static_cast<uint32_t>(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return in;
+  }
+  return nullptr;
+}
+
+constexpr size_t varint_size(uint32_t v)
+{
+  return v < (1u << 7) ? 1 : v < (1u << 14) ? 2 : v < (1u << 21) ? 3 : v < (1u << 28) ? 4 : 5;
+}
+
 template<size_t buf_size = 8192>
 class MatrixWriter : public IFile<MatrixFileHeader, std::ostream, buf_size>
 {
@@ -101,9 +148,12 @@ public:
                uint32_t nb_counts,
                uint32_t id,
                uint32_t partition,
-               bool lz4)
+               bool lz4,
+               bool sparse = false)
     : IFile<MatrixFileHeader, std::ostream, buf_size>(path, std::ios::out | std::ios::binary)
   {
+    if (sparse)
+      this->m_header.matrix_magic = MAGICS.at(KM_FILE::SPARSE_MATRIX);
     this->m_header.compressed = lz4;
     this->m_header.kmer_size = kmer_size;
     this->m_header.kmer_slots = (kmer_size + 31) / 32;
@@ -122,9 +172,101 @@ public:
   {
     this->m_second_layer->write(reinterpret_cast<const char*>(kmer.get_data64()),
                                 this->m_header.kmer_slots*8);
-    this->m_second_layer->write(reinterpret_cast<char*>(counts.data()),
-                                counts.size()*(requiredC<MAX_C>::value/8));
+    if (!this->m_header.sparse())
+    {
+      this->m_second_layer->write(reinterpret_cast<char*>(counts.data()),
+                                  counts.size()*(requiredC<MAX_C>::value/8));
+      return;
+    }
+
+    using count_type = typename selectC<MAX_C>::type;
+    m_indices.clear(); m_values.clear();
+    for (uint32_t i = 0; i < counts.size(); i++)
+    {
+      if (counts[i])
+      {
+        m_indices.push_back(i);
+        m_values.resize(m_values.size() + sizeof(counts[i]));
+        std::memcpy(m_values.data() + m_values.size() - sizeof(counts[i]), &counts[i], sizeof(counts[i]));
+      }
+    }
+    write_row<count_type>(m_indices, reinterpret_cast<const count_type*>(m_values.data()), counts.data());
+  }
+
+  // Sparse input: indices must be strictly increasing and counts non-zero. On sparse matrices,
+  // the row is only expanded when its dense form is the smaller one.
+  template<size_t MAX_K, size_t MAX_C>
+  void write(Kmer<MAX_K>& kmer,
+             const std::vector<uint32_t>& indices,
+             const std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    using count_type = typename selectC<MAX_C>::type;
+    this->m_second_layer->write(reinterpret_cast<const char*>(kmer.get_data64()),
+                                this->m_header.kmer_slots*8);
+
+    if (!this->m_header.sparse())
+    {
+      this->m_second_layer->write(expand(indices, counts.data()),
+                                  this->m_header.nb_counts * sizeof(count_type));
+      return;
+    }
+
+    write_row<count_type>(indices, counts.data(), nullptr);
+  }
+
+private:
+  // Dense row of nb_counts counts from its non-zero entries, in m_dense.
+  template<typename count_type>
+  const char* expand(const std::vector<uint32_t>& indices, const count_type* values)
+  {
+    m_dense.assign(this->m_header.nb_counts * sizeof(count_type), 0);
+    count_type* dense = reinterpret_cast<count_type*>(m_dense.data());
+    for (size_t i = 0; i < indices.size(); i++)
+      dense[indices[i]] = values[i];
+    return m_dense.data();
+  }
+
+  // Writes the row tag, then the sparse entries or the dense row, expanded from the sparse
+  // entries when not given.
+  template<typename count_type>
+  void write_row(const std::vector<uint32_t>& indices, const count_type* values, const count_type* dense)
+  {
+    uint32_t nnz = indices.size();
+    size_t dense_bytes = this->m_header.nb_counts * sizeof(count_type);
+    size_t values_bytes = nnz * sizeof(count_type);
+    m_buffer.resize(nnz * 5);
+    uint8_t* p = m_buffer.data();
+    uint32_t prev = 0;
+    for (auto i : indices)
+    {
+      p = varint_encode(i - prev, p);
+      prev = i;
+    }
+    uint32_t idx_bytes = p - m_buffer.data();
+
+    uint8_t tag[10];
+    if (varint_size(idx_bytes) + idx_bytes + values_bytes >= dense_bytes)
+    {
+      uint8_t* e = varint_encode((nnz << 1) | 1, tag);
+      this->m_second_layer->write(reinterpret_cast<char*>(tag), e - tag);
+      this->m_second_layer->write(dense ? reinterpret_cast<const char*>(dense) : expand(indices, values),
+                                  dense_bytes);
+    }
+    else
+    {
+      uint8_t* e = varint_encode(nnz << 1, tag);
+      e = varint_encode(idx_bytes, e);
+      this->m_second_layer->write(reinterpret_cast<char*>(tag), e - tag);
+      this->m_second_layer->write(reinterpret_cast<char*>(m_buffer.data()), idx_bytes);
+      this->m_second_layer->write(reinterpret_cast<const char*>(values), values_bytes);
+    }
   }
+
+private:
+  std::vector<uint32_t> m_indices;
+  std::vector<char> m_values;
+  std::vector<char> m_dense;
+  std::vector<uint8_t> m_buffer;
 };
 
 template<size_t buf_size = 8192>
@@ -144,24 +286,77 @@ public:
   template<size_t MAX_K, size_t MAX_C>
   bool read(Kmer<MAX_K>& kmer, std::vector<typename selectC<MAX_C>::type>& counts)
   {
+    return read<MAX_K, MAX_C>(kmer, counts, counts.size());
+  }
+
+  // Fills the first n counts of the row (at most nb_counts) and consumes the whole row.
+  template<size_t MAX_K, size_t MAX_C>
+  bool read(Kmer<MAX_K>& kmer, std::vector<typename selectC<MAX_C>::type>& counts, std::size_t n)
+  {
+    using count_type = typename selectC<MAX_C>::type;
     this->m_second_layer->read(reinterpret_cast<char*>(kmer.get_data64_unsafe()),
                                 this->m_header.kmer_slots*8);
-    this->m_second_layer->read(reinterpret_cast<char*>(counts.data()),
-                                counts.size()*(requiredC<MAX_C>::value/8));
     if (!this->m_second_layer->gcount())
       return false;
+
+    n = std::min<std::size_t>(n, this->m_header.nb_counts);
+    bool dense = true;
+    if (this->m_header.sparse())
+      read_row_header(dense, sizeof(count_type));
+
+    if (dense)
+    {
+      this->m_second_layer->read(reinterpret_cast<char*>(counts.data()), n*sizeof(count_type));
+      if (n < this->m_header.nb_counts)
+        this->m_second_layer->ignore((this->m_header.nb_counts - n)*sizeof(count_type));
+      return true;
+    }
+
+    std::fill(counts.begin(), counts.begin() + n, 0);
+    const count_type* values = reinterpret_cast<const count_type*>(m_values.data());
+    for (size_t i = 0; i < m_indices.size() && m_indices[i] < n; i++)
+      counts[m_indices[i]] = values[i];
     return true;
   }
 
+  // Only the non-zero entries of the row, sample indices in increasing order.
+  // Works on both dense and sparse matrices, the latter without expanding the row.
   template<size_t MAX_K, size_t MAX_C>
-  bool read(Kmer<MAX_K>& kmer, std::vector<typename selectC<MAX_C>::type>& counts, std::size_t n)
+  bool read(Kmer<MAX_K>& kmer,
+            std::vector<uint32_t>& indices,
+            std::vector<typename selectC<MAX_C>::type>& counts)
   {
+    using count_type = typename selectC<MAX_C>::type;
     this->m_second_layer->read(reinterpret_cast<char*>(kmer.get_data64_unsafe()),
                                 this->m_header.kmer_slots*8);
-    this->m_second_layer->read(reinterpret_cast<char*>(counts.data()),
-                                n*(requiredC<MAX_C>::value/8));
     if (!this->m_second_layer->gcount())
       return false;
+
+    bool dense = true;
+    if (this->m_header.sparse())
+      read_row_header(dense, sizeof(count_type));
+
+    indices.clear(); counts.clear();
+    if (dense)
+    {
+      m_values.resize(this->m_header.nb_counts * sizeof(count_type));
+      this->m_second_layer->read(m_values.data(), m_values.size());
+      const count_type* values = reinterpret_cast<const count_type*>(m_values.data());
+      for (uint32_t i = 0; i < this->m_header.nb_counts; i++)
+      {
+        if (values[i])
+        {
+          indices.push_back(i);
+          counts.push_back(values[i]);
+        }
+      }
+    }
+    else
+    {
+      indices.assign(m_indices.begin(), m_indices.end());
+      const count_type* values = reinterpret_cast<const count_type*>(m_values.data());
+      counts.assign(values, values + m_indices.size());
+    }
     return true;
   }
 
@@ -189,6 +384,66 @@ public:
       stream << kmer.to_string() << '\n';
     }
   }
+
+private:
+  uint32_t read_varint()
+  {
+    uint32_t v = 0;
+    for (uint32_t shift = 0; ; shift += 7)
+    {
+      int b = this->m_second_layer->get();
+      if (b == std::char_traits<char>::eof())
+        throw IOError("Truncated sparse row in " + this->m_path + ".");
+      v |= static_cast<uint32_t>(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return v;
+    }
+  }
+
+  // Reads the row tag. For sparse rows, also loads the indices and the raw counts
+  // in m_indices and m_values. Indices are checked to be increasing and below nb_counts,
+  // so that they can be used on per-sample arrays.
+  void read_row_header(bool& dense, size_t count_bytes)
+  {
+    uint32_t tag = read_varint();
+    uint32_t nnz = tag >> 1;
+    dense = tag & 1;
+    if (dense)
+      return;
+
+    uint32_t nb_counts = this->m_header.nb_counts;
+    uint32_t idx_bytes = read_varint();
+    if (nnz > nb_counts || idx_bytes > static_cast<uint64_t>(nnz) * 5)
+      throw IOError("Corrupt sparse row in " + this->m_path + ".");
+    m_buffer.resize(idx_bytes);
+    this->m_second_layer->read(reinterpret_cast<char*>(m_buffer.data()), idx_bytes);
+    if (static_cast<uint32_t>(this->m_second_layer->gcount()) != idx_bytes)
+      throw IOError("Truncated sparse row in " + this->m_path + ".");
+
+    m_indices.resize(nnz);
+    const uint8_t* p = m_buffer.data();
+    const uint8_t* end = p + idx_bytes;
+    uint64_t index = 0;
+    for (uint32_t i = 0; i < nnz; i++)
+    {
+      uint32_t delta;
+      p = varint_decode(p, end, delta);
+      index += delta;
+      if (!p || (i && !delta) || index >= nb_counts)
+        throw IOError("Corrupt sparse row in " + this->m_path + ".");
+      m_indices[i] = static_cast<uint32_t>(index);
+    }
+
+    m_values.resize(nnz * count_bytes);
+    this->m_second_layer->read(m_values.data(), m_values.size());
+    if (static_cast<size_t>(this->m_second_layer->gcount()) != m_values.size())
+      throw IOError("Truncated sparse row in " + this->m_path + ".");
+  }
+
+private:
+  std::vector<uint32_t> m_indices;
+  std::vector<char> m_values;
+  std::vector<uint8_t> m_buffer;
 };
 
 class MatrixHashFileHeader : public KmHeader
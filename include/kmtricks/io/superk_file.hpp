@@ -53,6 +53,8 @@ public:
   uint32_t partition;
 };
 
+// The superk storage keeps the files of all the partitions of a sample open: they stay on the
+// fstream layer, whatever the I/O engine (see AsyncIO).
 template<size_t buf_size = 8192>
 class SuperkWriter : public IFile<SuperkFileHeader, std::ostream, buf_size>
 {
@@ -61,7 +63,7 @@ public:
   SuperkWriter(const std::string& path,
              uint32_t partition,
              bool lz4)
-    : IFile<SuperkFileHeader, std::ostream, buf_size>(path, std::ios::out | std::ios::binary)
+    : IFile<SuperkFileHeader, std::ostream, buf_size>(path, std::ios::out | std::ios::binary, false)
   {
     this->m_header.compressed = lz4;
     this->m_header.partition = partition;
@@ -91,7 +93,7 @@ class SuperkReader : public IFile<SuperkFileHeader, std::istream, buf_size>
   using icstream = lz4_stream::basic_istream<buf_size>;
 public:
   SuperkReader(const std::string& path)
-    : IFile<SuperkFileHeader, std::istream, buf_size>(path, std::ios::in | std::ios::binary)
+    : IFile<SuperkFileHeader, std::istream, buf_size>(path, std::ios::in | std::ios::binary, false)
   {
     this->m_header.deserialize(this->m_first_layer.get());
     this->m_header.sanity_check();
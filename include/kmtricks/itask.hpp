@@ -17,6 +17,7 @@
  *****************************************************************************/
 
 #pragma once
+#include <atomic>
 #include <functional>
 #include <cstdint>
 #include <memory>
@@ -36,6 +37,12 @@ public:
 
   virtual void set_level(uint32_t level) { m_priority_level = level; }
 
+  uint32_t level() const { return m_priority_level; }
+
+  // preferred NUMA node, -1 for any (see TaskPool)
+  void set_node(int node) { m_node = node; }
+  int node() const { return m_node; }
+
   bool operator==(const ITask& task) const
   {
     return m_priority_level == task.m_priority_level;
@@ -85,12 +92,14 @@ public:
 
 protected:
   uint32_t m_priority_level;
+  int m_node {-1};
   bool m_ready {false};
-  bool m_finish {false};
+  // read by the scheduler thread while the task runs
+  std::atomic<bool> m_finish {false};
   bool m_ce {false};
   bool m_clear {false};
-  bool m_running {false};
-  bool m_in_queue {false};
+  std::atomic<bool> m_running {false};
+  std::atomic<bool> m_in_queue {false};
   std::function<void()> m_callback {nullptr};
 };
 
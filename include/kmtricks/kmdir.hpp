@@ -203,6 +203,13 @@ public:
     return fmt::format("{}/{}.pinfo", m_part_info_storage, id);
   }
 
+  std::string get_merge_run_path(uint32_t part_id, uint32_t level, uint32_t run_id, bool compressed)
+  {
+    std::string ext = fmt::format("run{}_{}.matrix", level, run_id);
+    if (compressed) ext += ".lz4";
+    return fmt::format(m_part_template, m_counts_storage, part_id, "merge", ext);
+  }
+
   std::string get_merge_th_path()
   {
     return fmt::format("{}/merge_amin.txt", m_root);
@@ -17,6 +17,9 @@
  *****************************************************************************/
 
 #pragma once
+#include <algorithm>
+#include <cstdio>
+#include <functional>
 #include <vector>
 #include <kmtricks/kmer.hpp>
 #include <kmtricks/utils.hpp>
@@ -99,26 +102,77 @@ private:
   std::vector<uint64_t> m_total_w_rescue;
 };
 
+// Merge input reading a k-mer file, i.e. the counts of one sample.
 template<size_t MAX_K, size_t MAX_C>
-class KmerMerger
+class KmerFileInput
 {
   using count_type = typename selectC<MAX_C>::type;
 public:
-  struct element
+  KmerFileInput(const std::string& path)
+    : m_stream(std::make_shared<KmerReader<8192>>(path)), counts(1, 0)
   {
-    Kmer<MAX_K> value;
-    count_type count {0};
-    bool is_set {false};
-  };
+    value.set_k(m_stream->infos().kmer_size);
+  }
+
+  uint32_t kmer_size() const { return m_stream->infos().kmer_size; }
+  uint32_t partition() const { return m_stream->infos().partition; }
+
+  bool read_next()
+  {
+    return m_stream->template read<MAX_K, MAX_C>(value, counts[0]);
+  }
+
+private:
+  kr_t<8192> m_stream;
 
 public:
-  KmerMerger(std::vector<std::string>& paths,
-         std::vector<uint32_t>& abundance_min_vec,
-         uint32_t kmer_size,
-         uint32_t recurrence_min,
-         uint32_t save_if)
-    : m_paths(paths), m_a_min_vec(abundance_min_vec), m_kmer_size(kmer_size),
-      m_r_min(recurrence_min), m_save_if(save_if)
+  Kmer<MAX_K> value;
+  std::vector<count_type> counts;
+};
+
+// Merge input reading an intermediate run, i.e. a count matrix covering consecutive samples.
+template<size_t MAX_K, size_t MAX_C>
+class MatrixRunInput
+{
+  using count_type = typename selectC<MAX_C>::type;
+public:
+  MatrixRunInput(const std::string& path)
+    : m_stream(std::make_shared<MatrixReader<8192>>(path)), counts(m_stream->infos().nb_counts, 0)
+  {
+    value.set_k(m_stream->infos().kmer_size);
+  }
+
+  uint32_t kmer_size() const { return m_stream->infos().kmer_size; }
+  uint32_t partition() const { return m_stream->infos().partition; }
+
+  bool read_next()
+  {
+    return m_stream->template read<MAX_K, MAX_C>(value, counts);
+  }
+
+private:
+  mr_t<8192> m_stream;
+
+public:
+  Kmer<MAX_K> value;
+  std::vector<count_type> counts;
+};
+
+// Sorted merge of inputs covering consecutive ranges of samples (see KmerMerger and
+// KmerRunMerger). The inputs are kept in a min-heap on their current k-mer, so a step only
+// touches the inputs holding the current k-mer.
+template<size_t MAX_K, size_t MAX_C, typename Input>
+class BasicKmerMerger
+{
+  using count_type = typename selectC<MAX_C>::type;
+public:
+  BasicKmerMerger(std::vector<std::string>& paths,
+                  std::vector<uint32_t>& abundance_min_vec,
+                  uint32_t kmer_size,
+                  uint32_t recurrence_min,
+                  uint32_t save_if)
+    : m_paths(paths), m_r_min(recurrence_min), m_save_if(save_if),
+      m_kmer_size(kmer_size), m_a_min_vec(abundance_min_vec)
   {
     init_stream();
     init_state();
@@ -141,33 +195,30 @@ public:
 
   void init_stream()
   {
+    m_inputs.reserve(m_paths.size());
     for (auto& path: m_paths)
-      m_input_streams.push_back(std::make_shared<KmerReader<8192>>(path));
-    m_size = m_paths.size();
-    m_kmer_size = m_input_streams[0]->infos().kmer_size;
+      m_inputs.emplace_back(path);
+    m_kmer_size = m_inputs[0].kmer_size();
+    m_partition = m_inputs[0].partition();
   }
 
   void init_state()
   {
-    for (size_t i=0; i<m_size; i++)
+    m_size = 0;
+    m_offsets.resize(m_inputs.size());
+    m_heap.reserve(m_inputs.size());
+    for (size_t i=0; i<m_inputs.size(); i++)
     {
-      m_elements.push_back(element{});
-      m_elements[i].value.set_k(m_kmer_size);
-
-      if (read_next(i))
-        m_elements[i].is_set = true;
-
-      if ( (!m_current_set || m_elements[i].value < m_current) && m_elements[i].is_set )
-      {
-        m_current = m_next = m_elements[i].value;
-        m_current_set = true;
-      }
+      m_offsets[i] = m_size;
+      m_size += m_inputs[i].counts.size();
+      if (m_inputs[i].read_next())
+        heap_push(i);
     }
+    m_current.set_k(m_kmer_size);
     m_counts.resize(m_size, 0);
     m_infos = std::make_unique<MergeStatistics<MAX_C>>(m_size);
   }
 
-
 #ifdef WITH_PLUGIN
   void set_plugin(IMergePlugin* plugin)
   {
@@ -183,19 +234,36 @@ public:
   bool next()
   {
     m_keep = false;
-    m_finish = true;
-    m_next_set = false;
+
+    for (auto& i : m_present)
+      std::fill_n(m_counts.begin() + m_offsets[i], m_inputs[i].counts.size(), 0);
+    m_present.clear();
+
+    if (m_heap.empty())
+      return false;
+
+    m_current = m_inputs[m_heap.front()].value;
+    while (!m_heap.empty() && m_inputs[m_heap.front()].value == m_current)
+    {
+      uint32_t i = heap_pop();
+      auto& input = m_inputs[i];
+      std::copy(input.counts.begin(), input.counts.end(), m_counts.begin() + m_offsets[i]);
+      m_present.push_back(i);
+      if (input.read_next())
+        heap_push(i);
+    }
 
     uint32_t recurrence = 0;
     uint32_t solid_in = 0;
-    m_current = m_next;
     m_need_check.clear();
-    for (size_t i=0; i<m_size; i++)
+    for (auto& r : m_present)
     {
-      if (m_elements[i].is_set && m_elements[i].value == m_current)
+      for (size_t i=m_offsets[r]; i<m_offsets[r] + m_inputs[r].counts.size(); i++)
       {
-        m_finish = false;
-        m_counts[i] = m_elements[i].count;
+        // absent from sample i
+        if (m_counts[i] == 0)
+          continue;
+
         if (m_counts[i] >= m_a_min_vec[i])
         {
           recurrence++;
@@ -216,18 +284,6 @@ public:
           else
             m_counts[i] = 0;
         }
-        if (!read_next(i))
-          m_elements[i].is_set = false;
-      }
-      else
-      {
-        m_counts[i] = 0;
-      }
-
-      if (m_elements[i].is_set && (!m_next_set || m_elements[i].value < m_next))
-      {
-        m_next = m_elements[i].value;
-        m_next_set = true;
       }
     }
 
@@ -256,12 +312,12 @@ public:
     }
 #endif
 
-    return !m_finish;
+    return true;
   }
 
-  void write_as_bin(const std::string& path, bool compressed)
+  void write_as_bin(const std::string& path, bool compressed, bool sparse = false)
   {
-    MatrixWriter mw(path, m_kmer_size, 1, m_size, 0, m_partition, compressed);
+    MatrixWriter mw(path, m_kmer_size, 1, m_size, 0, m_partition, compressed, sparse);
     while (next())
     {
       if (m_keep)
@@ -323,35 +379,50 @@ public:
   }
 
 private:
-  bool read_next(size_t i)
+  // min-heap on the current k-mer of the inputs, ties broken by input order
+  bool heap_greater(uint32_t a, uint32_t b) const
+  {
+    if (m_inputs[a].value == m_inputs[b].value)
+      return a > b;
+    return m_inputs[b].value < m_inputs[a].value;
+  }
+
+  void heap_push(uint32_t i)
   {
-    return m_input_streams[i]->template read<MAX_K, MAX_C>(m_elements[i].value,
-                                                           m_elements[i].count);
+    m_heap.push_back(i);
+    std::push_heap(m_heap.begin(), m_heap.end(),
+                   [this](uint32_t a, uint32_t b) { return heap_greater(a, b); });
+  }
+
+  uint32_t heap_pop()
+  {
+    std::pop_heap(m_heap.begin(), m_heap.end(),
+                  [this](uint32_t a, uint32_t b) { return heap_greater(a, b); });
+    uint32_t i = m_heap.back();
+    m_heap.pop_back();
+    return i;
   }
 
 private:
   std::vector<std::string>& m_paths;
-  uint32_t m_a_min;
   uint32_t m_r_min;
   uint32_t m_save_if;
-  uint32_t m_partition;
+  uint32_t m_partition {0};
 
-  std::vector<kr_t<8192>> m_input_streams;
-  std::vector<element> m_elements;
+  std::vector<Input> m_inputs;
+  std::vector<size_t> m_offsets;
+  std::vector<uint32_t> m_heap;
+  std::vector<uint32_t> m_present;
   std::vector<size_t> m_need_check;
 
-  uint32_t m_size;
+  uint32_t m_size {0};
   uint32_t m_kmer_size;
   std::vector<uint32_t>& m_a_min_vec;
 
-  Kmer<MAX_K> m_next;
   Kmer<MAX_K> m_current;
-  bool m_next_set {false};
-  bool m_current_set {false};
   std::vector<count_type> m_counts;
 
   bool m_keep {false};
-  bool m_finish {false};
 
   std::unique_ptr<MergeStatistics<MAX_C>> m_infos {nullptr};
 
@@ -360,6 +431,74 @@ private:
 #endif
 };
 
+// Merge the k-mer files of a partition, one per sample.
+template<size_t MAX_K, size_t MAX_C>
+class KmerMerger : public BasicKmerMerger<MAX_K, MAX_C, KmerFileInput<MAX_K, MAX_C>>
+{
+  using BasicKmerMerger<MAX_K, MAX_C, KmerFileInput<MAX_K, MAX_C>>::BasicKmerMerger;
+};
+
+// Approximate footprint of one merge input stream: IFile buffer, fstream buffer or the blocks
+// of the async file layer and, when compressed, the lz4 source/destination buffers and
+// decompression context.
+inline size_t merge_stream_bytes(bool lz4)
+{
+  return (lz4 ? (256 << 10) : (16 << 10)) + AsyncIO::get().stream_bytes();
+}
+
+// Merge intermediate sorted runs, i.e. count matrices covering consecutive groups of samples,
+// produced by KmerMerger when the number of samples exceeds the merge fan-in.
+// Abundance/recurrence thresholds are applied on the full count vector, as in KmerMerger.
+template<size_t MAX_K, size_t MAX_C>
+class KmerRunMerger : public BasicKmerMerger<MAX_K, MAX_C, MatrixRunInput<MAX_K, MAX_C>>
+{
+  using BasicKmerMerger<MAX_K, MAX_C, MatrixRunInput<MAX_K, MAX_C>>::BasicKmerMerger;
+};
+
+// Merge groups of at most fanin k-mer files into intermediate runs (count matrices without any
+// threshold applied), then groups of runs level by level, until at most fanin runs remain.
+// run_path(level, id) names the runs; the runs of a level are removed once merged.
+template<size_t MAX_K, size_t MAX_C>
+std::vector<std::string> merge_runs(std::vector<std::string>& paths,
+                                    uint32_t fanin,
+                                    uint32_t kmer_size,
+                                    bool lz4,
+                                    const std::function<std::string(uint32_t, uint32_t)>& run_path)
+{
+  std::vector<uint32_t> no_threshold(paths.size(), 0);
+  std::vector<std::string> runs;
+
+  for (size_t i=0; i<paths.size(); i+=fanin)
+  {
+    std::vector<std::string> group(paths.begin() + i,
+                                   paths.begin() + std::min<size_t>(i + fanin, paths.size()));
+    std::string run = run_path(0, runs.size());
+    KmerMerger<MAX_K, MAX_C> merger(group, no_threshold, kmer_size, 0, 0);
+    merger.write_as_bin(run, lz4, true);
+    runs.push_back(run);
+  }
+
+  for (uint32_t level=1; runs.size() > fanin; level++)
+  {
+    std::vector<std::string> next_runs;
+    for (size_t i=0; i<runs.size(); i+=fanin)
+    {
+      std::vector<std::string> group(runs.begin() + i,
+                                     runs.begin() + std::min<size_t>(i + fanin, runs.size()));
+      std::string run = run_path(level, next_runs.size());
+      {
+        KmerRunMerger<MAX_K, MAX_C> merger(group, no_threshold, kmer_size, 0, 0);
+        merger.write_as_bin(run, lz4, true);
+      }
+      for (auto& f : group)
+        std::remove(f.c_str());
+      next_runs.push_back(run);
+    }
+    runs = std::move(next_runs);
+  }
+  return runs;
+}
+
 template<size_t MAX_C, size_t buf_size = 8192, typename Reader = HashReader<buf_size>>
 class HashMerger
 {
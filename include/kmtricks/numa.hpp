@@ -0,0 +1,117 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <spdlog/spdlog.h>
+
+namespace km
+{
+
+// NUMA nodes with the CPUs of each one this process may run on, read from
+// /sys/devices/system/node (a single node when not available, nodes without CPUs are
+// skipped). KMTRICKS_NUMA_NODES=<n> splits the available CPUs into n emulated nodes
+// instead, to exercise the placement on a single-node machine.
+class NumaTopology
+{
+ public:
+  static const NumaTopology& get()
+  {
+    static NumaTopology topology;
+    return topology;
+  }
+
+  size_t nb_nodes() const { return m_cpus.size(); }
+  const std::vector<int>& cpus(size_t node) const { return m_cpus[node]; }
+  bool emulated() const { return m_emulated; }
+
+  // partitions are spread round-robin over the nodes, so that the count and merge tasks
+  // of a partition run on the same node and the merge reads node-local page cache
+  size_t node_of_partition(uint32_t partition) const { return partition % nb_nodes(); }
+
+  // pin the calling thread to the CPUs of a node: with the default (local) memory policy,
+  // the pages it touches first, e.g. the MemAllocator pool of a CountTask, are then
+  // allocated on that node
+  bool pin_thread(size_t node) const
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : m_cpus[node]) CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+  }
+
+  // "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+  static std::vector<int> parse_cpulist(const std::string& list)
+  {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+      if (range.find_first_of("0123456789") == std::string::npos) continue;
+      size_t dash = range.find('-');
+      int first = std::atoi(range.c_str());
+      int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+      for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+  }
+
+ private:
+  NumaTopology()
+  {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    std::vector<int> all;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &allowed)) all.push_back(cpu);
+    }
+
+    const char* emulate = std::getenv("KMTRICKS_NUMA_NODES");
+    if (emulate && !all.empty())
+    {
+      // contiguous CPU ranges, or CPUs shared round-robin when there are more nodes than CPUs
+      size_t n = std::max<size_t>(1, std::strtoul(emulate, nullptr, 10));
+      m_cpus.resize(n);
+      if (n <= all.size())
+        for (size_t i = 0; i < all.size(); i++) m_cpus[i * n / all.size()].push_back(all[i]);
+      else
+        for (size_t i = 0; i < n; i++) m_cpus[i].push_back(all[i % all.size()]);
+      m_emulated = true;
+    }
+    else
+    {
+      std::ifstream online("/sys/devices/system/node/online");
+      std::string nodes;
+      std::getline(online, nodes);
+      for (int node : parse_cpulist(nodes))
+      {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        std::getline(in, list);
+        std::vector<int> cpus;
+        for (int cpu : parse_cpulist(list))
+          if (std::find(all.begin(), all.end(), cpu) != all.end()) cpus.push_back(cpu);
+        if (!cpus.empty()) m_cpus.push_back(std::move(cpus));
+      }
+    }
+    if (m_cpus.empty()) m_cpus.push_back(all);
+
+    spdlog::debug("NUMA: {} node(s){}", m_cpus.size(), m_emulated ? " (emulated)" : "");
+  }
+
+  std::vector<std::vector<int>> m_cpus;
+  bool m_emulated {false};
+};
+
+};
@@ -767,9 +767,12 @@ public:
                 bool lz4,
                 MODE mode,
                 FORMAT format,
-                bool clear = false)
+                bool clear = false,
+                uint32_t fanin = 0,
+                bool sparse = false)
     : ITask(4, clear), m_part_id(partition_id), m_ab_vec(ab_vec), m_kmer_size(kmer_size),
-      m_rec_min(recurrence_min), m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format)
+      m_rec_min(recurrence_min), m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format),
+      m_fanin(fanin), m_sparse(sparse)
   {}
 
   void preprocess() {}
@@ -796,8 +799,33 @@ public:
                                                                      KM_FILE::KMER);
     std::string out_path = KmDir::get().get_matrix_path(m_part_id, m_mode, m_format,
                                                         COUNT_FORMAT::KMER, m_lz4);
-    KmerMerger<span, MAX_C> merger(paths, m_ab_vec, m_kmer_size, m_rec_min, m_save_if);
 
+    if (m_fanin < 2 || paths.size() <= m_fanin)
+    {
+      KmerMerger<span, MAX_C> merger(paths, m_ab_vec, m_kmer_size, m_rec_min, m_save_if);
+      dump(merger, out_path);
+    }
+    else
+    {
+      std::vector<std::string> runs = merge_runs<span, MAX_C>(
+        paths, m_fanin, m_kmer_size, m_lz4,
+        [this](uint32_t level, uint32_t id) {
+          return KmDir::get().get_merge_run_path(m_part_id, level, id, m_lz4);
+        });
+      spdlog::debug("[exec] - KmerMergeTask - P={}, {} runs", m_part_id, runs.size());
+      KmerRunMerger<span, MAX_C> merger(runs, m_ab_vec, m_kmer_size, m_rec_min, m_save_if);
+      dump(merger, out_path);
+      for (auto& f : runs)
+        std::remove(f.c_str());
+    }
+
+    spdlog::debug("[done] - KmerMergeTask - P={}", m_part_id);
+  }
+
+private:
+  template<typename Merger>
+  void dump(Merger& merger, const std::string& out_path)
+  {
 #ifdef WITH_PLUGIN
     IMergePlugin* plugin = nullptr;
 
@@ -816,7 +844,7 @@ public:
       if (m_format == FORMAT::TEXT)
         merger.write_as_text(out_path);
       else if (m_format == FORMAT::BIN)
-        merger.write_as_bin(out_path, m_lz4);
+        merger.write_as_bin(out_path, m_lz4, m_sparse);
     }
     else if (m_mode == MODE::PA)
     {
@@ -838,8 +866,6 @@ public:
 #endif
 
     merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
-
-    spdlog::debug("[done] - KmerMergeTask - P={}", m_part_id);
   }
 
 private:
@@ -851,6 +877,8 @@ private:
   bool m_lz4;
   MODE m_mode;
   FORMAT m_format;
+  uint32_t m_fanin;
+  bool m_sparse;
 };
 
 template<size_t MAX_C>
@@ -19,6 +19,11 @@
 #pragma once
 
 // std
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <future>
 #include <iostream>
@@ -27,27 +32,31 @@
 #include <string>
 #include <thread>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <kmtricks/itask.hpp>
+#include <kmtricks/numa.hpp>
 
 namespace km
 {
-class TaskPool
+// A single priority queue shared by all workers, under one mutex. Superseded by TaskPool,
+// kept as the baseline of task_pool_bench.
+class GlobalQueueTaskPool
 {
   using size_type = std::result_of<decltype (&std::thread::hardware_concurrency)()>::type;
 
  public:
-  TaskPool(size_type threads)
+  GlobalQueueTaskPool(size_type threads)
   {
     if (threads < m_n) m_n = threads;
     for (size_t i = 0; i < m_n; i++)
     {
-      m_pool.push_back(std::thread(&TaskPool::worker, this, i));
+      m_pool.push_back(std::thread(&GlobalQueueTaskPool::worker, this, i));
     }
   }
 
-  ~TaskPool()
+  ~GlobalQueueTaskPool()
   {
     {
       std::unique_lock<std::mutex> lock(m_queue_mutex);
@@ -58,11 +67,11 @@ class TaskPool
       if (t.joinable()) t.join();
   }
 
-  TaskPool() = delete;
-  TaskPool(const TaskPool&) = delete;
-  TaskPool& operator=(const TaskPool&) = delete;
-  TaskPool(TaskPool&&) = delete;
-  TaskPool& operator=(TaskPool&&) = delete;
+  GlobalQueueTaskPool() = delete;
+  GlobalQueueTaskPool(const GlobalQueueTaskPool&) = delete;
+  GlobalQueueTaskPool& operator=(const GlobalQueueTaskPool&) = delete;
+  GlobalQueueTaskPool(GlobalQueueTaskPool&&) = delete;
+  GlobalQueueTaskPool& operator=(GlobalQueueTaskPool&&) = delete;
 
 
   void join_all()
@@ -119,4 +128,234 @@ class TaskPool
   bool m_stop{false};
 };
 
+// Work-stealing pool: each worker owns one deque per priority level and runs its own tasks
+// last in, first out, so that tasks added by a running task (e.g. the count tasks of a
+// SuperKTask callback) stay on the worker that produced their input. Idle workers steal the
+// oldest tasks of the others. The highest level with a queued task is always served first,
+// levels above nb_levels - 1 being merged into the top one. Workers only sleep when nothing
+// is queued; waiting for completion (wait_idle, wait_until) is notified by the workers
+// instead of polled.
+//
+// Given a NUMA topology with several nodes, the workers are pinned to the nodes round-robin,
+// a task with a preferred node (ITask::set_node) is queued on a worker of that node, and
+// idle workers steal from their own node before the others.
+class TaskPool
+{
+  using size_type = std::result_of<decltype (&std::thread::hardware_concurrency)()>::type;
+  static constexpr size_t nb_levels = 8;
+
+ public:
+  TaskPool(size_type threads, const NumaTopology* numa = nullptr)
+  {
+    if (threads < m_n) m_n = threads;
+    if (m_n == 0) m_n = 1;
+    if (numa && numa->nb_nodes() > 1) m_numa = numa;
+    size_t nb_nodes = m_numa ? m_numa->nb_nodes() : 1;
+
+    m_workers = std::vector<Worker>(m_n);
+    m_node_workers.resize(nb_nodes);
+    for (size_t i = 0; i < m_n; i++)
+    {
+      m_workers[i].node = i % nb_nodes;
+      m_node_workers[i % nb_nodes].push_back(i);
+    }
+    // steal order: own deque, then the workers of the same node, then the others
+    for (size_t i = 0; i < m_n; i++)
+    {
+      for (size_t j = 0; j < m_n; j++)
+        if (m_workers[(i + j) % m_n].node == m_workers[i].node) m_workers[i].victims.push_back((i + j) % m_n);
+      for (size_t j = 0; j < m_n; j++)
+        if (m_workers[(i + j) % m_n].node != m_workers[i].node) m_workers[i].victims.push_back((i + j) % m_n);
+    }
+
+    for (size_t i = 0; i < m_n; i++)
+    {
+      m_pool.push_back(std::thread(&TaskPool::worker, this, i));
+    }
+  }
+
+  ~TaskPool()
+  {
+    stop();
+    for (std::thread& t : m_pool)
+      if (t.joinable()) t.join();
+  }
+
+  TaskPool() = delete;
+  TaskPool(const TaskPool&) = delete;
+  TaskPool& operator=(const TaskPool&) = delete;
+  TaskPool(TaskPool&&) = delete;
+  TaskPool& operator=(TaskPool&&) = delete;
+
+  // wait for all the tasks, including those added by running tasks, then stop the workers
+  void join_all()
+  {
+    wait_idle();
+    stop();
+    for (std::thread& t : m_pool)
+      if (t.joinable()) t.join();
+  }
+
+  void join(int i)
+  {
+    if (m_pool[i].joinable()) m_pool[i].join();
+  }
+
+  void add_task(task_t task)
+  {
+    task->in();
+    size_t level = std::min<size_t>(task->level(), nb_levels - 1);
+    // from a worker of this pool: its own deque, otherwise spread over the workers (of the
+    // preferred node if any)
+    size_t i = target_worker(task->node());
+    m_active.fetch_add(1);
+    {
+      std::lock_guard<std::mutex> lock(m_workers[i].mutex);
+      m_workers[i].queues[level].push_back(std::move(task));
+    }
+    m_queued[level].fetch_add(1);
+    m_nb_queued.fetch_add(1);
+    if (m_sleeping.load() > 0)
+    {
+      { std::lock_guard<std::mutex> lock(m_idle_mutex); }
+      m_wake.notify_one();
+    }
+  }
+
+  // block until every added task has completed, woken by the last one only
+  void wait_idle()
+  {
+    std::unique_lock<std::mutex> lock(m_done_mutex);
+    m_done.wait(lock, [this] { return m_active.load() == 0; });
+  }
+
+  // block until pred() holds, pred being checked again after each task completion
+  template<typename Pred>
+  void wait_until(Pred pred)
+  {
+    std::unique_lock<std::mutex> lock(m_done_mutex);
+    m_waiting.fetch_add(1);
+    m_done.wait(lock, pred);
+    m_waiting.fetch_sub(1);
+  }
+
+ private:
+  struct alignas(64) Worker
+  {
+    std::mutex mutex;
+    std::array<std::deque<task_t>, nb_levels> queues;
+    size_t node {0};
+    std::vector<size_t> victims;
+  };
+
+  size_t target_worker(int node)
+  {
+    if (m_numa && node >= 0)
+    {
+      size_t n = static_cast<size_t>(node) % m_node_workers.size();
+      if (t_pool == this && m_workers[t_worker].node == n) return t_worker;
+      const auto& workers = m_node_workers[n];
+      if (!workers.empty())
+        return workers[m_next.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+    }
+    if (t_pool == this) return t_worker;
+    return m_next.fetch_add(1, std::memory_order_relaxed) % m_n;
+  }
+
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_idle_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_all();
+  }
+
+  // a queued task of the highest level, own tasks first, nullptr when none is queued
+  task_t next_task(size_t i)
+  {
+    for (size_t level = nb_levels; level-- > 0;)
+    {
+      if (m_queued[level].load() == 0) continue;
+      for (size_t j = 0; j < m_n; j++)
+      {
+        Worker& w = m_workers[m_workers[i].victims[j]];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        auto& queue = w.queues[level];
+        if (queue.empty()) continue;
+        task_t task;
+        if (j == 0) { task = std::move(queue.back()); queue.pop_back(); }
+        else { task = std::move(queue.front()); queue.pop_front(); }
+        m_queued[level].fetch_sub(1);
+        m_nb_queued.fetch_sub(1);
+        return task;
+      }
+    }
+    return nullptr;
+  }
+
+  void worker(size_t i)
+  {
+    t_pool = this;
+    t_worker = i;
+    if (m_numa && !m_numa->pin_thread(m_workers[i].node))
+      spdlog::warn("cannot pin worker {} to NUMA node {}", i, m_workers[i].node);
+    while (true)
+    {
+      task_t task = next_task(i);
+      // tasks are often added in bursts, let their producer run before going to sleep
+      for (size_t spin = 0; !task && spin < 64; spin++)
+      {
+        std::this_thread::yield();
+        task = next_task(i);
+      }
+      if (!task)
+      {
+        std::unique_lock<std::mutex> lock(m_idle_mutex);
+        m_sleeping.fetch_add(1);
+        m_wake.wait(lock, [this] { return m_stop || m_nb_queued.load() > 0; });
+        m_sleeping.fetch_sub(1);
+        if (m_stop && m_nb_queued.load() == 0) return;
+        continue;
+      }
+      task->preprocess();
+      task->exec();
+      task->postprocess();
+      task->out();
+      task.reset();
+
+      // the tasks added by this one were counted before, m_active only reaches 0 at the end
+      bool last = m_active.fetch_sub(1) == 1;
+      if (last || m_waiting.load() > 0)
+      {
+        { std::lock_guard<std::mutex> lock(m_done_mutex); }
+        m_done.notify_all();
+      }
+    }
+  }
+
+ private:
+  size_type m_n{std::thread::hardware_concurrency()};
+  std::vector<std::thread> m_pool;
+  std::vector<Worker> m_workers;
+  const NumaTopology* m_numa {nullptr};
+  std::vector<std::vector<size_t>> m_node_workers; // workers of each node
+  std::array<std::atomic<size_t>, nb_levels> m_queued{};
+  std::atomic<size_t> m_nb_queued{0};
+  std::atomic<size_t> m_active{0}; // added and not completed
+  std::atomic<size_t> m_next{0};
+
+  std::mutex m_idle_mutex;
+  std::condition_variable m_wake;
+  std::atomic<size_t> m_sleeping{0};
+  bool m_stop{false};
+
+  std::mutex m_done_mutex;
+  std::condition_variable m_done;
+  std::atomic<size_t> m_waiting{0}; // in wait_until
+
+  static inline thread_local TaskPool* t_pool{nullptr};
+  static inline thread_local size_t t_worker{0};
 };
+
+};
\ No newline at end of file
@@ -43,6 +43,14 @@ public:
   {
     if (spdlog::get_level() == spdlog::level::info)
       m_is_info = true;
+    if (m_opt->numa)
+    {
+      m_numa = &NumaTopology::get();
+      spdlog::info("NUMA placement: {} node(s){}", m_numa->nb_nodes(), m_numa->emulated() ? " (emulated)" : "");
+    }
+    AsyncIO::get().set(str_to_io_engine(m_opt->io_engine));
+    if (AsyncIO::get().engine() != IO_ENGINE::FSTREAM)
+      spdlog::info("I/O engine: {} ({} KiB blocks)", io_engine_to_str(AsyncIO::get().engine()), AsyncIO::get().block_size() >> 10);
     m_dyn.set_option(option::HideBarWhenComplete{false});
     init_progress();
   }
@@ -159,7 +167,7 @@ public:
       m_dyn.push_back(std::move(m_progress[2])); m_dyn[0].set_progress(0);
     }
 
-    TaskPool pool(m_opt->nb_threads);
+    TaskPool pool(m_opt->nb_threads, m_numa);
 
     for (auto id : KmDir::get().m_fof)
     {
@@ -179,7 +187,7 @@ public:
   {
     if (m_is_info) { m_dyn.push_back(std::move(m_progress[3])); m_dyn[1].set_progress(0); }
 
-    TaskPool pool(m_opt->nb_threads);
+    TaskPool pool(m_opt->nb_threads, m_numa);
 
     for (auto id : KmDir::get().m_fof)
     {
@@ -237,6 +245,7 @@ public:
           }
         }
         if (m_is_info) task->set_callback([this](){ this->m_dyn[1].tick(); });
+        place(task, p);
 
         pool.add_task(task);
       }
@@ -259,7 +268,7 @@ public:
       m_dyn.push_back(std::move(m_progress[2])); m_dyn[0].set_progress(0);
       m_dyn.push_back(std::move(m_progress[3])); m_dyn[1].set_progress(0);
     }
-    TaskPool pool(m_opt->nb_threads);
+    TaskPool pool(m_opt->nb_threads, m_numa);
 
     int max_running = std::floor(m_opt->nb_threads * m_opt->focus) > 0 ? m_opt->nb_threads * m_opt->focus : 1;
 
@@ -330,28 +339,23 @@ public:
             ProgressBar* ptr = &this->m_dyn[1];
             task->set_callback([ptr](){ ptr->tick(); });
           }
+          this->place(task, p);
           pool.add_task(task);
         }
       });
 
-      while (superk_in() >= max_running)
+      if (superk_in() >= max_running && max_running == m_opt->nb_threads)
       {
-        if (max_running == m_opt->nb_threads)
-        {
-          max_running /= 2;
-          if (!(max_running > 0)) max_running = 1;
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        max_running /= 2;
+        if (!(max_running > 0)) max_running = 1;
       }
+      pool.wait_until([this, max_running] { return this->superk_in() < max_running; });
       task->set_level(5);
       m_superk.push_back(task);
       spdlog::debug("[push] - SuperKTask - S={}", std::get<0>(id));
       pool.add_task(task);
     }
-    while (superk_finish() != m_nb_samples)
-    {
-      std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    }
+    // join_all waits for the count tasks added by the SuperKTask callbacks
     pool.join_all();
 
     if (m_opt->hist)
@@ -385,6 +389,12 @@ public:
   }
 
 
+  // prefer the NUMA node of the partition, with --numa
+  void place(task_t& task, uint32_t partition)
+  {
+    if (m_numa) task->set_node(m_numa->node_of_partition(partition));
+  }
+
   int superk_in()
   {
     int count = 0;
@@ -404,7 +414,7 @@ public:
       m_dyn.push_back(std::move(m_progress[3])); m_dyn[1].set_progress(0);
     }
 
-    TaskPool pool(m_opt->nb_threads);
+    TaskPool pool(m_opt->nb_threads, m_numa);
     
     auto nb_partitions = m_config._nb_partitions;
     Repartition repart(km::KmDir::get().m_repart_storage + "_gatb/repartition.minimRepart");
@@ -441,29 +451,23 @@ public:
             ProgressBar* ptr = &this->m_dyn[1];
             task->set_callback([ptr](){ ptr->tick(); });
           }
+          this->place(task, part_id);
           pool.add_task(task);
         }
       });
 
-      while (superk_in() >= max_running)
+      if (superk_in() >= max_running && max_running == m_opt->nb_threads)
       {
-        if (max_running == m_opt->nb_threads)
-        {
-          max_running /= 2;
-          if (!(max_running > 0)) max_running = 1;
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        max_running /= 2;
+        if (!(max_running > 0)) max_running = 1;
       }
-      
+      pool.wait_until([this, max_running] { return this->superk_in() < max_running; });
       task->set_level(5);
       m_superk.push_back(task);
       spdlog::debug("[push] - LoganRepartTask - S={}", sid);
       pool.add_task(task);
     }
 
-    while (superk_finish() != m_nb_samples) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    }
     pool.join_all();
 
     if (m_is_info) { m_dyn[0].mark_as_completed(); }
@@ -481,7 +485,15 @@ public:
       m_opt->m_ab_min_vec = compute_merge_thresholds(m_hists, m_opt->m_ab_min_f,
                                                      KmDir::get().get_merge_th_path());
     }
-    TaskPool pool(m_opt->nb_threads);
+    uint32_t fanin = m_opt->merge_fanin;
+    if (fanin == 0)
+    {
+      fanin = get_merge_fanin(m_opt->nb_threads, m_opt->max_memory, merge_stream_bytes(m_opt->lz4));
+    }
+    if (m_nb_samples > fanin)
+      spdlog::info("Hierarchical merge: {} samples, fan-in {}", m_nb_samples, fanin);
+
+    TaskPool pool(m_opt->nb_threads, m_numa);
     for (auto& p : m_opt->restrict_to_list)
     {
       task_t task = nullptr;
@@ -490,7 +502,7 @@ public:
         spdlog::debug("[push] - KmerMergeTask - P={}", p);
         task = std::make_shared<KmerMergeTask<MAX_K, MAX_C>>(
           p, m_opt->m_ab_min_vec, m_config._kmerSize, m_opt->r_min, m_opt->save_if,
-          m_opt->lz4, m_opt->mode, m_opt->format, !m_opt->keep_tmp);
+          m_opt->lz4, m_opt->mode, m_opt->format, !m_opt->keep_tmp, fanin, m_opt->sparse);
       }
       else if (m_opt->count_format == COUNT_FORMAT::HASH)
       {
@@ -500,6 +512,7 @@ public:
           m_opt->format, m_hw, !m_opt->keep_tmp, m_opt->bwidth);
       }
       if (m_is_info) task->set_callback([this](){ this->m_dyn[2].tick(); });
+      place(task, p);
       pool.add_task(task);
     }
     pool.join_all();
@@ -509,7 +522,7 @@ public:
 
   void exec_format()
   {
-    TaskPool pool(m_opt->nb_threads);
+    TaskPool pool(m_opt->nb_threads, m_numa);
     if (m_is_info)
     {
       m_dyn.push_back(std::move(m_progress[5]));
@@ -571,25 +584,33 @@ public:
     }
   }
 
+  void run_step(const std::string& name, const std::function<void()>& step)
+  {
+    if (m_opt->step_runner)
+      m_opt->step_runner(name, step);
+    else
+      step();
+  }
+
   void execute()
   {
     Timer whole_time;
 
-    exec_config();
-    exec_repart();
+    run_step("config", [this]() { exec_config(); });
+    run_step("repart", [this]() { exec_repart(); });
 
     if (m_opt->until == COMMAND::REPART)
       goto end;
 
     if (!m_opt->logan && m_opt->until == COMMAND::SUPERK) {
-      exec_superk();
+      run_step("superk", [this]() { exec_superk(); });
       goto end;
     }
 
     if (m_opt->logan) {
-      exec_logan_count();
+      run_step("count", [this]() { exec_logan_count(); });
     } else {
-      exec_superk_count();
+      run_step("count", [this]() { exec_superk_count(); });
     }
 
     if (m_opt->until == COMMAND::COUNT)
@@ -597,14 +618,14 @@ public:
 
     if (!m_opt->skip_merge && !m_opt->kff)
     {
-      exec_merge();
+      run_step("merge", [this]() { exec_merge(); });
 
       if (m_opt->until == COMMAND::MERGE)
         goto end;
     }
 
     if (m_opt->mode == MODE::BFT)
-      exec_format();
+      run_step("format", [this]() { exec_format(); });
 
     end:
       // spdlog::info("Done in {} - Peak RSS -> {:.2f} MB.",
@@ -627,6 +648,7 @@ public:
   std::vector<task_t> m_counts;
   std::vector<hist_t> m_hists;
   TaskPool* m_pool {nullptr};
+  const NumaTopology* m_numa {nullptr};
   std::condition_variable m_cv;
   size_t m_nb_samples;
   HashWindow m_hw;
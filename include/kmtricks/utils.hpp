@@ -17,6 +17,7 @@
  *****************************************************************************/
 
 #pragma once
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <random>
@@ -236,6 +237,20 @@ inline std::tuple<int64_t, int64_t> get_prlimit_nofile()
   return std::make_tuple(rlim.rlim_cur, rlim.rlim_max);
 }
 
+// Number of streams a single merge task can open at once, bounded by the soft limit on open
+// files and by a memory budget (in MB), both shared between nb_tasks concurrent tasks.
+inline uint32_t get_merge_fanin(size_t nb_tasks, size_t max_memory, size_t stream_bytes)
+{
+  const int64_t reserved_fds = 64;
+  int64_t soft = std::get<0>(get_prlimit_nofile());
+  nb_tasks = std::max<size_t>(nb_tasks, 1);
+
+  int64_t by_fd = (soft - reserved_fds) / static_cast<int64_t>(nb_tasks);
+  int64_t by_mem = static_cast<int64_t>((max_memory << 20) / nb_tasks / stream_bytes);
+
+  return static_cast<uint32_t>(std::max<int64_t>(std::min(by_fd, by_mem), 2));
+}
+
 inline double bloom_fp(size_t m, size_t n, size_t k = 1)
 {
   static double e = std::exp(1.0);
@@ -26,6 +26,7 @@ kmatCli::kmatCli(
     merge_opt = std::make_shared<struct merge_options>();
     reverse_opt = std::make_shared<struct reverse_options>();
     select_opt = std::make_shared<struct select_options>();
+    sort_opt = std::make_shared<struct sort_options>();
     unitig_opt = std::make_shared<struct unitig_options>();
 
     convert_cli(cli, convert_opt);
@@ -35,6 +36,8 @@ kmatCli::kmatCli(
     filter_cli(cli, filter_opt);
     merge_cli(cli, merge_opt);
     reverse_cli(cli, reverse_opt);
+    select_cli(cli, select_opt);
+    sort_cli(cli, sort_opt);
     unitig_cli(cli, unitig_opt);
 }
 
@@ -95,6 +98,10 @@ std::tuple<COMMAND, kmat_opt_t> kmatCli::parse(int argc, char* argv[])
         this->select_opt->inputs = cli->get_positionals();
         return std::make_tuple(COMMAND::SELECT, this->select_opt);
     }
+    else if (cli->is("sort")) {
+        this->sort_opt->inputs = cli->get_positionals();
+        return std::make_tuple(COMMAND::SORT, this->sort_opt);
+    }
     else if (cli->is("unitig")) {
         this->unitig_opt->inputs = cli->get_positionals();
         return std::make_tuple(COMMAND::UNITIG, this->unitig_opt);
@@ -132,10 +139,22 @@ kmat_opt_t convert_cli(std::shared_ptr<bc::Parser<1>> cli, convert_opt_t opt)
         ->as_flag()
         ->setter(opt->out_csv);
 
+    convert->add_param("--output-format", "txt (dense rows), coo (one 'unitig color value' line per non-zero entry), csr (binary rows with a .idx index, requires -o) or bit (bit-packed rows plus a color-major .T copy, requires -o and -p).")
+        ->meta("STRING")
+        ->def("txt")
+        ->checker(bc::check::f::in("txt|coo|csr|bit"))
+        ->setter(opt->output_format);
+
     convert->add_param("-o/--output", "output file. {stdout}")
          ->meta("FILE")
          ->def("")
          ->setter(opt->out_fname);
+
+    convert->add_param("-t/--threads", "number of threads.")
+        ->meta("INT")
+        ->def("4")
+        ->checker(bc::check::is_number)
+        ->setter(opt->nb_threads);
     
     convert->add_param("-h/--help", "show this message and exit.")
          ->as_flag()
@@ -166,6 +185,17 @@ kmat_opt_t diff_cli(std::shared_ptr<bc::Parser<1>> cli, diff_opt_t opt)
          ->as_flag()
          ->setter(opt->actg_order);
 
+    diff->add_param("-t/--threads", "number of threads, each one processing a k-mer range of the inputs.")
+         ->meta("INT")
+         ->def("1")
+         ->checker(bc::check::is_number)
+         ->setter(opt->nb_threads);
+
+    diff->add_param("--tmp-dir", "directory for key-range parts. {output directory}")
+         ->meta("DIR")
+         ->def("")
+         ->setter(opt->tmp_dir);
+
     diff->add_param("-h/--help", "show this message and exit.")
          ->as_flag()
          ->action(bc::Action::ShowHelp);
@@ -286,6 +316,12 @@ kmat_opt_t filter_cli(std::shared_ptr<bc::Parser<1>> cli, filter_opt_t opt)
         ->as_flag()
         ->setter(opt->keep_tmp);
 
+    filter->add_param("-w/--count-width", "bits per count for text matrices, larger counts saturate: 8, 16 or 32.")
+        ->meta("INT")
+        ->def("32")
+        ->checker(bc::check::f::in("8|16|32"))
+        ->setter(opt->count_width);
+
     filter->add_param("-t/--threads", "number of threads.")
         ->meta("INT")
         ->def("4")
@@ -308,7 +344,7 @@ kmat_opt_t filter_cli(std::shared_ptr<bc::Parser<1>> cli, filter_opt_t opt)
 
 kmat_opt_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_opt_t opt)
 {
-    bc::cmd_t merge = cli->add_command("merge", "Merge two input text-based kmer-sorted matrices.");
+    bc::cmd_t merge = cli->add_command("merge", "Merge text-based kmer-sorted matrices.");
 
     merge->add_param("-k/--kmer-size", "k-mer size")
          ->meta("INT")
@@ -324,6 +360,28 @@ kmat_opt_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_opt_t opt)
          ->as_flag()
          ->setter(opt->actg_order);
 
+    merge->add_param("-l/--list", "file listing more matrices to merge after <matrix_1> <matrix_2>, one path per line.")
+         ->meta("FILE")
+         ->def("")
+         ->setter(opt->input_list);
+
+    merge->add_param("-F/--fanin", "maximum number of matrices merged in one pass, larger merges go through intermediate runs.")
+         ->meta("INT")
+         ->def("64")
+         ->checker(bc::check::f::range(2, 4096))
+         ->setter(opt->fanin);
+
+    merge->add_param("--tmp-dir", "directory for intermediate runs and key-range parts. {output directory}")
+         ->meta("DIR")
+         ->def("")
+         ->setter(opt->tmp_dir);
+
+    merge->add_param("-t/--threads", "number of threads, each one merging a k-mer range of the inputs.")
+         ->meta("INT")
+         ->def("1")
+         ->checker(bc::check::is_number)
+         ->setter(opt->nb_threads);
+
     merge->add_param("-h/--help", "show this message and exit.")
          ->as_flag()
          ->action(bc::Action::ShowHelp);
@@ -332,7 +390,7 @@ kmat_opt_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_opt_t opt)
          ->as_flag()
          ->action(bc::Action::ShowVersion);
 
-    merge->set_positionals(2, "<matrix_1> <matrix_2>", "Two text-based k-mer matrices");
+    merge->set_positionals(2, "<matrix_1> <matrix_2>", "Two text-based k-mer matrices (more with -l)");
 
     return opt;
 }
@@ -382,6 +440,17 @@ kmat_opt_t select_cli(std::shared_ptr<bc::Parser<1>> cli, select_opt_t opt)
          ->as_flag()
          ->setter(opt->actg_order);
 
+    select->add_param("-t/--threads", "number of threads, each one processing a k-mer range of the inputs.")
+         ->meta("INT")
+         ->def("1")
+         ->checker(bc::check::is_number)
+         ->setter(opt->nb_threads);
+
+    select->add_param("--tmp-dir", "directory for key-range parts. {output directory}")
+         ->meta("DIR")
+         ->def("")
+         ->setter(opt->tmp_dir);
+
     select->add_param("-h/--help", "show this message and exit.")
          ->as_flag()
          ->action(bc::Action::ShowHelp);
@@ -395,4 +464,62 @@ kmat_opt_t select_cli(std::shared_ptr<bc::Parser<1>> cli, select_opt_t opt)
     return opt;
 }
 
+
+kmat_opt_t sort_cli(std::shared_ptr<bc::Parser<1>> cli, sort_opt_t opt)
+{
+    bc::cmd_t sort = cli->add_command("sort", "Sort a text-based k-mer matrix by k-mer, in memory or through sorted runs on disk.");
+
+    sort->add_param("-o/--output", "output file. {stdout}")
+         ->meta("FILE")
+         ->def("")
+         ->setter(opt->output);
+
+    sort->add_param("-z/--actg", "use A<C<T<G order of nucleotides")
+         ->as_flag()
+         ->setter(opt->actg_order);
+
+    sort->add_param("-c/--canonical", "replace k-mers by their canonical form before sorting.")
+         ->as_flag()
+         ->setter(opt->canonicalize);
+
+    sort->add_param("-d/--sum-duplicates", "output each k-mer once, summing the counts of its lines.")
+         ->as_flag()
+         ->setter(opt->sum_duplicates);
+
+    sort->add_param("-m/--max-memory", "memory budget for the in-memory chunks, in MB.")
+         ->meta("INT")
+         ->def("2048")
+         ->checker(bc::check::is_number)
+         ->setter(opt->max_memory);
+
+    sort->add_param("-t/--threads", "number of threads sorting chunks and merging runs.")
+         ->meta("INT")
+         ->def("1")
+         ->checker(bc::check::is_number)
+         ->setter(opt->nb_threads);
+
+    sort->add_param("-F/--fanin", "maximum number of runs merged in one pass.")
+         ->meta("INT")
+         ->def("64")
+         ->checker(bc::check::f::range(2, 4096))
+         ->setter(opt->fanin);
+
+    sort->add_param("--tmp-dir", "directory for sorted runs. {output directory}")
+         ->meta("DIR")
+         ->def("")
+         ->setter(opt->tmp_dir);
+
+    sort->add_param("-h/--help", "show this message and exit.")
+         ->as_flag()
+         ->action(bc::Action::ShowHelp);
+
+    sort->add_param("-v/--version", "show version and exit.")
+         ->as_flag()
+         ->action(bc::Action::ShowVersion);
+
+    sort->set_positionals(1, "<input.mat>", "Text-based k-mer matrix");
+
+    return opt;
+}
+
 };
\ No newline at end of file
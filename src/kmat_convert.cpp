@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <string>
@@ -16,10 +19,148 @@
 
 #include <kmat_tools/cli/cli_common.h>
 #include <kmat_tools/cli/convert.h>
+#include <kmat_tools/csr.h>
+#include <kmat_tools/ggcat.h>
+#include <kmat_tools/pa_matrix.h>
 
 
 namespace kmat {
 
+// A block of query lines, each paired with the identifier (or sequence) of its unitig
+struct convert_chunk
+{
+    std::vector<std::string> lines;
+    std::vector<std::string> ids;
+    size_t nb_lines{0};
+    fmt::memory_buffer out;
+
+    // csr/bit only: offset of each row within out, and number of stored entries
+    std::vector<uint64_t> row_offsets;
+    uint64_t nnz{0};
+};
+
+// Input bytes / lines per chunk, bounding the memory held by the chunks in flight
+constexpr size_t convert_chunk_bytes = 4 << 20;
+constexpr size_t convert_chunk_lines = 4096;
+
+static void format_chunk(convert_chunk& chunk, const convert_opt_t& opt, size_t num_colors, const std::string& separator, const GgcatColorSubsets& subsets)
+{
+    using json = nlohmann::json;
+
+    // Dense values of the current line, and the colors set on it, so that sparse outputs
+    // and resets do not have to scan every color
+    std::vector<float> presence_values(num_colors, 0);
+    std::vector<uint32_t> colors;
+    std::vector<float> values;
+    std::vector<uint64_t> words(pa_row_bytes(num_colors) / sizeof(uint64_t));
+    auto set_value = [&](uint64_t index, float curr_value) {
+        if (index < presence_values.size()) {
+            if (presence_values[index] == 0) {
+                colors.push_back(index);
+            }
+            if (opt->ap_flag) {
+                presence_values[index] = (curr_value > 0 && curr_value >= opt->min_frac);
+            } else {
+                presence_values[index] = curr_value;
+            }
+        }
+    };
+    auto reset = [&]() {
+        for (auto c : colors) {
+            presence_values[c] = 0;
+        }
+        colors.clear();
+    };
+
+    // Annotation mode: k-mers of the unitig per color, and the colors seen
+    std::vector<uint64_t> kmer_counts(subsets.empty() ? 0 : num_colors, 0);
+    std::vector<uint32_t> annotated_colors;
+
+    chunk.row_offsets.clear();
+    chunk.nnz = 0;
+    for (size_t l = 0; l < chunk.nb_lines; l++) {
+        const std::string& line = chunk.lines[l];
+
+        if (opt->from_annotations) {
+            // The query is the unitig itself, so the fraction of a color is the share of the
+            // unitig k-mers whose subset contains it
+            uint64_t total = 0;
+            auto on_run = [&](uint64_t subset, uint64_t count) {
+                for (auto c : subsets.colors(subset)) {
+                    if (c < num_colors) {
+                        if (kmer_counts[c] == 0) { annotated_colors.push_back(c); }
+                        kmer_counts[c] += count;
+                    }
+                }
+                total += count;
+            };
+            if (scan_ggcat_color_annotations(line, on_run) == 0 || total == 0) {
+                throw std::runtime_error(fmt::format("unitig \"{}\" has no color annotation", chunk.ids[l]));
+            }
+            for (auto c : annotated_colors) {
+                set_value(c, static_cast<float>(static_cast<double>(kmer_counts[c]) / total));
+                kmer_counts[c] = 0;
+            }
+            annotated_colors.clear();
+        } else if (!scan_ggcat_query_line(line, set_value)) {
+            // Not the usual ggcat layout, fall back to full JSON parsing
+            reset();
+            try {
+                json jsonObj = json::parse(line);
+
+                // Check if the key "matches" exists and is an object
+                if (jsonObj.contains("matches") && jsonObj["matches"].is_object()) {
+                    for (auto& [key, value] : jsonObj["matches"].items()) {
+                        if (!key.empty() && value.is_number()) {  // Check if key is not empty and value is a number
+                            set_value(std::stoull(key), value.get<float>());
+                        }
+                    }
+                }
+            } catch (json::parse_error& e) {
+                throw std::runtime_error(fmt::format("error reading ggcat files, check that the format is correct: {}", e.what()));
+            }
+        }
+
+        const std::string& id = chunk.ids[l];
+        if (opt->output_format == "txt") {
+            chunk.out.append(id.data(), id.data() + id.size());
+            for (size_t i=0; i < presence_values.size(); i++) {
+                chunk.out.append(separator.data(), separator.data() + separator.size());
+                append_value(chunk.out, presence_values[i]);
+            }
+            chunk.out.push_back('\n');
+        } else {
+            // Sparse outputs: non-zero entries by increasing color
+            std::sort(colors.begin(), colors.end());
+            colors.erase(std::unique(colors.begin(), colors.end()), colors.end());
+            colors.erase(std::remove_if(colors.begin(), colors.end(), [&](uint32_t c) { return presence_values[c] == 0; }), colors.end());
+
+            if (opt->output_format == "coo") {
+                for (auto c : colors) {
+                    chunk.out.append(id.data(), id.data() + id.size());
+                    chunk.out.append(separator.data(), separator.data() + separator.size());
+                    fmt::format_to(std::back_inserter(chunk.out), "{}", c);
+                    chunk.out.append(separator.data(), separator.data() + separator.size());
+                    append_value(chunk.out, presence_values[c]);
+                    chunk.out.push_back('\n');
+                }
+            } else if (opt->output_format == "csr") {
+                values.clear();
+                for (auto c : colors) {
+                    values.push_back(presence_values[c]);
+                }
+                chunk.row_offsets.push_back(chunk.out.size());
+                append_csr_row(chunk.out, colors, values, opt->ap_flag);
+            } else { // bit
+                chunk.row_offsets.push_back(chunk.out.size());
+                append_pa_row(chunk.out, words, colors);
+            }
+            chunk.nnz += colors.size();
+        }
+        reset();
+    }
+}
+
 int main_convert(convert_opt_t opt)
 {
     namespace fs = std::filesystem;
@@ -40,14 +181,15 @@ int main_convert(convert_opt_t opt)
         throw std::runtime_error(fmt::format("color dump file \"{}\" does not exist", color_dump_Filename));
     }
 
-    std::string color_query_Filename = opt->inputs[2];
-    if(!fs::is_regular_file(color_query_Filename)) {
+    std::string color_query_Filename = opt->from_annotations ? "" : opt->inputs[2];
+    if(!opt->from_annotations && !fs::is_regular_file(color_query_Filename)) {
         throw std::runtime_error(fmt::format("query output file \"{}\" does not exist", color_query_Filename));
     }
 
     spdlog::info("reading color names");
     
     std::vector<std::string> color_names;  // Vector to store the values of "x"
+    GgcatColorSubsets subsets;
     std::string line;
     color_names.push_back("UnitigID");
     
@@ -62,6 +204,8 @@ int main_convert(convert_opt_t opt)
             if (jsonObj.contains("color_name")) {
                 // Extract the value of "x" and store it in the vector
                 color_names.push_back(jsonObj["color_name"].get<std::string>());
+            } else if (opt->from_annotations && jsonObj.contains("subset_index") && jsonObj.contains("colors")) {
+                subsets.add(jsonObj["subset_index"].get<uint64_t>(), jsonObj["colors"].get<std::vector<uint32_t>>());
             }
         } catch (json::parse_error& e) {
             spdlog::error("Cannot find field color_index in a line of the color dump file.");
@@ -71,15 +215,27 @@ int main_convert(convert_opt_t opt)
     }
     colorDumpFile.close();
 
+    if (opt->from_annotations && subsets.empty()) {
+        throw std::runtime_error(fmt::format("color dump file \"{}\" does not list the color subsets", color_dump_Filename));
+    }
+
     spdlog::info("building unitig matrix");
 
     uint64_t num_colors {color_names.size()-1};
-    std::vector<float> presence_values(num_colors, 0);  // Vector to store the values of "x"
+
+    const bool csr = opt->output_format == "csr";
+    const bool bit = opt->output_format == "bit";
+    if ((csr || bit) && (opt->out_fname).empty()) {
+        throw std::runtime_error(fmt::format("{} output requires an output file (-o)", opt->output_format));
+    }
+    if (bit && !opt->ap_flag) {
+        throw std::runtime_error("bit output requires a presence-absence matrix (-p)");
+    }
 
     std::ostream* fpout = &std::cout;
     std::ofstream ofs;
     if(!(opt->out_fname).empty()) {
-        ofs.open((opt->out_fname).c_str());
+        ofs.open((opt->out_fname).c_str(), (csr || bit) ? std::ios::binary : std::ios::out);
         if(!ofs.good()) {
             spdlog::error(fmt::format("cannot open output file \"{}\"", opt->out_fname));
             std::exit(EXIT_FAILURE);
@@ -90,7 +246,36 @@ int main_convert(convert_opt_t opt)
     //*fpout << std::fixed << std::setprecision(2);
     std::string separator{opt->out_csv ? "," : " "};
 
-    if (!opt->no_header){
+    // csr/bit: the header is rewritten with the final counts, rows are listed in the index
+    CsrMatrixHeader csr_header;
+    PaMatrixHeader pa_header;
+    std::ofstream row_index;
+    uint64_t row_offset = 0;
+    uint64_t nb_rows = 0;
+    uint64_t nnz = 0;
+    if (csr || bit) {
+        if (csr) {
+            csr_header.nb_colors = num_colors;
+            csr_header.flags = opt->ap_flag ? CSR_PRESENCE_ABSENCE : 0;
+            ofs.write(reinterpret_cast<const char*>(&csr_header), sizeof(csr_header));
+            row_offset = sizeof(csr_header);
+        } else {
+            pa_header.nb_cols = num_colors;
+            pa_header.row_bytes = pa_row_bytes(num_colors);
+            ofs.write(reinterpret_cast<const char*>(&pa_header), sizeof(pa_header));
+            row_offset = sizeof(pa_header);
+        }
+
+        std::string index_path = csr_index_path(opt->out_fname);
+        row_index.open(index_path);
+        if (!row_index.good()) {
+            throw std::runtime_error(fmt::format("cannot open output file \"{}\"", index_path));
+        }
+    } else if (opt->output_format == "coo") {
+        if (!opt->no_header) {
+            *fpout << color_names[0] << separator << "ColorIndex" << separator << "Value\n";
+        }
+    } else if (!opt->no_header){
         *fpout << color_names[0];
         for (size_t i = 1; i < color_names.size(); i++) {
             *fpout << separator << color_names[i];
@@ -98,57 +283,105 @@ int main_convert(convert_opt_t opt)
         *fpout << "\n";
     }
 
-    int line_counter{0};
-    float curr_value;
-    std::ifstream colorQueryFile(color_query_Filename);
+    // Chunks are read on this thread, formatted by workers, and written back in input order.
+    // Each query line is paired with the next unitig record (or, with annotations, each
+    // unitig is read alone and its header carries the colors).
+    const size_t nb_slots = opt->nb_threads > 1 ? 2 * opt->nb_threads : 1;
+    std::vector<convert_chunk> chunks(nb_slots);
+    std::vector<std::future<void>> pending(nb_slots);
+
+    auto flush_slot = [&](size_t slot) {
+        if (pending[slot].valid()) {
+            pending[slot].get();
+        }
+        convert_chunk& chunk = chunks[slot];
+        if (csr || bit) {
+            fmt::memory_buffer index;
+            for (size_t l = 0; l < chunk.row_offsets.size(); l++) {
+                fmt::format_to(std::back_inserter(index), "{} {}\n", chunk.ids[l], row_offset + chunk.row_offsets[l]);
+            }
+            row_index.write(index.data(), index.size());
+            row_offset += chunk.out.size();
+            nb_rows += chunk.row_offsets.size();
+            nnz += chunk.nnz;
+            chunk.row_offsets.clear();
+            chunk.nnz = 0;
+        }
+        fpout->write(chunk.out.data(), chunk.out.size());
+        chunk.out.clear();
+    };
+
+    std::ifstream colorQueryFile;
+    if (!opt->from_annotations) {
+        colorQueryFile.open(color_query_Filename);
+    }
 
     klibpp::KSeq unitig;
     klibpp::SeqStreamIn utg_ssi(unitigs_filename.c_str());
-    while (std::getline(colorQueryFile, line)) {
-        try {
-            // Parse the line as a JSON object
-            json jsonObj = json::parse(line);
+    for (size_t slot = 0; ; slot = (slot + 1) % nb_slots) {
+        flush_slot(slot);
 
-            std::fill(presence_values.begin(), presence_values.end(), 0);  // Vector to store the values of "x"
-            // Check if the key "x" exists and is an object
-            if (jsonObj.contains("matches") && jsonObj["matches"].is_object()) {
-                json nestedObj = jsonObj["matches"];
-                for (auto it = nestedObj.begin(); it != nestedObj.end(); ++it) {
-                    auto key = it.key();
-                    auto value = it.value();
-                    if (!key.empty() && value.is_number()) {  // Check if key is not empty and value is a number
-                        uint64_t index = std::stoi(key);  // Convert key to integer index
-                        curr_value = value.get<float>();
-                        if (index < presence_values.size()) {
-                            if (opt->ap_flag) {
-                                presence_values[index] = (curr_value > 0 && curr_value >= opt->min_frac);
-                            } else {
-                                presence_values[index] = curr_value;
-                            }
-                        }
-                    }
+        convert_chunk& chunk = chunks[slot];
+        chunk.nb_lines = 0;
+        size_t chunk_bytes = 0;
+        while (chunk.nb_lines < convert_chunk_lines && chunk_bytes < convert_chunk_bytes) {
+            if (chunk.nb_lines == chunk.lines.size()) {
+                chunk.lines.emplace_back();
+                chunk.ids.emplace_back();
+            }
+            if (opt->from_annotations) {
+                if (!(utg_ssi >> unitig)) {
+                    break;
                 }
-                utg_ssi >> unitig;
-                // std::cerr << unitig.seq << " " << unitig.name << std::endl;
-                *fpout << (opt->out_write_seq ? unitig.seq : unitig.name);
-                for (size_t i=0; i < presence_values.size(); i++) {
-                    *fpout << separator << presence_values[i];
+                chunk.lines[chunk.nb_lines] = unitig.comment;
+            } else {
+                if (!std::getline(colorQueryFile, chunk.lines[chunk.nb_lines])) {
+                    break;
                 }
-                *fpout << "\n";
+                utg_ssi >> unitig;
             }
-        } catch (json::parse_error& e) {
-            spdlog::error("Error reading ggcat files. Check that the format is correct.");
-            spdlog::error(e.what());
-            std::exit(EXIT_FAILURE);
+            chunk.ids[chunk.nb_lines] = opt->out_write_seq ? unitig.seq : unitig.name;
+            chunk_bytes += chunk.lines[chunk.nb_lines].size();
+            chunk.nb_lines++;
+        }
+
+        if (chunk.nb_lines == 0) {
+            // Remaining chunks, oldest first
+            for (size_t i = 1; i < nb_slots; i++) {
+                flush_slot((slot + i) % nb_slots);
+            }
+            break;
+        }
+
+        if (nb_slots == 1) {
+            format_chunk(chunk, opt, num_colors, separator, subsets);
+        } else {
+            pending[slot] = std::async(std::launch::async, format_chunk, std::ref(chunk), std::cref(opt), num_colors, std::cref(separator), std::cref(subsets));
         }
     }
 
     // closing files (output depends)
     colorQueryFile.close();
+    if (csr) {
+        csr_header.nb_rows = nb_rows;
+        csr_header.nnz = nnz;
+        ofs.seekp(0);
+        ofs.write(reinterpret_cast<const char*>(&csr_header), sizeof(csr_header));
+        row_index.close();
+    } else if (bit) {
+        pa_header.nb_rows = nb_rows;
+        ofs.seekp(0);
+        ofs.write(reinterpret_cast<const char*>(&pa_header), sizeof(pa_header));
+        row_index.close();
+    }
     if(!(opt->out_fname).empty()) {
         ofs.close();
         spdlog::info(fmt::format("presence-absence unitig matrix written to \"{}\"", (opt->out_fname).c_str()));
     }
+    if (bit) {
+        transpose_pa_matrix(opt->out_fname);
+        spdlog::info(fmt::format("color-major presence-absence matrix written to \"{}\"", pa_transposed_path(opt->out_fname)));
+    }
 
     return 0;
 }
@@ -6,51 +6,61 @@
 
 #include <kmat_tools/cmd/diff.h>
 #include <kmat_tools/matrix.h>
+#include <kmat_tools/partition.h>
 #include <kmat_tools/utils.h>
 
 
 namespace kmat {
 
-int main_diff(diff_opt_t opt)
+// k-mers of the first matrix absent from the second, restricted to a byte range of each
+static void diff_matrices(diff_opt_t opt, const std::vector<byte_range>& ranges, std::ostream& out)
 {
-  TextMatrixReader mat_1(opt->inputs[0]);
-  TextMatrixReader mat_2(opt->inputs[1]);
-
-  std::ostream* fpout = &std::cout;
-  std::ofstream ofs;
-  if(!(opt->output).empty()) {
-    ofs.open((opt->output).c_str());
-    if(!ofs.good()) { throw std::runtime_error(fmt::format("cannot open {}", opt->output)); }
-    fpout = &ofs;
-  }
+  TextMatrixReader mat_1(opt->inputs[0], ranges[0].begin, ranges[0].end);
+  TextMatrixReader mat_2(opt->inputs[1], ranges[1].begin, ranges[1].end);
 
   std::string kmer_1, line_1;
-  bool has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1);
+  PackedKmer packed_1;
+  bool has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1, packed_1, opt->actg_order);
 
   std::string kmer_2, line_2;
-  bool has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2);
+  PackedKmer packed_2;
+  bool has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2, packed_2, opt->actg_order);
 
   if(has_kmer_1 && has_kmer_2 && kmer_1.size() != kmer_2.size()) {
     throw std::runtime_error(fmt::format("different k-mer size between the two input matrices: {} vs {}.", kmer_1.size(), kmer_2.size()));
   }
 
   while (has_kmer_1 && has_kmer_2) {
-    int cmp = opt->actg_order ? actg_compare(kmer_1,kmer_2) : kmer_1.compare(kmer_2);
+    int cmp = compare_kmers(kmer_1, packed_1, kmer_2, packed_2, opt->actg_order);
     if(cmp == 0) { // kmer_1 == kmer_2
-      has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1);
-      has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2);
+      has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1, packed_1, opt->actg_order);
+      has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2, packed_2, opt->actg_order);
     } else if(cmp < 0) { // kmer_1 < kmer_2
-      *fpout << kmer_1 << " " << line_1 << "\n";
-      has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1);
+      out << kmer_1 << " " << line_1 << "\n";
+      has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1, packed_1, opt->actg_order);
     } else { // kmer_1 > kmer_2
-      has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2);
+      has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2, packed_2, opt->actg_order);
     }
   }
 
   while (has_kmer_1) {
-    *fpout << kmer_1 << " " << line_1 << "\n";
-    has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1);
+    out << kmer_1 << " " << line_1 << "\n";
+    has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1, packed_1, opt->actg_order);
   }
+}
+
+int main_diff(diff_opt_t opt)
+{
+  std::ostream* fpout = &std::cout;
+  std::ofstream ofs;
+  if(!(opt->output).empty()) {
+    ofs.open((opt->output).c_str());
+    if(!ofs.good()) { throw std::runtime_error(fmt::format("cannot open {}", opt->output)); }
+    fpout = &ofs;
+  }
+
+  run_partitioned(opt->inputs, opt->nb_threads, opt->actg_order, *fpout, get_tmp_dir(opt->tmp_dir, opt->output),
+    [&](const std::vector<byte_range>& ranges, std::ostream& out) { diff_matrices(opt, ranges, out); });
 
   if(!(opt->output).empty()) {
     ofs.close();
@@ -59,4 +69,4 @@ int main_diff(diff_opt_t opt)
   return 0;
 }
 
-};
\ No newline at end of file
+};
@@ -33,6 +33,73 @@ bool should_skip_filter(filter_opt_t opt) {
     return (no_absent_filter && no_present_filter);
 }
 
+template<typename count_type>
+struct text_matrix_filter {
+
+    int operator()(fs::path input, filter_opt_t opt)
+    {
+        if (opt->min_abundance > std::numeric_limits<count_type>::max()) {
+            throw std::runtime_error(fmt::format("min abundance {} does not fit in {}-bit counts", opt->min_abundance, 8*sizeof(count_type)));
+        }
+
+        TextMatrixReader reader(input);
+
+        std::ostream* fpout = &std::cout;
+        std::ofstream ofs;
+        if(!(opt->output).empty()) {
+            ofs.open((opt->output).c_str());
+            if(!ofs.good()) { throw std::runtime_error(fmt::format("cannot open output file {}", (opt->output).c_str())); }
+            fpout = &ofs;
+        }
+
+        size_t nb_samples{0};
+        size_t nb_kmers{0};
+        size_t nb_retained{0};
+
+        std::string kmer;
+        std::vector<count_type> counts;
+
+        while(reader.read_kmer_counts(kmer,counts)) {
+
+            nb_kmers++;
+            if (nb_kmers == 1) { nb_samples = counts.size(); }
+
+            if (nb_samples != counts.size()) {
+                throw std::runtime_error(fmt::format("inconsistent number of samples at line {}: found {}, expected {}", reader.line_count(), counts.size(), nb_samples));
+            }
+
+            size_t nb_absent{0};
+            size_t nb_present{0};
+            for (auto value: counts) {
+                if(value >= opt->min_abundance){
+                    nb_present++;
+                } else {
+                    nb_absent++;
+                }
+            }
+
+            bool enough_absent = (!opt->min_nb_absent_set && nb_absent >= opt->min_frac_absent * nb_samples)
+                || (opt->min_nb_absent_set && nb_absent >= opt->min_nb_absent);    
+            bool enough_present = (!opt->min_nb_present_set && nb_present >= opt->min_frac_present * nb_samples)
+                || (opt->min_nb_present_set && nb_present >= opt->min_nb_present);
+            if (enough_absent && enough_present) {
+                nb_retained++;
+                *fpout << reader.line() << "\n";
+            }
+        }
+
+        spdlog::info(fmt::format("{} samples", nb_samples));
+        spdlog::info(fmt::format("{}/{} k-mers retained", nb_retained, nb_kmers));
+
+        if(!(opt->output).empty()) {
+            ofs.close();
+        }
+
+        return 0;
+    }
+};
+
+
 int kmat_basic_filter(fs::path input, filter_opt_t opt) {
 
     // Optimization: if no filtering is needed, just copy the file
@@ -53,60 +120,7 @@ int kmat_basic_filter(fs::path input, filter_opt_t opt) {
         return 0;
     }
 
-    TextMatrixReader reader(input);
-
-    std::ostream* fpout = &std::cout;
-    std::ofstream ofs;
-    if(!(opt->output).empty()) {
-        ofs.open((opt->output).c_str());
-        if(!ofs.good()) { throw std::runtime_error(fmt::format("cannot open output file {}", (opt->output).c_str())); }
-        fpout = &ofs;
-    }
-
-    size_t nb_samples{0};
-    size_t nb_kmers{0};
-    size_t nb_retained{0};
-
-    std::string kmer;
-    std::vector<size_t> counts;
-
-    while(reader.read_kmer_counts(kmer,counts)) {
-
-        nb_kmers++;
-        if (nb_kmers == 1) { nb_samples = counts.size(); }
-
-        if (nb_samples != counts.size()) {
-            throw std::runtime_error(fmt::format("inconsistent number of samples at line {}: found {}, expected {}", reader.line_count(), counts.size(), nb_samples));
-        }
-
-        size_t nb_absent{0};
-        size_t nb_present{0};
-        for (auto value: counts) {
-            if(value >= opt->min_abundance){
-                nb_present++;
-            } else {
-                nb_absent++;
-            }
-        }
-
-        bool enough_absent = (!opt->min_nb_absent_set && nb_absent >= opt->min_frac_absent * nb_samples)
-            || (opt->min_nb_absent_set && nb_absent >= opt->min_nb_absent);    
-        bool enough_present = (!opt->min_nb_present_set && nb_present >= opt->min_frac_present * nb_samples)
-            || (opt->min_nb_present_set && nb_present >= opt->min_nb_present);
-        if (enough_absent && enough_present) {
-            nb_retained++;
-            *fpout << reader.line() << "\n";
-        }
-    }
-
-    spdlog::info(fmt::format("{} samples", nb_samples));
-    spdlog::info(fmt::format("{}/{} k-mers retained", nb_retained, nb_kmers));
-
-    if(!(opt->output).empty()) {
-        ofs.close();
-    }
-
-    return 0;
+    return count_width_exec<text_matrix_filter>(opt->count_width, input, opt);
 }
 
 
@@ -1,5 +1,10 @@
+#include <filesystem>
+#include <fstream>
 #include <memory>
+#include <queue>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <spdlog/spdlog.h>
@@ -7,17 +12,104 @@
 
 #include <kmat_tools/cmd/merge.h>
 #include <kmat_tools/matrix.h>
+#include <kmat_tools/partition.h>
 #include <kmat_tools/utils.h>
 
 
 namespace kmat {
 
+// number of samples of a matrix, from its first line
+static size_t get_matrix_nb_samples(const std::string& path)
+{
+  TextMatrixReader mat(path);
+  std::string kmer, line;
+  return mat.read_kmer_and_line(kmer, line) ? get_nb_samples(line) : 0;
+}
+
+// k-way merge of k-mer sorted text matrices, restricted to a byte range of each input. The
+// columns of each input follow those of the previous one; inputs without a k-mer are
+// filled with zeros.
+static void merge_matrices(const std::vector<std::string>& paths, const std::vector<byte_range>& ranges, const std::vector<size_t>& nb_samples, std::ostream& out, bool actg_order)
+{
+  struct input_t {
+    std::unique_ptr<TextMatrixReader<>> reader;
+    std::string kmer;
+    PackedKmer packed;
+    std::string line;
+    std::string empty_samples;
+    bool has_kmer{false};
+  };
+
+  std::vector<input_t> inputs(paths.size());
+  for (size_t i = 0; i < paths.size(); i++) {
+    auto& in = inputs[i];
+    in.reader = std::make_unique<TextMatrixReader<>>(paths[i], ranges[i].begin, ranges[i].end);
+    in.has_kmer = in.reader->read_kmer_and_line(in.kmer, in.line, in.packed, actg_order);
+    in.empty_samples.reserve(2*nb_samples[i]);
+    for (size_t s = 0; s < nb_samples[i]; ++s) { in.empty_samples.append(" 0"); }
+  }
+
+  // min-heap of inputs on their current k-mer
+  auto greater = [&](size_t a, size_t b) {
+    int cmp = compare_kmers(inputs[a].kmer, inputs[a].packed, inputs[b].kmer, inputs[b].packed, actg_order);
+    return cmp == 0 ? a > b : cmp > 0;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (inputs[i].has_kmer) { heap.push(i); }
+  }
+
+  std::string kmer;
+  PackedKmer packed;
+  auto same_kmer = [&](const input_t& in) {
+    return in.packed.packed && packed.packed ? in.packed.compare(packed) == 0 : in.kmer == kmer;
+  };
+
+  std::vector<char> present(inputs.size(), 0);
+  std::vector<size_t> popped;
+  fmt::memory_buffer row;
+  while (!heap.empty()) {
+    kmer = inputs[heap.top()].kmer;
+    packed = inputs[heap.top()].packed;
+    while (!heap.empty() && same_kmer(inputs[heap.top()])) {
+      present[heap.top()] = 1;
+      popped.push_back(heap.top());
+      heap.pop();
+    }
+
+    row.clear();
+    row.append(kmer.data(), kmer.data() + kmer.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+      const std::string& values = present[i] ? inputs[i].line : inputs[i].empty_samples;
+      if (present[i]) { row.push_back(' '); }
+      row.append(values.data(), values.data() + values.size());
+    }
+    row.push_back('\n');
+    out.write(row.data(), row.size());
+
+    for (auto i : popped) {
+      present[i] = 0;
+      auto& in = inputs[i];
+      in.has_kmer = in.reader->read_kmer_and_line(in.kmer, in.line, in.packed, actg_order);
+      if (in.has_kmer) { heap.push(i); }
+    }
+    popped.clear();
+  }
+}
+
 int main_merge(merge_opt_t opt)
 {
   // opt->sanity_check();
 
-  TextMatrixReader mat_1(opt->inputs[0]);
-  TextMatrixReader mat_2(opt->inputs[1]);
+  std::vector<std::string> paths = opt->inputs;
+  if (!(opt->input_list).empty()) {
+    std::ifstream list(opt->input_list);
+    if (!list.good()) { throw std::runtime_error(fmt::format("cannot open {}", opt->input_list)); }
+    std::string path;
+    while (std::getline(list, path)) {
+      if (!path.empty()) { paths.push_back(path); }
+    }
+  }
 
   std::ostream* fpout = &std::cout;
   std::ofstream ofs;
@@ -27,48 +119,60 @@ int main_merge(merge_opt_t opt)
     fpout = &ofs;
   }
 
-  size_t ksize = opt->kmer_size;
-
-  std::string kmer_1, line_1;
-  bool has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1);
-  size_t nb_samples_1 = has_kmer_1 ? get_nb_samples(line_1) : 0;
-  spdlog::info(fmt::format("samples in 1st matrix: {}", nb_samples_1));
-
-  std::string empty_samples_1; empty_samples_1.reserve(2*nb_samples_1);
-  for(auto i=0; i<nb_samples_1; ++i) { empty_samples_1.append(" 0"); }
-
-  std::string kmer_2, line_2;
-  bool has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2);
-  size_t nb_samples_2 = has_kmer_2 ? get_nb_samples(line_2) : 0;
-  spdlog::info(fmt::format("samples in 2nd matrix: {}", nb_samples_2));
-
-  std::string empty_samples_2; empty_samples_2.reserve(2*nb_samples_2);
-  for(auto i=0; i<nb_samples_2; ++i) { empty_samples_2.append(" 0"); }
-
-  while (has_kmer_1 && has_kmer_2) {
-    int cmp = opt->actg_order ? actg_compare(kmer_1,kmer_2) : kmer_1.compare(kmer_2);
-    if(cmp == 0) {
-      *fpout << kmer_1 << " " << line_1 << " " << line_2;
-      has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1);
-      has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2);
-    } else if(cmp < 0) {
-      *fpout << kmer_1 << " " << line_1 << empty_samples_2;
-      has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1);
-    } else { // cmp > 0
-      *fpout << kmer_2 << empty_samples_1 << " " << line_2;
-      has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2);
+  // With more inputs than the fan-in, consecutive groups are merged into intermediate runs,
+  // which keeps the column order, until a single pass remains.
+  fs::path tmp_dir = get_tmp_dir(opt->tmp_dir, opt->output);
+
+  std::unordered_map<std::string, size_t> nb_samples;
+  size_t total_samples{0};
+  for (const auto& path : paths) {
+    nb_samples[path] = get_matrix_nb_samples(path);
+    spdlog::debug(fmt::format("samples in {}: {}", path, nb_samples[path]));
+    total_samples += nb_samples[path];
+  }
+  spdlog::info(fmt::format("merging {} matrices, {} samples", paths.size(), total_samples));
+
+  // Each merge runs on opt->nb_threads key ranges of its inputs
+  auto merge = [&](const std::vector<std::string>& group, std::ostream& out) {
+    std::vector<size_t> group_samples;
+    for (const auto& path : group) { group_samples.push_back(nb_samples[path]); }
+    run_partitioned(group, opt->nb_threads, opt->actg_order, out, tmp_dir,
+      [&](const std::vector<byte_range>& ranges, std::ostream& part) {
+        merge_matrices(group, ranges, group_samples, part, opt->actg_order);
+      });
+  };
+
+  size_t fanin = std::max<size_t>(opt->fanin, 2);
+  std::unordered_set<std::string> runs;
+  for (size_t level = 0; paths.size() > fanin; level++) {
+    std::vector<std::string> next;
+    for (size_t first = 0; first < paths.size(); first += fanin) {
+      std::vector<std::string> group(paths.begin() + first, paths.begin() + std::min(first + fanin, paths.size()));
+      if (group.size() == 1) {
+        next.push_back(group[0]);
+        continue;
+      }
+      std::string run = (tmp_dir / fmt::format("kmat_merge.{}.{}.{}.mat", getpid(), level, next.size())).string();
+      std::ofstream run_stream(run);
+      if(!run_stream.good()) { throw std::runtime_error(fmt::format("cannot open {}", run)); }
+      merge(group, run_stream);
+      run_stream.close();
+      nb_samples[run] = 0;
+      for (const auto& path : group) { nb_samples[run] += nb_samples[path]; }
+      for (const auto& path : group) {
+        if (runs.erase(path)) { remove_file(path); }
+      }
+      runs.insert(run);
+      next.push_back(run);
     }
-    *fpout << "\n";
+    spdlog::info(fmt::format("merge pass {}: {} matrices into {} runs", level, paths.size(), next.size()));
+    paths = std::move(next);
   }
 
-  while (has_kmer_1) {
-    *fpout << kmer_1 << " " << line_1 << empty_samples_2;
-    has_kmer_1 = mat_1.read_kmer_and_line(kmer_1, line_1);
-  }
+  merge(paths, *fpout);
 
-  while(has_kmer_2) {
-    *fpout << kmer_2 << empty_samples_1 << " " << line_2;
-    has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2);
+  for (const auto& run : runs) {
+    remove_file(run);
   }
 
   if(!(opt->output).empty()) {
@@ -78,4 +182,4 @@ int main_merge(merge_opt_t opt)
   return 0;
 }
 
-};
\ No newline at end of file
+};
@@ -6,6 +6,7 @@
 
 #include <kmat_tools/cmd/reverse.h>
 #include <kmat_tools/matrix.h>
+#include <kmat_tools/revcomp.h>
 #include <kmat_tools/utils.h>
 
 
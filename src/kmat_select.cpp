@@ -1,3 +1,4 @@
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -8,29 +9,26 @@
 
 #include <kmat_tools/cmd/select.h>
 #include <kmat_tools/matrix.h>
+#include <kmat_tools/partition.h>
 #include <kmat_tools/utils.h>
 
 
 namespace kmat {
 
-int main_select(select_opt_t opt)
+// k-mers of the second matrix present in the first, restricted to a byte range of each.
+// Returns the number of retained k-mers.
+static size_t select_matrices(select_opt_t opt, const std::vector<byte_range>& ranges, std::ostream& out)
 {
-    TextMatrixReader mat_1(opt->inputs[0]);
-    TextMatrixReader mat_2(opt->inputs[1]);
-
-    std::ostream* fpout = &std::cout;
-    std::ofstream ofs;
-    if(!(opt->output).empty()) {
-        ofs.open((opt->output).c_str());
-        if(!ofs.good()) { throw std::runtime_error(fmt::format("cannot open {}", opt->output)); }
-        fpout = &ofs;
-    }
+    TextMatrixReader mat_1(opt->inputs[0], ranges[0].begin, ranges[0].end);
+    TextMatrixReader mat_2(opt->inputs[1], ranges[1].begin, ranges[1].end);
 
     std::string kmer_1;
-    bool has_kmer_1 = mat_1.read_kmer(kmer_1);
+    PackedKmer packed_1;
+    bool has_kmer_1 = mat_1.read_kmer(kmer_1, packed_1, opt->actg_order);
 
     std::string kmer_2, line_2;
-    bool has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2);
+    PackedKmer packed_2;
+    bool has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2, packed_2, opt->actg_order);
 
     if(has_kmer_1 && has_kmer_2 && kmer_1.size() != kmer_2.size()) {
         throw std::runtime_error(fmt::format("different k-mer size between the two input matrices: {} vs {}.", kmer_1.size(), kmer_2.size()));
@@ -38,20 +36,36 @@ int main_select(select_opt_t opt)
 
     size_t retained_kmers{0};
     while (has_kmer_1 && has_kmer_2) {
-        int cmp = opt->actg_order ? actg_compare(kmer_1,kmer_2) : kmer_1.compare(kmer_2);
+        int cmp = compare_kmers(kmer_1, packed_1, kmer_2, packed_2, opt->actg_order);
         if(cmp == 0) { // kmer_1 == kmer_2
             retained_kmers++;
-            *fpout << kmer_2 << " " << line_2 << "\n";
-            has_kmer_1 = mat_1.read_kmer(kmer_1);
-            has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2);
+            out << kmer_2 << " " << line_2 << "\n";
+            has_kmer_1 = mat_1.read_kmer(kmer_1, packed_1, opt->actg_order);
+            has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2, packed_2, opt->actg_order);
         } else if(cmp < 0) { // kmer_1 < kmer_2
-            has_kmer_1 = mat_1.read_kmer(kmer_1);
+            has_kmer_1 = mat_1.read_kmer(kmer_1, packed_1, opt->actg_order);
         } else { // kmer_1 > kmer_2
-            has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2);
+            has_kmer_2 = mat_2.read_kmer_and_line(kmer_2, line_2, packed_2, opt->actg_order);
         }
     }
+    return retained_kmers;
+}
+
+int main_select(select_opt_t opt)
+{
+    std::ostream* fpout = &std::cout;
+    std::ofstream ofs;
+    if(!(opt->output).empty()) {
+        ofs.open((opt->output).c_str());
+        if(!ofs.good()) { throw std::runtime_error(fmt::format("cannot open {}", opt->output)); }
+        fpout = &ofs;
+    }
+
+    std::atomic<size_t> retained_kmers{0};
+    run_partitioned(opt->inputs, opt->nb_threads, opt->actg_order, *fpout, get_tmp_dir(opt->tmp_dir, opt->output),
+        [&](const std::vector<byte_range>& ranges, std::ostream& out) { retained_kmers += select_matrices(opt, ranges, out); });
 
-    spdlog::info(fmt::format("retained k-mers: {}", retained_kmers));
+    spdlog::info(fmt::format("retained k-mers: {}", retained_kmers.load()));
 
     if(!(opt->output).empty()) {
         ofs.close();
@@ -60,4 +74,4 @@ int main_select(select_opt_t opt)
     return 0;
 }
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <charconv>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <kmat_tools/cmd/sort.h>
+#include <kmat_tools/matrix.h>
+#include <kmat_tools/packed_kmer.h>
+#include <kmat_tools/partition.h>
+#include <kmat_tools/revcomp.h>
+#include <kmat_tools/utils.h>
+
+
+namespace kmat {
+
+// Lines of the input held in memory, sorted on their packed k-mers
+struct sort_chunk
+{
+  struct record {
+    PackedKmer packed;
+    uint64_t offset;
+    uint32_t kmer_size;
+    uint32_t line_size;
+  };
+
+  std::string buffer;
+  std::vector<record> records;
+
+  std::string_view kmer(const record& r) const { return {buffer.data() + r.offset, r.kmer_size}; }
+  std::string_view values(const record& r) const {
+    return r.line_size > r.kmer_size ? std::string_view{buffer.data() + r.offset + r.kmer_size + 1, r.line_size - r.kmer_size - 1} : std::string_view{};
+  }
+
+  size_t memory() const { return buffer.size() + records.size() * sizeof(record); }
+};
+
+// Writes k-mer sorted lines, summing the counts of consecutive lines with the same k-mer if asked
+class SortedLineWriter
+{
+  public:
+    SortedLineWriter(std::ostream& out, bool sum_duplicates)
+      : m_out(out), m_sum_duplicates(sum_duplicates) {}
+
+    void add(std::string_view kmer, const PackedKmer& packed, std::string_view values) {
+      if (!m_sum_duplicates) {
+        append_line(kmer, values);
+        return;
+      }
+
+      bool same = m_has_kmer && (packed.packed && m_packed.packed ? packed.compare(m_packed) == 0 : kmer == m_kmer);
+      if (!same) {
+        write_sums();
+        m_kmer = kmer;
+        m_packed = packed;
+        m_has_kmer = true;
+        m_sums.clear();
+        parse_counts(values, true);
+      } else {
+        parse_counts(values, false);
+      }
+    }
+
+    // write the pending lines, to be called once all lines are added
+    void flush() {
+      write_sums();
+      m_out.write(m_buffer.data(), m_buffer.size());
+      m_buffer.clear();
+    }
+
+  private:
+    void append_line(std::string_view kmer, std::string_view values) {
+      m_buffer.append(kmer.data(), kmer.data() + kmer.size());
+      if (!values.empty()) {
+        m_buffer.push_back(' ');
+        m_buffer.append(values.data(), values.data() + values.size());
+      }
+      m_buffer.push_back('\n');
+      if (m_buffer.size() >= (1 << 20)) {
+        m_out.write(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+      }
+    }
+
+    void parse_counts(std::string_view values, bool first) {
+      size_t column = 0;
+      size_t idx = values.find_first_not_of(" \t");
+      while (idx != std::string_view::npos) {
+        uint64_t value{0};
+        auto [ptr, ec] = std::from_chars(values.data() + idx, values.data() + values.size(), value);
+        if (ec != std::errc()) {
+          throw std::runtime_error(fmt::format("cannot sum the counts of k-mer {}: \"{}\" is not a count", m_kmer, values.substr(idx, values.find_first_of(" \t", idx) - idx)));
+        }
+        if (first) {
+          m_sums.push_back(value);
+        } else if (column < m_sums.size()) {
+          m_sums[column] += value;
+        }
+        column++;
+        idx = values.find_first_not_of(" \t", ptr - values.data());
+      }
+      if (column != m_sums.size()) {
+        throw std::runtime_error(fmt::format("different number of samples for k-mer {}: {} vs {}", m_kmer, column, m_sums.size()));
+      }
+    }
+
+    void write_sums() {
+      if (!m_has_kmer) { return; }
+      m_line.clear();
+      for (auto sum : m_sums) {
+        if (m_line.size()) { m_line.push_back(' '); }
+        fmt::format_to(std::back_inserter(m_line), "{}", sum);
+      }
+      append_line(m_kmer, std::string_view{m_line.data(), m_line.size()});
+      m_has_kmer = false;
+    }
+
+    std::ostream& m_out;
+    bool m_sum_duplicates;
+    fmt::memory_buffer m_buffer;
+    fmt::memory_buffer m_line;
+
+    std::string m_kmer;
+    PackedKmer m_packed;
+    bool m_has_kmer{false};
+    std::vector<uint64_t> m_sums;
+};
+
+// Read lines until the chunk reaches max_bytes, returns false at the end of the input
+static bool read_chunk(TextMatrixReader<>& reader, sort_chunk& chunk, size_t max_bytes, sort_opt_t opt)
+{
+  std::string kmer, line;
+  while (chunk.memory() < max_bytes) {
+    if (!reader.read_kmer_and_line(kmer, line)) {
+      return false;
+    }
+    if (opt->canonicalize && !is_canonical(kmer, opt->actg_order)) {
+      reverse_complement_inplace(kmer);
+    }
+
+    sort_chunk::record r;
+    r.packed.assign(kmer, opt->actg_order);
+    r.offset = chunk.buffer.size();
+    r.kmer_size = kmer.size();
+    chunk.buffer.append(kmer);
+    if (!line.empty()) {
+      chunk.buffer.push_back(' ');
+      chunk.buffer.append(line);
+    }
+    r.line_size = chunk.buffer.size() - r.offset;
+    chunk.records.push_back(r);
+  }
+  return true;
+}
+
+// Sort a chunk (keeping the input order of equal k-mers) and write it
+static void sort_and_write_chunk(sort_chunk& chunk, std::ostream& out, sort_opt_t opt)
+{
+  std::stable_sort(chunk.records.begin(), chunk.records.end(), [&](const sort_chunk::record& a, const sort_chunk::record& b) {
+    return compare_kmers(chunk.kmer(a), a.packed, chunk.kmer(b), b.packed, opt->actg_order) < 0;
+  });
+
+  SortedLineWriter writer(out, opt->sum_duplicates);
+  for (const auto& r : chunk.records) {
+    writer.add(chunk.kmer(r), r.packed, chunk.values(r));
+  }
+  writer.flush();
+}
+
+// k-way merge of sorted runs, restricted to a byte range of each. Equal k-mers come out in run order.
+static void merge_runs(const std::vector<std::string>& paths, const std::vector<byte_range>& ranges, std::ostream& out, sort_opt_t opt)
+{
+  struct input_t {
+    std::unique_ptr<TextMatrixReader<>> reader;
+    std::string kmer;
+    PackedKmer packed;
+    std::string line;
+  };
+
+  std::vector<input_t> inputs(paths.size());
+  auto greater = [&](size_t a, size_t b) {
+    int cmp = compare_kmers(inputs[a].kmer, inputs[a].packed, inputs[b].kmer, inputs[b].packed, opt->actg_order);
+    return cmp == 0 ? a > b : cmp > 0;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+  for (size_t i = 0; i < paths.size(); i++) {
+    auto& in = inputs[i];
+    in.reader = std::make_unique<TextMatrixReader<>>(paths[i], ranges[i].begin, ranges[i].end);
+    if (in.reader->read_kmer_and_line(in.kmer, in.line, in.packed, opt->actg_order)) { heap.push(i); }
+  }
+
+  SortedLineWriter writer(out, opt->sum_duplicates);
+  while (!heap.empty()) {
+    size_t i = heap.top();
+    heap.pop();
+    auto& in = inputs[i];
+    writer.add(in.kmer, in.packed, in.line);
+    if (in.reader->read_kmer_and_line(in.kmer, in.line, in.packed, opt->actg_order)) { heap.push(i); }
+  }
+  writer.flush();
+}
+
+int main_sort(sort_opt_t opt)
+{
+  TextMatrixReader reader(opt->inputs[0]);
+
+  std::ostream* fpout = &std::cout;
+  std::ofstream ofs;
+  if(!(opt->output).empty()) {
+    ofs.open((opt->output).c_str());
+    if(!ofs.good()) { throw std::runtime_error(fmt::format("cannot open {}", opt->output)); }
+    fpout = &ofs;
+  }
+
+  // one chunk is read while up to nb_threads chunks are sorted and written to runs
+  size_t nb_threads = std::max<size_t>(opt->nb_threads, 1);
+  size_t chunk_bytes = std::max<size_t>((opt->max_memory << 20) / (nb_threads + 1), 1 << 20);
+  fs::path tmp_dir = get_tmp_dir(opt->tmp_dir, opt->output);
+
+  std::vector<std::string> runs;
+  std::deque<std::future<void>> pending;
+  bool more = true;
+  while (more) {
+    auto chunk = std::make_shared<sort_chunk>();
+    chunk->buffer.reserve(chunk_bytes);
+    more = read_chunk(reader, *chunk, chunk_bytes, opt);
+
+    if (!more && runs.empty()) {
+      spdlog::info(fmt::format("sorting {} lines in memory", chunk->records.size()));
+      sort_and_write_chunk(*chunk, *fpout, opt);
+      break;
+    }
+
+    if (pending.size() >= nb_threads) {
+      pending.front().get();
+      pending.pop_front();
+    }
+    std::string run = (tmp_dir / fmt::format("kmat_sort.{}.0.{}.mat", getpid(), runs.size())).string();
+    runs.push_back(run);
+    spdlog::debug(fmt::format("sorting {} lines into {}", chunk->records.size(), run));
+    pending.push_back(std::async(std::launch::async, [chunk, run, opt]() {
+      std::ofstream run_stream(run);
+      if(!run_stream.good()) { throw std::runtime_error(fmt::format("cannot open {}", run)); }
+      sort_and_write_chunk(*chunk, run_stream, opt);
+    }));
+  }
+  for (auto& p : pending) { p.get(); }
+  if (!runs.empty()) {
+    spdlog::info(fmt::format("{} sorted runs", runs.size()));
+  }
+
+  // Each merge runs on nb_threads key ranges of its runs
+  auto merge = [&](const std::vector<std::string>& group, std::ostream& out) {
+    run_partitioned(group, nb_threads, opt->actg_order, out, tmp_dir,
+      [&](const std::vector<byte_range>& ranges, std::ostream& part) {
+        merge_runs(group, ranges, part, opt);
+      });
+  };
+
+  // the merge passes are skipped when the input was sorted in memory
+  size_t fanin = std::max<size_t>(opt->fanin, 2);
+  for (size_t level = 1; runs.size() > fanin; level++) {
+    std::vector<std::string> next;
+    for (size_t first = 0; first < runs.size(); first += fanin) {
+      std::vector<std::string> group(runs.begin() + first, runs.begin() + std::min(first + fanin, runs.size()));
+      std::string run = (tmp_dir / fmt::format("kmat_sort.{}.{}.{}.mat", getpid(), level, next.size())).string();
+      std::ofstream run_stream(run);
+      if(!run_stream.good()) { throw std::runtime_error(fmt::format("cannot open {}", run)); }
+      merge(group, run_stream);
+      run_stream.close();
+      for (const auto& path : group) { remove_file(path); }
+      next.push_back(run);
+    }
+    spdlog::info(fmt::format("merge pass {}: {} runs into {}", level, runs.size(), next.size()));
+    runs = std::move(next);
+  }
+
+  if (!runs.empty()) {
+    merge(runs, *fpout);
+  }
+  for (const auto& run : runs) {
+    remove_file(run);
+  }
+
+  if(!(opt->output).empty()) {
+    ofs.close();
+  }
+
+  return 0;
+}
+
+};
@@ -58,6 +58,10 @@ int main(int argc, char* argv[])
             kmat::select_opt_t opt = std::static_pointer_cast<struct kmat::select_options>(options);
             return kmat::main_select(opt);
         }
+        else if (cmd == kmat::COMMAND::SORT) {
+            kmat::sort_opt_t opt = std::static_pointer_cast<struct kmat::sort_options>(options);
+            return kmat::main_sort(opt);
+        }
         else if (cmd == kmat::COMMAND::UNITIG) {
             kmat::unitig_opt_t opt = std::static_pointer_cast<struct kmat::unitig_options>(options);
             return kmat::main_unitig(opt);
@@ -18,127 +18,263 @@
 #include <kmat_tools/utils.h>
 
 #include <kmat_tools/aggregator.h>
+#include <kmat_tools/kmer_index.h>
 #include <kmat_tools/matrix_writer.h>
+#include <kmat_tools/unitig_index.h>
 
 namespace fs = std::filesystem;
 
 
 namespace kmat {
 
-int main_unitig(unitig_opt_t opt)
-{
-    // input validation
-    fs::path unitig_path = opt->inputs[0];
-    if(!fs::is_regular_file(unitig_path)) {
-        throw std::runtime_error(fmt::format("unitig file \"{}\" does not exist", unitig_path.c_str()));
-    }
+// the unitig dictionary is bounded by sshash, whatever the k-mer widths kmtricks is built with
+constexpr int unitig_max_k = std::min<int>(KL[MUSET_KMER_N-1]-1, sshash::constants::max_k);
 
-    fs::path matrix_path = opt->inputs[1];
-    if(!fs::is_regular_file(matrix_path)) {
-        throw std::runtime_error(fmt::format("k-mer matrix file \"{}\" does not exist", matrix_path.c_str()));
-    }
-
-    if(opt->mini_size >= opt->kmer_size) {
-        throw std::runtime_error("minimizer size must be smaller than k-mer size");
+static std::unique_ptr<MatrixWriter> make_unitig_writer(unitig_opt_t opt, size_t nb_samples)
+{
+    if (opt->output_format == "txt") {
+        // NORMAL TEXT FILE
+        return std::make_unique<TextMatrixWriter>(opt->prefix, opt->write_frac_matrix );
+    } else if (opt->output_format == "tsv") {
+        // TSV COMPRESSED FOR DOWNSTREAM IN MEMORY
+        return std::make_unique<CompressedTSVMatrixWriter>(opt->prefix, opt->write_frac_matrix, nb_samples);
     }
+    // IF NOT RECOGNIZED DEFAULT TO TXT FOR BACKWARD COMPATIBILITY AND AVOID DISRUPTION
+    spdlog::info(fmt::format("OUTPUT FORMAT {} NOT RECOGNIZED. DEFAULT TO TXT.", opt->output_format));
+    return std::make_unique<TextMatrixWriter>(opt->prefix, opt->write_frac_matrix );
+}
 
-    spdlog::info("building k-mer dictionary");
+// Reads the k-mer matrix, aggregates counts per unitig and writes the unitig matrix,
+// with counts stored on count_type (see --count-width).
+template<typename count_type>
+struct aggregate_unitigs {
 
-    sshash::dictionary kmer_dict;
+    int operator()(unitig_opt_t opt, sshash::dictionary& kmer_dict, const fs::path& unitig_path, const fs::path& matrix_path)
     {
-        std::string sshash_logfile = fmt::format("{}.sshash.log", opt->prefix);
-        std::ofstream ofs(sshash_logfile, std::ios::out);
-        std::streambuf *coutbuf = std::cout.rdbuf();
-        if (ofs.good()) {
-          std::cout.rdbuf(ofs.rdbuf());
-        }
+        TextMatrixReader mat(matrix_path);
 
-        sshash::build_configuration build_config;
-        build_config.k = opt->kmer_size;
-        build_config.m = opt->mini_size;
-        build_config.c = 5.0;
-        build_config.pthash_threads = opt->nb_threads;
-        build_config.canonical_parsing = true;
-        build_config.verbose = false;
-        kmer_dict.build(unitig_path, build_config);
+        std::string kmer;
+        std::vector<uint32_t> sample_ids;
+        std::vector<count_type> kmer_counts;
+        std::size_t nb_counts {0};
+        bool has_kmer = mat.read_kmer_sparse_counts(kmer,sample_ids,kmer_counts,nb_counts);
 
-        std::cout.rdbuf(coutbuf);
-    }
+        std::size_t nb_samples {has_kmer ? nb_counts : 0};
+        spdlog::debug(fmt::format("samples: {}", nb_samples));
 
-    spdlog::debug(fmt::format("k-mer processed: {}", kmer_dict.size()));
-    spdlog::debug(fmt::format("unitigs processed: {}", kmer_dict.num_contigs()));
+        size_t number_unitigs {kmer_dict.num_contigs()};
 
-    spdlog::info("aggregating k-mer counts");
+        std::unique_ptr<Aggregator<count_type>> aggregator;
+        if (opt->abundance_metric == "mean") {
+            spdlog::info(fmt::format("Computing mean ({}) for unitigs.", opt->abundance_metric));
+            auto mean = std::make_unique<MeanAggregator<count_type>>(nb_samples, number_unitigs, opt->min_frac );
+            spdlog::debug(fmt::format("mean accumulators: {} bytes", mean->memory_bytes()));
+            aggregator = std::move(mean);
+        }
+        else { // median
+            spdlog::info(fmt::format("Computing median ({}) for unitigs.", opt->abundance_metric));
+            aggregator = std::make_unique<MedianAggregator<count_type>>(nb_samples, number_unitigs, opt->min_frac );
+        }
 
-    TextMatrixReader mat(matrix_path);
+        // rows are read sparse so that aggregation only touches the samples where the k-mer is present
+        run_step(*opt, "aggregation", [&]() {
+            while(has_kmer) {
+                auto res = kmer_dict.lookup_advanced(kmer.c_str());
+                if (res.kmer_id == sshash::constants::invalid_uint64) {
+                    has_kmer = mat.read_kmer_sparse_counts(kmer,sample_ids,kmer_counts,nb_counts);
+                    continue;
+                }
+
+                if (nb_counts != nb_samples) {
+                    spdlog::debug(fmt::format("ERROR: GOT THESE NUMBER OF SAMPLES {}. EXPECTED {}", nb_counts, nb_samples));
+                    has_kmer = mat.read_kmer_sparse_counts(kmer,sample_ids,kmer_counts,nb_counts);
+                    continue;
+                }
+
+                std::size_t utg_id = res.contig_id;
+                aggregator->process_kmer(utg_id, sample_ids, kmer_counts);
+
+                has_kmer = mat.read_kmer_sparse_counts(kmer,sample_ids,kmer_counts,nb_counts);
+            }
+        });
+
+        spdlog::info("writing unitig matrix");
+
+        run_step(*opt, "writing", [&]() {
+            std::unique_ptr<MatrixWriter> writer = make_unitig_writer(opt, nb_samples);
+
+            std::unique_ptr<AbundanceStoreWriter> index_writer;
+            if (opt->write_index) {
+                index_writer = std::make_unique<AbundanceStoreWriter>(index_abundance_path(opt->prefix), opt->kmer_size, number_unitigs, nb_samples);
+            }
+
+            klibpp::KSeq unitig;
+            klibpp::SeqStreamIn utg_ssi(unitig_path.c_str());
+
+            std::vector<double> utg_abundances(nb_samples);
+            std::vector<double> utg_fractions(nb_samples);
+
+            for(uint64_t utg_id=0; utg_ssi >> unitig; utg_id++) {
+                std::size_t utg_nb_kmers {unitig.seq.length() - opt->kmer_size + 1};
+                // FILL SAMPLES VECTOR WITH ABUNDANCE FRACTION FOR THE UTG
+                for (size_t idx {0}; idx < nb_samples; idx++){
+                    auto [abundance, frac] = aggregator->get_abundance_fraction(utg_id, idx, utg_nb_kmers);
+                    utg_abundances[idx] = abundance;
+                    if (opt->write_frac_matrix) {utg_fractions[idx] = frac;}
+                }
+                // DUMP IT TO DISK
+                std::string utg_identifier {opt->write_seq ? unitig.seq : unitig.name};
+                writer->write_row(utg_identifier, utg_abundances, utg_fractions);
+                if (index_writer) { index_writer->write_row(utg_abundances); }
+                // REPEAT
+            }
+
+            if (index_writer) { index_writer->close(); }
+        });
+        return 0;
+    }
+};
 
-    std::string kmer;
-    std::vector<uint32_t> kmer_counts;
-    bool has_kmer = mat.read_kmer_counts(kmer,kmer_counts);
 
-    std::size_t nb_samples {has_kmer ? kmer_counts.size() : 0};
-    spdlog::debug(fmt::format("samples: {}", nb_samples));
+// --engine unitig: loads the k-mer matrix in a sorted 2-bit index, then walks the k-mers of
+// each unitig in order and writes its row once they are aggregated. No unitig-by-sample
+// accumulator is held, the memory is that of the sparse k-mer matrix.
+template<typename count_type>
+struct aggregate_unitigs_by_unitig {
 
-    size_t number_unitigs {kmer_dict.num_contigs()};
+    int operator()(unitig_opt_t opt, sshash::dictionary& kmer_dict, const fs::path& unitig_path, const fs::path& matrix_path)
+    {
+        TextMatrixReader mat(matrix_path);
+
+        std::string kmer;
+        std::vector<uint32_t> sample_ids;
+        std::vector<count_type> kmer_counts;
+        std::size_t nb_counts {0};
+        bool has_kmer = mat.read_kmer_sparse_counts(kmer,sample_ids,kmer_counts,nb_counts);
+
+        std::size_t nb_samples {has_kmer ? nb_counts : 0};
+        spdlog::debug(fmt::format("samples: {}", nb_samples));
+
+        KmerRowIndex<count_type> index(opt->kmer_size);
+        size_t nb_rows {0};
+        run_step(*opt, "matrix index", [&]() {
+            while(has_kmer) {
+                nb_rows++;
+                if (nb_counts != nb_samples) {
+                    spdlog::debug(fmt::format("ERROR: GOT THESE NUMBER OF SAMPLES {}. EXPECTED {}", nb_counts, nb_samples));
+                } else {
+                    index.add_row(kmer, sample_ids, kmer_counts);
+                }
+                has_kmer = mat.read_kmer_sparse_counts(kmer,sample_ids,kmer_counts,nb_counts);
+            }
+            index.build();
+        });
+        spdlog::debug(fmt::format("k-mer rows: {}, indexed: {}", nb_rows, index.size()));
+
+        bool median = opt->abundance_metric == "median";
+        spdlog::info(fmt::format("Computing {} for unitigs.", median ? "median" : "mean"));
+        UnitigAggregator<count_type> aggregator(nb_samples, median, opt->min_frac);
+
+        std::unique_ptr<MatrixWriter> writer = make_unitig_writer(opt, nb_samples);
+
+        std::unique_ptr<AbundanceStoreWriter> index_writer;
+        if (opt->write_index) {
+            index_writer = std::make_unique<AbundanceStoreWriter>(index_abundance_path(opt->prefix), opt->kmer_size, kmer_dict.num_contigs(), nb_samples);
+        }
 
-    std::unique_ptr<Aggregator> aggregator;
-    if (opt->abundance_metric == "mean") {
-        spdlog::info(fmt::format("Computing mean ({}) for unitigs.", opt->abundance_metric));
-        aggregator = std::make_unique<MeanAggregator>(nb_samples, number_unitigs, opt->min_frac );
-    }
-    else { // median
-        spdlog::info(fmt::format("Computing median ({}) for unitigs.", opt->abundance_metric));
-        aggregator = std::make_unique<MedianAggregator>(nb_samples, number_unitigs, opt->min_frac );
+        klibpp::KSeq unitig;
+        klibpp::SeqStreamIn utg_ssi(unitig_path.c_str());
+
+        std::vector<double> utg_abundances(nb_samples);
+        std::vector<double> utg_fractions(nb_samples);
+        typename KmerRowIndex<count_type>::Row row;
+
+        // unitig rows are written as soon as they are aggregated
+        run_step(*opt, "aggregation", [&]() {
+            while (utg_ssi >> unitig) {
+                std::size_t utg_nb_kmers {unitig.seq.length() - opt->kmer_size + 1};
+                for_each_canonical_kmer(unitig.seq, opt->kmer_size, [&](kmer_key key, bool valid) {
+                    if (valid && index.find(key, row)) {
+                        aggregator.process_kmer(row.sample_ids, row.counts, row.size);
+                    }
+                });
+                aggregator.finish_unitig(utg_nb_kmers, utg_abundances, utg_fractions);
+
+                std::string utg_identifier {opt->write_seq ? unitig.seq : unitig.name};
+                writer->write_row(utg_identifier, utg_abundances, utg_fractions);
+                if (index_writer) { index_writer->write_row(utg_abundances); }
+            }
+
+            if (index_writer) { index_writer->close(); }
+        });
+        return 0;
     }
+};
 
-    while(has_kmer) {
-        auto res = kmer_dict.lookup_advanced(kmer.c_str());
-        if (res.kmer_id == sshash::constants::invalid_uint64) {
-            has_kmer = mat.read_kmer_counts(kmer,kmer_counts);
-            continue;
-        }
 
-        std::size_t utg_id = res.contig_id;
-        aggregator->process_kmer(utg_id, kmer_counts);
+int main_unitig(unitig_opt_t opt)
+{
+    // input validation
+    fs::path unitig_path = opt->inputs[0];
+    if(!fs::is_regular_file(unitig_path)) {
+        throw std::runtime_error(fmt::format("unitig file \"{}\" does not exist", unitig_path.c_str()));
+    }
+
+    fs::path matrix_path = opt->inputs[1];
+    if(!fs::is_regular_file(matrix_path)) {
+        throw std::runtime_error(fmt::format("k-mer matrix file \"{}\" does not exist", matrix_path.c_str()));
+    }
 
-        has_kmer = mat.read_kmer_counts(kmer,kmer_counts);
+    if(opt->mini_size >= opt->kmer_size) {
+        throw std::runtime_error("minimizer size must be smaller than k-mer size");
     }
 
-    spdlog::info("writing unitig matrix");
+    if(opt->engine != "kmer" && opt->engine != "unitig") {
+        throw std::runtime_error(fmt::format("unknown aggregation engine \"{}\", expected kmer or unitig", opt->engine));
+    }
 
-    std::unique_ptr<MatrixWriter> writer;
-    if (opt->output_format == "txt") {
-        // NORMAL TEXT FILE
-        writer = std::make_unique<TextMatrixWriter>(opt->prefix, opt->write_frac_matrix );
-    } else if (opt->output_format == "tsv") {
-        // TSV COMPRESSED FOR DOWNSTREAM IN MEMORY
-        writer = std::make_unique<CompressedTSVMatrixWriter>(opt->prefix, opt->write_frac_matrix, nb_samples);
-    } else {
-        // IF NOT RECOGNIZED DEFAULT TO TXT FOR BACKWARD COMPATIBILITY AND AVOID DISRUPTION
-        spdlog::info(fmt::format("OUTPUT FORMAT {} NOT RECOGNIZED. DEFAULT TO TXT.", opt->output_format));
-        writer = std::make_unique<TextMatrixWriter>(opt->prefix, opt->write_frac_matrix );
+    // the unitig engine needs the dictionary only for the index
+    sshash::dictionary kmer_dict;
+    if (opt->engine == "kmer" || opt->write_index) {
+        run_step(*opt, "sshash build", [&]() {
+            spdlog::info("building k-mer dictionary");
+
+            std::string sshash_logfile = fmt::format("{}.sshash.log", opt->prefix);
+            std::ofstream ofs(sshash_logfile, std::ios::out);
+            std::streambuf *coutbuf = std::cout.rdbuf();
+            if (ofs.good()) {
+              std::cout.rdbuf(ofs.rdbuf());
+            }
+
+            sshash::build_configuration build_config;
+            build_config.k = opt->kmer_size;
+            build_config.m = opt->mini_size;
+            build_config.c = 5.0;
+            build_config.pthash_threads = opt->nb_threads;
+            build_config.canonical_parsing = true;
+            build_config.verbose = false;
+            kmer_dict.build(unitig_path, build_config);
+
+            std::cout.rdbuf(coutbuf);
+
+            spdlog::debug(fmt::format("k-mer processed: {}", kmer_dict.size()));
+            spdlog::debug(fmt::format("unitigs processed: {}", kmer_dict.num_contigs()));
+        });
     }
 
-    klibpp::KSeq unitig;
-    klibpp::SeqStreamIn utg_ssi(unitig_path.c_str());
+    if (opt->write_index) {
+        std::string dict_path = index_dictionary_path(opt->prefix);
+        spdlog::info(fmt::format("writing unitig index {}", dict_path));
+        essentials::saver saver(dict_path.c_str());
+        kmer_dict.visit(saver);
+    }
 
-    std::vector<double> utg_abundances(nb_samples);
-    std::vector<double> utg_fractions(nb_samples);
+    spdlog::info(fmt::format("aggregating k-mer counts ({} engine)", opt->engine));
 
-    for(uint64_t utg_id=0; utg_ssi >> unitig; utg_id++) {
-        std::size_t utg_nb_kmers {unitig.seq.length() - opt->kmer_size + 1};
-        // FILL SAMPLES VECTOR WITH ABUNDANCE FRACTION FOR THE UTG
-        for (size_t idx {0}; idx < nb_samples; idx++){
-            auto [abundance, frac] = aggregator->get_abundance_fraction(utg_id, idx, utg_nb_kmers);
-            utg_abundances[idx] = abundance;
-            if (opt->write_frac_matrix) {utg_fractions[idx] = frac;}
-        }
-        // DUMP IT TO DISK
-        std::string utg_identifier {opt->write_seq ? unitig.seq : unitig.name};
-        writer->write_row(utg_identifier, utg_abundances, utg_fractions);
-        // REPEAT
+    if (opt->engine == "unitig") {
+        return count_width_exec<aggregate_unitigs_by_unitig>(opt->count_width, opt, kmer_dict, unitig_path, matrix_path);
     }
-    return 0;
+    return count_width_exec<aggregate_unitigs>(opt->count_width, opt, kmer_dict, unitig_path, matrix_path);
 }
 
 
@@ -148,10 +284,10 @@ kmat_opt_t unitig_cli(std::shared_ptr<bc::Parser<1>> cli, unitig_opt_t opt)
 
     unitig->add_group("main options", "");
 
-    unitig->add_param("-k/--kmer-size", fmt::format("k-mer size [8,{}].", KL[MUSET_KMER_N-1]-1))
+    unitig->add_param("-k/--kmer-size", fmt::format("k-mer size [8,{}].", unitig_max_k))
         ->meta("INT")
         ->def("31")
-        ->checker(bc::check::f::range(8, KL[MUSET_KMER_N-1]-1))
+        ->checker(bc::check::f::range(8, unitig_max_k))
         ->setter(opt->kmer_size);
 
     unitig->add_param("-p/--prefix", "output files prefix.")
@@ -173,6 +309,10 @@ kmat_opt_t unitig_cli(std::shared_ptr<bc::Parser<1>> cli, unitig_opt_t opt)
         ->as_flag()
         ->setter(opt->write_seq);
 
+    unitig->add_param("--index", "also write a unitig index (<prefix>.index.sshash and <prefix>.index.abundance) for muset query.")
+        ->as_flag()
+        ->setter(opt->write_index);
+
     unitig->add_group("other options", "");
 
     unitig->add_param("-m/--minimizer-size", "minimizer size")
@@ -192,6 +332,18 @@ kmat_opt_t unitig_cli(std::shared_ptr<bc::Parser<1>> cli, unitig_opt_t opt)
     ->checker(bc::check::f::in("mean|median"))
     ->setter(opt->abundance_metric);
 
+    unitig->add_param("-w/--count-width", "bits per count, larger counts saturate: 8, 16 or 32.")
+    ->meta("INT")
+    ->def("32")
+    ->checker(bc::check::f::in("8|16|32"))
+    ->setter(opt->count_width);
+
+    unitig->add_param("--engine", "aggregation engine: 'kmer' looks each matrix k-mer up in the unitigs and holds per-unitig accumulators, 'unitig' holds the k-mer matrix in memory and aggregates one unitig at a time.")
+    ->meta("STRING")
+    ->def("kmer")
+    ->checker(bc::check::f::in("kmer|unitig"))
+    ->setter(opt->engine);
+
     unitig->add_param("--output-format", "Output format can be either 'txt' or 'tsv' (tsv is gzip compressed).")
     ->meta("STRING")
     ->def("txt") // Default to txt for backward compatibility
@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <sstream>
@@ -22,6 +23,7 @@
 #include <kmat_tools/utils.h>
 
 #include "muset_cli.h"
+#include "muset_report.h"
 
 
 void init_logger(const fs::path &dir) {
@@ -54,6 +56,9 @@ void print_options(muset::muset_options_t opt) {
     spdlog::info(fmt::format("output unitig fraction matrix (--out-frac): {}", opt->write_frac_matrix));
     spdlog::info(fmt::format("input consists of logan unitigs (--logan): {}", opt->logan));
     spdlog::info(fmt::format("minimizer size (-m): {}", opt->mini_size));
+    spdlog::info(fmt::format("count width (--count-width): {}", opt->count_width));
+    spdlog::info(fmt::format("unitig engine (--unitig-engine): {}", opt->unitig_engine));
+    spdlog::info(fmt::format("write unitig index (--index): {}", opt->write_index));
 
     if(opt->min_nb_absent_set) {
         spdlog::info(fmt::format("number of absent samples (-n): {}", opt->min_nb_absent));
@@ -70,7 +75,33 @@ void print_options(muset::muset_options_t opt) {
     spdlog::info(fmt::format("threads (-t): {}", opt->nb_threads));
 }
 
-void kmtricks_pipeline(muset::muset_options_t muset_opt) {
+// Size of a file, or of the files under a directory (kmtricks run directory)
+uint64_t path_bytes(const fs::path& path) {
+    std::error_code ec;
+    if (fs::is_regular_file(path, ec)) { return fs::file_size(path, ec); }
+    uint64_t bytes{0};
+    if (fs::is_directory(path, ec)) {
+        for (const auto& entry : fs::recursive_directory_iterator(path, ec)) {
+            if (entry.is_regular_file(ec)) { bytes += entry.file_size(ec); }
+        }
+    }
+    return bytes;
+}
+
+// Number of k-mers of a kmat fasta output, read from its last header (records are numbered from 1)
+uint64_t fasta_kmer_count(const fs::path& fasta) {
+    std::ifstream ifs(fasta, std::ios::binary | std::ios::ate);
+    std::streamoff size = ifs.tellg();
+    if (!ifs.good() || size <= 0) { return 0; }
+    std::streamoff start = std::max<std::streamoff>(0, size - 512);
+    std::string tail(size - start, '\0');
+    ifs.seekg(start);
+    ifs.read(tail.data(), tail.size());
+    size_t header = tail.rfind('>');
+    return header == std::string::npos ? 0 : std::strtoull(tail.c_str() + header + 1, nullptr, 10);
+}
+
+void kmtricks_pipeline(muset::muset_options_t muset_opt, muset::StageReport& report) {
 
     // set kmtricks pipeline options
     auto kmtricks_opt = std::make_shared<km::all_options>();
@@ -79,6 +110,10 @@ void kmtricks_pipeline(muset::muset_options_t muset_opt) {
     kmtricks_opt->kmer_size = muset_opt->kmer_size; // --kmer-size
     kmtricks_opt->c_ab_min = muset_opt->min_abundance; // --hard-min
     kmtricks_opt->lz4 = muset_opt->lz4; // --cpr
+    kmtricks_opt->sparse = muset_opt->sparse;
+    kmtricks_opt->numa = muset_opt->numa;
+    kmtricks_opt->merge_fanin = muset_opt->merge_fanin;
+    kmtricks_opt->io_engine = muset_opt->io_engine;
     kmtricks_opt->r_min = muset_opt->min_nb_absent; // --recurrence-min
     kmtricks_opt->logan = muset_opt->logan; // --logan
     kmtricks_opt->nb_threads = muset_opt->nb_threads; // --treads
@@ -96,6 +131,7 @@ void kmtricks_pipeline(muset::muset_options_t muset_opt) {
     kmtricks_opt->bwidth = 2;
     kmtricks_opt->out_format = km::OUT_FORMAT::HOWDE;
     kmtricks_opt->verbosity = "info";
+    kmtricks_opt->step_runner = [&report](const std::string& name, const std::function<void()>& step) { report.run(name, step); };
 
     km::const_loop_executor<0, KMER_N>::exec<km::main_all>(kmtricks_opt->kmer_size, kmtricks_opt);
 }
@@ -112,6 +148,7 @@ void kmat_filter(muset::muset_options_t muset_opt) {
     filter_opt->min_nb_absent = muset_opt->min_nb_absent;
     filter_opt->min_nb_present_set = muset_opt->min_nb_present_set;
     filter_opt->min_nb_present = muset_opt->min_nb_present;
+    filter_opt->count_width = muset_opt->count_width;
 
     filter_opt->keep_tmp = muset_opt->keep_tmp;
     filter_opt->lz4 = muset_opt->lz4;
@@ -173,7 +210,7 @@ void kmat_fafmt(muset::muset_options_t muset_opt) {
     kmat::main_fafmt(fafmt_opt);
 }
 
-void kmat_unitig(muset::muset_options_t muset_opt) {
+void kmat_unitig(muset::muset_options_t muset_opt, muset::StageReport& report) {
 
     auto unitig_opt = std::make_shared<kmat::unitig_options>();
 
@@ -186,6 +223,10 @@ void kmat_unitig(muset::muset_options_t muset_opt) {
     unitig_opt->nb_threads = muset_opt->nb_threads;
     unitig_opt->output_format = muset_opt->output_format;
     unitig_opt->abundance_metric = muset_opt->abundance_metric;
+    unitig_opt->count_width = muset_opt->count_width;
+    unitig_opt->write_index = muset_opt->write_index;
+    unitig_opt->engine = muset_opt->unitig_engine;
+    unitig_opt->step_runner = [&report](const std::string& name, const std::function<void()>& step) { report.run(name, step); };
 
     (unitig_opt->inputs).push_back(muset_opt->filtered_unitigs);
     (unitig_opt->inputs).push_back(muset_opt->filtered_matrix);
@@ -195,9 +236,27 @@ void kmat_unitig(muset::muset_options_t muset_opt) {
 
 int main(int argc, char* argv[])
 {
+    if (argc > 1 && muset::is_index_command(argv[1])) {
+        muset::musetCommandCli command_cli("muset", "query sequences against a muset unitig index.", PROJECT_VER, "");
+        std::string command = command_cli.parse(argc, argv);
+        try
+        {
+            if (command == "query") { return muset::main_query(command_cli.query_opt); }
+            if (command == "serve") { return muset::main_serve(command_cli.serve_opt); }
+            return muset::main_client(command_cli.client_opt);
+        }
+        catch (const std::exception& e) {
+            spdlog::error(e.what());
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
     muset::musetCli cli("muset", "a pipeline for building an abundance unitig matrix from a list of FASTA/FASTQ files.", PROJECT_VER, "");
     auto muset_opt = cli.parse(argc, argv);
 
+    muset::StageReport report;
+    fs::path report_path;
+
     try
     {
         // check ggcat dependency
@@ -224,6 +283,14 @@ int main(int argc, char* argv[])
         print_options(muset_opt);
         spdlog::info("---------------");
 
+        // stage timings and resources, written on success and on failure
+        report_path = muset_opt->out_dir/"muset_report.json";
+        std::string command_line;
+        for (int i = 0; i < argc; i++) { command_line += (i ? " " : "") + std::string(argv[i]); }
+        report.set_info("muset_version", PROJECT_VER);
+        report.set_info("command", command_line);
+        report.set_info("threads", std::to_string(muset_opt->nb_threads));
+
         // muset pipeline
 
         if(!muset_opt->fof.empty()) {
@@ -233,7 +300,8 @@ int main(int argc, char* argv[])
             if(fs::is_directory(muset_opt->kmer_matrix)) {
                 throw std::runtime_error(fmt::format("kmtricks output directory \"{}\" already exists.", (muset_opt->kmer_matrix).c_str()));
             }
-            kmtricks_pipeline(muset_opt);
+            report.run("kmtricks", [&]() { kmtricks_pipeline(muset_opt, report); });
+            report.add_counter("kmtricks", "output_bytes", path_bytes(muset_opt->kmer_matrix));
         } else {
             // use an input text matrix or a previous kmtricks directory
             spdlog::info(fmt::format("Using input k-mer matrix: {}", (muset_opt->in_matrix).c_str()));
@@ -265,11 +333,18 @@ int main(int argc, char* argv[])
 
         spdlog::info(fmt::format("Filtering k-mer matrix"));
         muset_opt->filtered_matrix = muset_opt->out_dir/"matrix.filtered.mat";
-        kmat_filter(muset_opt);
+        report.run("filter", [&]() { kmat_filter(muset_opt); });
+        report.add_counter("filter", "input_bytes", path_bytes(muset_opt->kmer_matrix));
+        report.add_counter("filter", "output_bytes", path_bytes(muset_opt->filtered_matrix));
 
         spdlog::info(fmt::format("Writing k-mers in FASTA format"));
         muset_opt->filtered_kmers = muset_opt->out_dir/"matrix.filtered.fasta";
-        kmat_fasta(muset_opt);
+        report.run("fasta", [&]() { kmat_fasta(muset_opt); });
+        uint64_t nb_kmers = fasta_kmer_count(muset_opt->filtered_kmers);
+        report.add_counter("filter", "kmers", nb_kmers);
+        report.add_counter("fasta", "kmers", nb_kmers);
+        report.add_counter("fasta", "input_bytes", path_bytes(muset_opt->filtered_matrix));
+        report.add_counter("fasta", "output_bytes", path_bytes(muset_opt->filtered_kmers));
 
         if(fs::is_empty(muset_opt->filtered_kmers)) {
             muset_opt->remove_temp_files();
@@ -278,11 +353,16 @@ int main(int argc, char* argv[])
 
         spdlog::info(fmt::format("Building unitigs"));
         muset_opt->unitigs = muset_opt->out_dir/"unitigs";
-        ggcat(muset_opt);
+        report.run("ggcat", [&]() { ggcat(muset_opt); });
+        report.add_counter("ggcat", "kmers", nb_kmers);
+        report.add_counter("ggcat", "input_bytes", path_bytes(muset_opt->filtered_kmers));
+        report.add_counter("ggcat", "output_bytes", path_bytes(muset_opt->unitigs));
 
         spdlog::info(fmt::format("Filtering unitigs"));
         muset_opt->filtered_unitigs = muset_opt->out_dir/"unitigs.fa";
-        kmat_fafmt(muset_opt);
+        report.run("fafmt", [&]() { kmat_fafmt(muset_opt); });
+        report.add_counter("fafmt", "input_bytes", path_bytes(muset_opt->unitigs));
+        report.add_counter("fafmt", "output_bytes", path_bytes(muset_opt->filtered_unitigs));
 
         if(fs::is_empty(muset_opt->filtered_unitigs)) {
             muset_opt->remove_temp_files();
@@ -291,17 +371,24 @@ int main(int argc, char* argv[])
 
         spdlog::info(fmt::format("Building unitig matrix"));
         muset_opt->unitig_prefix = muset_opt->out_dir/"unitigs";
-        kmat_unitig(muset_opt);
+        report.run("unitig", [&]() { kmat_unitig(muset_opt, report); });
+        report.add_counter("unitig", "kmers", nb_kmers);
+        report.add_counter("unitig", "input_bytes", path_bytes(muset_opt->filtered_unitigs) + path_bytes(muset_opt->filtered_matrix));
 
         spdlog::debug(fmt::format("Removing temporary files"));
         muset_opt->remove_temp_files();
+
+        report.write(report_path, "success");
+        spdlog::info(fmt::format("stage report written to {}", report_path.c_str()));
     }
     catch (const km::km_exception& e) {
         spdlog::error("{} - {}", e.get_name(), e.get_msg());
+        if (!report_path.empty()) { report.write(report_path, fmt::format("{} - {}", e.get_name(), e.get_msg())); }
         std::exit(EXIT_FAILURE);
     }
     catch (const std::exception& e) {
         spdlog::error(e.what());
+        if (!report_path.empty()) { report.write(report_path, e.what()); }
         std::exit(EXIT_FAILURE);
     }
 
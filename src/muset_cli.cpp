@@ -109,6 +109,18 @@ muset_options_t muset_cli(std::shared_ptr<bc::Parser<0>> cli, muset_options_t op
         ->checker(bc::check::f::in("mean|median"))
         ->setter(options->abundance_metric);
 
+    cli->add_param("--unitig-engine", "unitig aggregation: [kmer,unitig], unitig holds the filtered k-mer matrix in memory instead of per-unitig accumulators. {kmer}")
+        ->meta("STRING")
+        ->def("kmer")
+        ->checker(bc::check::f::in("kmer|unitig"))
+        ->setter(options->unitig_engine);
+
+    cli->add_param("--count-width", "bits per count when aggregating unitigs, larger values saturate: [8,16,32]. {32}")
+        ->meta("INT")
+        ->def("32")
+        ->checker(bc::check::f::in("8|16|32"))
+        ->setter(options->count_width);
+
     cli->add_param("--output-format", "output format can be either [txt, tsv.gz]. {txt}")
         ->meta("STRING")
         ->def("txt") // Default to txt for backward compatibility
@@ -119,6 +131,10 @@ muset_options_t muset_cli(std::shared_ptr<bc::Parser<0>> cli, muset_options_t op
         ->as_flag()
         ->setter(options->logan);
 
+    cli->add_param("--index", "also write a unitig index (unitigs.index.*) for muset query.")
+        ->as_flag()
+        ->setter(options->write_index);
+
     cli->add_param("-e/--generate-maximal-unitigs-links", "ggcat generates maximal unitigs connections references, in BCALM2 format L:<+/->:<other id>:<+/->")
         ->as_flag()
         ->setter(options->unitig_edges);
@@ -165,6 +181,26 @@ muset_options_t muset_cli(std::shared_ptr<bc::Parser<0>> cli, muset_options_t op
         ->as_flag()
         ->setter(options->keep_tmp);
 
+    cli->add_param("--sparse-matrix", "store the k-mer matrix with sparse rows (smaller when most k-mers are in few samples).")
+        ->as_flag()
+        ->setter(options->sparse);
+
+    cli->add_param("--numa", "pin the k-mer counting and merging threads to NUMA nodes, each partition being counted and merged on one node (KMTRICKS_NUMA_NODES=<n> emulates n nodes).")
+        ->as_flag()
+        ->setter(options->numa);
+
+    cli->add_param("--merge-fanin", "maximum number of sample files merged at once per partition, more samples being merged through intermediate runs (0: derived from the open-file limit and the memory).")
+        ->meta("INT")
+        ->def("0")
+        ->checker(bc::check::is_number)
+        ->setter(options->merge_fanin);
+
+    cli->add_param("--io-engine", "I/O engine of the kmtricks partition files: fstream, pread (1 MiB blocks) or uring (1 MiB blocks, io_uring read-ahead and write-behind, fstream if not supported by the kernel). {fstream}")
+        ->meta("STRING")
+        ->def("fstream")
+        ->checker(bc::check::f::in("fstream|pread|uring"))
+        ->setter(options->io_engine);
+
     cli->add_param("-t/--threads", "number of threads.")
         ->meta("INT")
         ->def("4")
@@ -189,4 +225,151 @@ muset_options_t muset_cli(std::shared_ptr<bc::Parser<0>> cli, muset_options_t op
 }
 
 
+musetCommandCli::musetCommandCli(const std::string& name, const std::string& desc, const std::string& version, const std::string& authors) {
+    cli = std::make_shared<bc::Parser<1>>(name, desc, version, authors);
+    query_opt = std::make_shared<struct query_options>();
+    serve_opt = std::make_shared<struct serve_options>();
+    client_opt = std::make_shared<struct client_options>();
+    query_cli(cli, query_opt);
+    serve_cli(cli, serve_opt);
+    client_cli(cli, client_opt);
+}
+
+
+std::string musetCommandCli::parse(int argc, char* argv[])
+{
+    try
+    {
+        (*cli).parse(argc, argv);
+    }
+    catch (const bc::ex::BCliError& e)
+    {
+        if (!e.get_name().empty()) {
+            spdlog::error(fmt::format("[{}] {}\n\nFor more information try --help", e.get_name(), e.get_msg()));
+        }
+        std::exit(EXIT_FAILURE);
+    }
+
+    auto positionals = cli->get_positionals();
+    if (cli->is("query")) {
+        query_opt->index_prefix = positionals[0];
+        query_opt->queries = positionals[1];
+        return "query";
+    } else if (cli->is("serve")) {
+        serve_opt->index_prefix = positionals[0];
+        return "serve";
+    }
+    client_opt->queries = positionals[0];
+    return "client";
+}
+
+
+query_options_t query_cli(command_cli_t cli, query_options_t options) {
+
+    bc::cmd_t query = cli->add_command("query", "Query sequences against a unitig index written with --index.");
+
+    query->add_group("main options", "");
+
+    query->add_param("-o/--output", "output file, one line per query and sample with k-mer hits. {stdout}")
+        ->meta("FILE")
+        ->def("")
+        ->setter(options->output);
+
+    query->add_param("-t/--threads", "number of threads.")
+        ->meta("INT")
+        ->def("4")
+        ->checker(bc::check::is_number)
+        ->setter(options->nb_threads);
+
+    query->add_param("-b/--batch-size", "number of query sequences read at once and split between threads.")
+        ->meta("INT")
+        ->def("1024")
+        ->checker(bc::check::f::range(1, 1 << 24))
+        ->setter(options->batch_size);
+
+    query->add_param("-h/--help", "show this message and exit.")
+        ->as_flag()
+        ->action(bc::Action::ShowHelp);
+
+    query->add_param("-v/--version", "show version and exit.")
+        ->as_flag()
+        ->action(bc::Action::ShowVersion);
+
+    query->set_positionals(2, "<index_prefix> <queries>", "index prefix (e.g. <out_dir>/unitigs) and a FASTA/FASTQ file of queries");
+
+  return options;
+}
+
+
+serve_options_t serve_cli(command_cli_t cli, serve_options_t options) {
+
+    bc::cmd_t serve = cli->add_command("serve", "Answer queries on a Unix socket, keeping a unitig index in memory.");
+
+    serve->add_group("main options", "");
+
+    serve->add_param("-s/--socket", "path of the Unix domain socket.")
+        ->meta("FILE")
+        ->def("muset.sock")
+        ->setter(options->socket);
+
+    serve->add_param("-t/--threads", "number of worker threads, each answering one request at a time.")
+        ->meta("INT")
+        ->def("4")
+        ->checker(bc::check::is_number)
+        ->setter(options->nb_threads);
+
+    serve->add_param("-h/--help", "show this message and exit.")
+        ->as_flag()
+        ->action(bc::Action::ShowHelp);
+
+    serve->add_param("-v/--version", "show version and exit.")
+        ->as_flag()
+        ->action(bc::Action::ShowVersion);
+
+    serve->set_positionals(1, "<index_prefix>", "index prefix (e.g. <out_dir>/unitigs)");
+
+  return options;
+}
+
+
+client_options_t client_cli(command_cli_t cli, client_options_t options) {
+
+    bc::cmd_t client = cli->add_command("client", "Send queries to a muset serve instance, with the output of muset query.");
+
+    client->add_group("main options", "");
+
+    client->add_param("-s/--socket", "path of the Unix domain socket.")
+        ->meta("FILE")
+        ->def("muset.sock")
+        ->setter(options->socket);
+
+    client->add_param("-o/--output", "output file. {stdout}")
+        ->meta("FILE")
+        ->def("")
+        ->setter(options->output);
+
+    client->add_param("-b/--batch-size", "number of query sequences per request.")
+        ->meta("INT")
+        ->def("64")
+        ->checker(bc::check::f::range(1, 1 << 24))
+        ->setter(options->batch_size);
+
+    client->add_param("--stats", "log the server request and latency metrics after the queries.")
+        ->as_flag()
+        ->setter(options->print_stats);
+
+    client->add_param("-h/--help", "show this message and exit.")
+        ->as_flag()
+        ->action(bc::Action::ShowHelp);
+
+    client->add_param("-v/--version", "show version and exit.")
+        ->as_flag()
+        ->action(bc::Action::ShowVersion);
+
+    client->set_positionals(1, "<queries>", "a FASTA/FASTQ file of queries");
+
+  return options;
+}
+
+
 };
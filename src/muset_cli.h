@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <algorithm>
 #include <bcli/bcli.hpp>
@@ -49,12 +50,19 @@ struct muset_options
 
     bool keep_tmp{false};
     bool lz4{true};
+    bool sparse{false};
+    bool numa{false};
+    int merge_fanin{0};
+    std::string io_engine{"fstream"};
     bool logan{false};
     bool unitig_edges{false};
+    bool write_index{false};
 
     int nb_threads{1};
 
     fs::path abundance_metric;
+    std::string unitig_engine{"kmer"};
+    uint32_t count_width{32};
 
     // intermediate (temporary) files, defined along the pipeline
 
@@ -124,4 +132,75 @@ private:
 
 muset_options_t muset_cli(std::shared_ptr<bc::Parser<0>> cli, muset_options_t options);
 
+
+// muset query|serve|client, the index commands, parsed by their own parser
+
+using query_options_t = std::shared_ptr<struct query_options>;
+using serve_options_t = std::shared_ptr<struct serve_options>;
+using client_options_t = std::shared_ptr<struct client_options>;
+using command_cli_t = std::shared_ptr<bc::Parser<1>>;
+
+struct query_options
+{
+    std::string index_prefix;
+    std::string queries;
+    fs::path output;
+
+    int nb_threads{1};
+    uint32_t batch_size{1024};
+};
+
+struct serve_options
+{
+    std::string index_prefix;
+    std::string socket;
+
+    int nb_threads{1};
+};
+
+struct client_options
+{
+    std::string queries;
+    std::string socket;
+    fs::path output;
+
+    uint32_t batch_size{64};
+    bool print_stats{false};
+};
+
+
+class musetCommandCli
+{
+
+public:
+    musetCommandCli(
+        const std::string& name,
+        const std::string& desc,
+        const std::string& version,
+        const std::string& authors
+    );
+
+    // returns the name of the command, whose options are then set
+    std::string parse(int argc, char* argv[]);
+
+    query_options_t query_opt{nullptr};
+    serve_options_t serve_opt{nullptr};
+    client_options_t client_opt{nullptr};
+
+private:
+    command_cli_t cli{nullptr};
+};
+
+inline bool is_index_command(const std::string& arg) {
+    return arg == "query" || arg == "serve" || arg == "client";
+}
+
+query_options_t query_cli(command_cli_t cli, query_options_t options);
+serve_options_t serve_cli(command_cli_t cli, serve_options_t options);
+client_options_t client_cli(command_cli_t cli, client_options_t options);
+
+int main_query(query_options_t opt);
+int main_serve(serve_options_t opt);
+int main_client(client_options_t opt);
+
 };  // namespace km
@@ -14,6 +14,7 @@
 
 #include <kmat_tools/cmd/convert.h>
 #include <kmat_tools/cmd/fafmt.h>
+#include <kmat_tools/ggcat.h>
 
 #include "muset_pa_cli.h"
 
@@ -44,8 +45,10 @@ void print_options(muset::muset_pa_options_t opt) {
     spdlog::info(fmt::format("minimum unitig fraction set (-r): {}", opt->min_utg_frac_set));
     if(opt->min_utg_frac_set) { spdlog::info(fmt::format("minimum unitig fraction threshold (-r): {}", opt->min_utg_frac)); }
     spdlog::info(fmt::format("write unitig sequence (-s): {}", opt->write_utg_seq));
+    spdlog::info(fmt::format("output format (--output-format): {}", opt->output_format));
     spdlog::info(fmt::format("minimizer size (-m): {}", opt->mini_size));
 
+    spdlog::info(fmt::format("run ggcat query (--ggcat-query): {}", opt->ggcat_query));
     spdlog::info(fmt::format("keep temporary files (--keep-temp): {}", opt->keep_tmp));
     spdlog::info(fmt::format("threads (-t): {}", opt->nb_threads));
 }
@@ -129,7 +132,10 @@ void kmat_convert(muset::muset_pa_options_t opt) {
     // convert_opt->no_header = true;
     convert_opt->no_header = true;
     convert_opt->out_csv = false;
+    convert_opt->output_format = opt->output_format;
+    convert_opt->from_annotations = opt->from_annotations;
     convert_opt->out_fname = opt->unitig_matrix;
+    convert_opt->nb_threads = opt->nb_threads;
 
     (convert_opt->inputs).push_back(opt->filtered_unitigs);
     (convert_opt->inputs).push_back(opt->colors_json);
@@ -187,11 +193,26 @@ int main(int argc, char* argv[])
             throw std::runtime_error("No unitig retained to build the output matrix (filters were probably too strict).");
         }
 
-        opt->query_json = opt->out_dir/"unitigs.query.jsonl";
-        ggcat_query(opt);
+        // The unitigs are their own queries: when the dump lists the color subsets, the
+        // fractions follow from the C:<subset>:<count> annotations without a ggcat query pass
+        opt->from_annotations = !opt->ggcat_query && kmat::ggcat_dump_has_subsets(opt->colors_json);
+        if (opt->from_annotations) {
+            spdlog::info(fmt::format("Computing color fractions from unitig annotations"));
+        } else {
+            opt->query_json = opt->out_dir/"unitigs.query.jsonl";
+            ggcat_query(opt);
+        }
 
         spdlog::info(fmt::format("Building unitig matrix"));
-        opt->unitig_matrix = opt->out_dir/"unitigs.mat";
+        if (opt->output_format == "coo") {
+            opt->unitig_matrix = opt->out_dir/"unitigs.coo.txt";
+        } else if (opt->output_format == "csr") {
+            opt->unitig_matrix = opt->out_dir/"unitigs.csr";
+        } else if (opt->output_format == "bit") {
+            opt->unitig_matrix = opt->out_dir/"unitigs.bit";
+        } else {
+            opt->unitig_matrix = opt->out_dir/"unitigs.mat";
+        }
         kmat_convert(opt);
     }
     catch (const km::km_exception& e) {
@@ -96,6 +96,12 @@ muset_pa_options_t muset_pa_cli(muset_pa_cli_t cli, muset_pa_options_t options)
         ->as_flag()
         ->setter(options->write_utg_seq);
 
+    cli->add_param("--output-format", "output matrix format: txt (dense), coo (sparse text triplets), csr (sparse binary with a .idx index) or bit (bit-packed, requires -r).")
+        ->meta("STRING")
+        ->def("txt")
+        ->checker(bc::check::f::in("txt|coo|csr|bit"))
+        ->setter(options->output_format);
+
     /*** OTHER OPTIONS ***/
 
     cli->add_group("other options", "");
@@ -104,6 +110,10 @@ muset_pa_options_t muset_pa_cli(muset_pa_cli_t cli, muset_pa_options_t options)
     //     ->as_flag()
     //     ->setter(options->keep_tmp);
 
+    cli->add_param("--ggcat-query", "compute unitig color fractions with a ggcat query pass instead of the unitig annotations.")
+        ->as_flag()
+        ->setter(options->ggcat_query);
+
     cli->add_param("-t/--threads", "number of threads.")
         ->meta("INT")
         ->def("4")
@@ -30,7 +30,9 @@ struct muset_pa_options
     double min_utg_frac{0.8};
 
     bool write_utg_seq{false};
+    std::string output_format{"txt"};
     bool keep_tmp{false};
+    bool ggcat_query{false};
     int nb_threads{1};
 
     // intermediate files, not actual input parameters
@@ -40,6 +42,7 @@ struct muset_pa_options
     fs::path query_json;
     fs::path colors_json;
     fs::path unitig_matrix;
+    bool from_annotations{false};
 
     void sanity_check()
     {
@@ -50,6 +53,10 @@ struct muset_pa_options
         if (mini_size >= kmer_size) {
             throw std::runtime_error("minimizer size must be smaller than k-mer size");
         }
+
+        if (output_format == "bit" && !min_utg_frac_set) {
+            throw std::runtime_error("--output-format bit requires a presence-absence matrix (-r)");
+        }
     }
 };
 
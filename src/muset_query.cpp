@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <kseq++/seqio.hpp>
+
+#include "muset_cli.h"
+#include "muset_query.h"
+
+
+namespace muset {
+
+void UnitigIndex::load(const std::string& prefix)
+{
+    std::string dict_path = kmat::index_dictionary_path(prefix);
+    std::string store_path = kmat::index_abundance_path(prefix);
+    if (!fs::is_regular_file(dict_path) || !fs::is_regular_file(store_path)) {
+        throw std::runtime_error(fmt::format("no unitig index with prefix \"{}\" (expected {} and {})", prefix, dict_path, store_path));
+    }
+
+    {
+        essentials::loader loader(dict_path.c_str());
+        dict.visit(loader);
+    }
+    store = std::make_unique<kmat::AbundanceStore>(store_path);
+
+    if (!dict.canonicalized() || dict.k() != store->header().kmer_size || dict.num_contigs() != store->nb_unitigs()) {
+        throw std::runtime_error(fmt::format("{} and {} do not belong to the same index", dict_path, store_path));
+    }
+}
+
+UnitigQuery::UnitigQuery(const UnitigIndex& index)
+  : m_index(index), m_query(&index.dict),
+    m_abundance(index.store->nb_samples(), 0), m_nb_kmers(index.store->nb_samples(), 0) {}
+
+// Stream the k-mers of the sequence through the dictionary. Consecutive k-mers mostly hit
+// the same unitig, its abundance row is added once per run.
+void UnitigQuery::query(std::string_view name, std::string_view seq, fmt::memory_buffer& out)
+{
+    const uint64_t k = m_index.dict.k();
+    const uint64_t nb_kmers = seq.size() >= k ? seq.size() - k + 1 : 0;
+
+    uint64_t run_unitig = sshash::constants::invalid_uint64;
+    uint64_t run_length = 0;
+    auto add_run = [&]() {
+        if (run_length == 0) { return; }
+        auto row = m_index.store->row(run_unitig);
+        for (uint64_t j = 0; j < row.size; j++) {
+            uint32_t s = row.samples[j];
+            if (m_nb_kmers[s] == 0) { m_samples.push_back(s); }
+            m_nb_kmers[s] += run_length;
+            m_abundance[s] += run_length * static_cast<double>(row.abundances[j]);
+        }
+        run_length = 0;
+    };
+
+    m_query.start();
+    for (uint64_t i = 0; i < nb_kmers; i++) {
+        auto res = m_query.lookup_advanced(seq.data() + i);
+        if (res.kmer_id == sshash::constants::invalid_uint64) { continue; }
+        stats.nb_positive_kmers++;
+        if (res.contig_id != run_unitig) {
+            add_run();
+            run_unitig = res.contig_id;
+        }
+        run_length++;
+    }
+    add_run();
+
+    std::sort(m_samples.begin(), m_samples.end());
+    for (auto s : m_samples) {
+        fmt::format_to(std::back_inserter(out), "{}\t{}\t{:.2f}\t{:.4f}\n", name, s,
+                       m_abundance[s] / m_nb_kmers[s], static_cast<double>(m_nb_kmers[s]) / nb_kmers);
+        m_abundance[s] = 0;
+        m_nb_kmers[s] = 0;
+    }
+    m_samples.clear();
+
+    stats.nb_queries++;
+    stats.nb_kmers += nb_kmers;
+}
+
+int main_query(query_options_t opt)
+{
+    if (!fs::is_regular_file(opt->queries)) {
+        throw std::runtime_error(fmt::format("query file \"{}\" does not exist", opt->queries));
+    }
+
+    spdlog::info(fmt::format("loading unitig index {}", opt->index_prefix));
+    UnitigIndex index;
+    index.load(opt->index_prefix);
+    spdlog::info(fmt::format("{} unitigs, {} samples, k={}", index.store->nb_unitigs(), index.store->nb_samples(), index.dict.k()));
+
+    std::ostream* fpout = &std::cout;
+    std::ofstream ofs;
+    if(!(opt->output).empty()) {
+        ofs.open((opt->output).c_str());
+        if(!ofs.good()) { throw std::runtime_error(fmt::format("cannot open {}", opt->output.c_str())); }
+        fpout = &ofs;
+    }
+    *fpout << "query\tsample\tabundance\tkmer_fraction\n";
+
+    // Each batch of queries is split into nb_threads slices, each thread owns its query
+    // state and output buffer; the buffers are written in query order.
+    size_t nb_threads = std::max(opt->nb_threads, 1);
+    std::vector<std::unique_ptr<UnitigQuery>> queries;
+    for (size_t t = 0; t < nb_threads; t++) { queries.push_back(std::make_unique<UnitigQuery>(index)); }
+    std::vector<fmt::memory_buffer> buffers(nb_threads);
+
+    klibpp::KSeq record;
+    klibpp::SeqStreamIn ssi(opt->queries.c_str());
+    std::vector<klibpp::KSeq> batch;
+    batch.reserve(opt->batch_size);
+
+    bool more = true;
+    while (more) {
+        batch.clear();
+        while (batch.size() < opt->batch_size && (more = static_cast<bool>(ssi >> record))) {
+            batch.push_back(std::move(record));
+        }
+        if (batch.empty()) { break; }
+
+        size_t slice = (batch.size() + nb_threads - 1) / nb_threads;
+        std::vector<std::future<void>> pending;
+        for (size_t t = 0; t < nb_threads && t * slice < batch.size(); t++) {
+            pending.push_back(std::async(std::launch::async, [&, t]() {
+                buffers[t].clear();
+                for (size_t i = t * slice; i < std::min(batch.size(), (t + 1) * slice); i++) {
+                    queries[t]->query(batch[i].name, batch[i].seq, buffers[t]);
+                }
+            }));
+        }
+        for (size_t t = 0; t < pending.size(); t++) {
+            pending[t].get();
+            fpout->write(buffers[t].data(), buffers[t].size());
+        }
+    }
+
+    query_stats total;
+    for (const auto& query : queries) { total.add(query->stats); }
+    spdlog::info(fmt::format("{} queries, {} k-mers, {} found in the index", total.nb_queries, total.nb_kmers, total.nb_positive_kmers));
+
+    if(!(opt->output).empty()) {
+        ofs.close();
+    }
+
+    return 0;
+}
+
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "../external/sshash/dictionary.hpp"
+#include "../external/sshash/query/streaming_query_canonical_parsing.hpp"
+
+#include <kmat_tools/unitig_index.h>
+
+
+namespace muset {
+
+// Unitig index written by --index: the sshash dictionary and the abundance store, loaded
+// once and shared read-only by the query threads
+struct UnitigIndex
+{
+    sshash::dictionary dict;
+    std::unique_ptr<kmat::AbundanceStore> store;
+
+    void load(const std::string& prefix);
+};
+
+struct query_stats
+{
+    uint64_t nb_queries{0};
+    uint64_t nb_kmers{0};
+    uint64_t nb_positive_kmers{0};
+
+    void add(const query_stats& other) {
+        nb_queries += other.nb_queries;
+        nb_kmers += other.nb_kmers;
+        nb_positive_kmers += other.nb_positive_kmers;
+    }
+};
+
+// Query state of one thread: the sshash streaming query and per-sample hit counters
+class UnitigQuery
+{
+  public:
+    UnitigQuery(const UnitigIndex& index);
+
+    // Append one "query sample abundance kmer_fraction" line per sample with hits
+    void query(std::string_view name, std::string_view seq, fmt::memory_buffer& out);
+
+    query_stats stats;
+
+  private:
+    const UnitigIndex& m_index;
+    sshash::streaming_query_canonical_parsing m_query;
+
+    std::vector<double> m_abundance; // sum of the unitig abundances of the hit k-mers
+    std::vector<uint64_t> m_nb_kmers; // number of k-mers hitting a unitig present in the sample
+    std::vector<uint32_t> m_samples; // samples with at least one hit
+};
+
+};
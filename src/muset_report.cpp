@@ -0,0 +1,183 @@
+#include <cmath>
+#include <fstream>
+#include <string>
+
+#include <sys/resource.h>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <nlohmann/json.hpp>
+
+#include "muset_report.h"
+
+
+namespace muset {
+
+static double to_seconds(const timeval& tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static uint64_t maxrss_bytes(const rusage& usage) {
+#if __APPLE__
+    return usage.ru_maxrss;
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+// VmHWM of /proc/self/status, 0 when not available
+static uint64_t proc_peak_rss()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+    return 0;
+}
+
+ResourceUsage ResourceUsage::now()
+{
+    ResourceUsage usage;
+    rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    usage.user_s = to_seconds(self.ru_utime);
+    usage.sys_s = to_seconds(self.ru_stime);
+    usage.children_user_s = to_seconds(children.ru_utime);
+    usage.children_sys_s = to_seconds(children.ru_stime);
+    usage.children_peak_rss = maxrss_bytes(children);
+    usage.peak_rss = proc_peak_rss();
+    if (usage.peak_rss == 0) { usage.peak_rss = maxrss_bytes(self); }
+
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value;
+    while (io >> key >> value) {
+        if (key == "rchar:") { usage.rchar = value; }
+        else if (key == "wchar:") { usage.wchar = value; }
+        else if (key == "read_bytes:") { usage.read_bytes = value; }
+        else if (key == "write_bytes:") { usage.write_bytes = value; }
+    }
+    return usage;
+}
+
+// fixed number of decimals in the report
+static double round_to(double value, int decimals)
+{
+    double scale = std::pow(10.0, decimals);
+    return std::round(value * scale) / scale;
+}
+
+void StageReport::run(const std::string& name, const std::function<void()>& stage)
+{
+    Stage current;
+    current.name = m_open.empty() ? name : m_stages[m_open.back()].name + "/" + name;
+    current.depth = m_open.size();
+    current.start = ResourceUsage::now();
+    m_stages.push_back(current);
+    size_t index = m_stages.size() - 1;
+    m_open.push_back(index);
+
+    km::Timer timer;
+    auto finish = [&](bool completed) {
+        Stage& s = m_stages[index];
+        s.wall_s = timer.elapsed<std::chrono::microseconds>().count() / 1e6;
+        s.end = ResourceUsage::now();
+        s.completed = completed;
+        m_open.pop_back();
+        spdlog::debug(fmt::format("stage {}: {:.2f} s, peak RSS {:.1f} MB (+{:.1f} MB)", s.name, s.wall_s,
+                                  s.end.peak_rss / 1048576.0, (s.end.peak_rss - s.start.peak_rss) / 1048576.0));
+    };
+
+    try {
+        stage();
+    } catch (...) {
+        finish(false);
+        throw;
+    }
+    finish(true);
+}
+
+void StageReport::add_counter(const std::string& stage, const std::string& counter, uint64_t value)
+{
+    for (auto it = m_stages.rbegin(); it != m_stages.rend(); ++it) {
+        if (it->name == stage) {
+            it->counters[counter] = value;
+            return;
+        }
+    }
+}
+
+void StageReport::set_info(const std::string& key, const std::string& value)
+{
+    m_info.emplace_back(key, value);
+}
+
+void StageReport::write(const fs::path& path, const std::string& status)
+{
+    using json = nlohmann::ordered_json;
+
+    json report;
+    for (const auto& [key, value] : m_info) {
+        report[key] = value;
+    }
+    report["status"] = status;
+    report["wall_s"] = round_to(m_timer.elapsed<std::chrono::microseconds>().count() / 1e6, 3);
+    report["peak_rss_bytes"] = ResourceUsage::now().peak_rss;
+
+    json stages = json::array();
+    for (const Stage& s : m_stages) {
+        const ResourceUsage& a = s.start;
+        const ResourceUsage& b = s.end;
+        double user_s = b.user_s - a.user_s;
+        double sys_s = b.sys_s - a.sys_s;
+        double children_cpu_s = (b.children_user_s - a.children_user_s) + (b.children_sys_s - a.children_sys_s);
+
+        json stage;
+        stage["name"] = s.name;
+        stage["depth"] = s.depth;
+        stage["completed"] = s.completed;
+        stage["wall_s"] = round_to(s.wall_s, 3);
+        stage["cpu_s"] = round_to(user_s + sys_s + children_cpu_s, 3);
+        stage["user_s"] = round_to(user_s, 3);
+        stage["sys_s"] = round_to(sys_s, 3);
+        stage["children_cpu_s"] = round_to(children_cpu_s, 3);
+        // the high-water mark only grows: the process peak at the end of the stage, and how
+        // much the stage raised it
+        stage["peak_rss_bytes"] = b.peak_rss;
+        stage["peak_rss_increase_bytes"] = b.peak_rss - a.peak_rss;
+        // the children peak is a maximum over all waited-for children, only a new maximum is the stage's
+        if (b.children_peak_rss > a.children_peak_rss) {
+            stage["children_peak_rss_bytes"] = b.children_peak_rss;
+        }
+        stage["io_read_bytes"] = b.rchar - a.rchar;
+        stage["io_write_bytes"] = b.wchar - a.wchar;
+        stage["storage_read_bytes"] = b.read_bytes - a.read_bytes;
+        stage["storage_write_bytes"] = b.write_bytes - a.write_bytes;
+        for (const auto& [counter, value] : s.counters) {
+            stage[counter] = value;
+        }
+        if (s.wall_s > 0) {
+            if (auto it = s.counters.find("kmers"); it != s.counters.end()) {
+                stage["kmers_per_s"] = round_to(it->second / s.wall_s, 1);
+            }
+            if (auto it = s.counters.find("input_bytes"); it != s.counters.end()) {
+                stage["input_mb_per_s"] = round_to(it->second / 1048576.0 / s.wall_s, 2);
+            }
+        }
+        stages.push_back(std::move(stage));
+    }
+    report["stages"] = std::move(stages);
+
+    std::ofstream ofs(path);
+    if (!ofs.good()) {
+        spdlog::warn(fmt::format("cannot write the stage report {}", path.c_str()));
+        return;
+    }
+    ofs << report.dump(2) << '\n';
+}
+
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <kmtricks/timer.hpp>
+
+namespace fs = std::filesystem;
+
+
+namespace muset {
+
+// Resource counters of the process at one point in time
+struct ResourceUsage
+{
+    double user_s{0};
+    double sys_s{0};
+    double children_user_s{0}; // waited-for child processes (ggcat)
+    double children_sys_s{0};
+    uint64_t children_peak_rss{0};
+    uint64_t peak_rss{0}; // high-water mark of the process so far (VmHWM, or getrusage)
+    // /proc/self/io: all reads and writes (rchar, wchar) and those reaching the storage
+    // layer (read_bytes, write_bytes), child processes included once waited for
+    uint64_t rchar{0};
+    uint64_t wchar{0};
+    uint64_t read_bytes{0};
+    uint64_t write_bytes{0};
+
+    static ResourceUsage now();
+};
+
+// Wall time, CPU time, peak RSS and I/O of the pipeline stages, written as a JSON report
+// (muset_report.json in the output directory). Stages may be nested, e.g. the kmtricks
+// steps inside the kmtricks stage; their names are then joined with '/'.
+//
+// The process high-water mark is never reset: a stage reports the peak at its end and the
+// increase over the peak at its start, 0 when an earlier stage already used more memory.
+class StageReport
+{
+  public:
+    // Run a stage and record its resource usage, also when it throws
+    void run(const std::string& name, const std::function<void()>& stage);
+
+    // Attach a value to the last recorded stage with this name (e.g. "kmers", "input_bytes"),
+    // "kmers" and "input_bytes" also give a throughput
+    void add_counter(const std::string& stage, const std::string& counter, uint64_t value);
+
+    void set_info(const std::string& key, const std::string& value);
+
+    // status is "success" or the error message
+    void write(const fs::path& path, const std::string& status);
+
+  private:
+    struct Stage
+    {
+        std::string name;
+        size_t depth{0};
+        bool completed{false};
+        double wall_s{0};
+        ResourceUsage start;
+        ResourceUsage end;
+        std::map<std::string, uint64_t> counters;
+    };
+
+    km::Timer m_timer;
+    std::vector<Stage> m_stages;
+    std::vector<size_t> m_open; // nested running stages, innermost last
+    std::vector<std::pair<std::string, std::string>> m_info;
+};
+
+};
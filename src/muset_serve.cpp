@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <kseq++/seqio.hpp>
+
+#include "muset_cli.h"
+#include "muset_query.h"
+#include "muset_socket.h"
+
+
+namespace muset {
+
+static std::atomic<bool> serve_stop{false};
+
+static void stop_serving(int) {
+    serve_stop = true;
+}
+
+// Request counts and latencies of the server, percentiles are taken on the last
+// latency_window requests
+class ServeMetrics
+{
+  public:
+    static constexpr size_t latency_window = 1 << 16;
+
+    void record(uint64_t nb_queries, double latency_us) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nb_requests++;
+        m_nb_queries += nb_queries;
+        m_total_us += latency_us;
+        if (m_latencies.size() < latency_window) {
+            m_latencies.push_back(latency_us);
+        } else {
+            m_latencies[m_nb_requests % latency_window] = latency_us;
+        }
+    }
+
+    // "name<TAB>value" lines
+    std::string report() const {
+        std::vector<double> latencies;
+        uint64_t nb_requests, nb_queries;
+        double total_us;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            latencies = m_latencies;
+            nb_requests = m_nb_requests;
+            nb_queries = m_nb_queries;
+            total_us = m_total_us;
+        }
+        double uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        auto percentile = [&latencies](double p) {
+            if (latencies.empty()) { return 0.0; }
+            size_t i = std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()));
+            std::nth_element(latencies.begin(), latencies.begin() + i, latencies.end());
+            return latencies[i];
+        };
+
+        std::string out;
+        auto add = [&out](const char* name, auto value) { out += fmt::format("{}\t{}\n", name, value); };
+        add("uptime_s", fmt::format("{:.1f}", uptime));
+        add("requests", nb_requests);
+        add("queries", nb_queries);
+        add("requests_per_s", fmt::format("{:.1f}", nb_requests / uptime));
+        add("queries_per_s", fmt::format("{:.1f}", nb_queries / uptime));
+        add("mean_latency_us", fmt::format("{:.1f}", nb_requests ? total_us / nb_requests : 0.0));
+        add("p50_latency_us", fmt::format("{:.1f}", percentile(0.50)));
+        add("p99_latency_us", fmt::format("{:.1f}", percentile(0.99)));
+        return out;
+    }
+
+  private:
+    mutable std::mutex m_mutex;
+    std::chrono::steady_clock::time_point m_start{std::chrono::steady_clock::now()};
+    uint64_t m_nb_requests{0};
+    uint64_t m_nb_queries{0};
+    double m_total_us{0};
+    std::vector<double> m_latencies;
+};
+
+// A client connection and its buffered input, handed to a worker one request at a time
+struct ServeConnection
+{
+    ServeConnection(int fd) : fd(fd), reader(fd, &serve_stop) {}
+
+    int fd;
+    SocketLineReader reader;
+};
+
+// Answer one request of a connection. Returns false when the client closed the connection
+// (or the server stops) before a request. A request is timed from its first line to the end
+// of its response.
+static bool serve_request(ServeConnection& connection, UnitigQuery& query, ServeMetrics& metrics)
+{
+    std::string line, name, seq, error;
+    fmt::memory_buffer out;
+    bool has_record{false};
+    bool in_request{false};
+    bool stats_request{false};
+    uint64_t nb_queries{0};
+    auto start = std::chrono::steady_clock::now();
+
+    auto flush_record = [&]() {
+        if (has_record && error.empty()) {
+            query.query(name, seq, out);
+            nb_queries++;
+        }
+        has_record = false;
+    };
+
+    while (connection.reader.getline(line)) {
+        if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+        if (!in_request) {
+            start = std::chrono::steady_clock::now();
+            in_request = true;
+        }
+
+        if (line == SERVE_STATS) {
+            // a request is either FASTA records or a metrics request
+            if (has_record || nb_queries > 0) {
+                if (error.empty()) { error = fmt::format("{} inside a request", SERVE_STATS); }
+                continue;
+            }
+            std::string report = metrics.report();
+            out.append(report.data(), report.data() + report.size());
+            stats_request = true;
+        } else if (line == SERVE_END) {
+            flush_record();
+        } else if (!line.empty() && line[0] == '>') {
+            flush_record();
+            name = line.substr(1, line.find_first_of(" \t") - 1);
+            seq.clear();
+            has_record = true;
+            continue;
+        } else if (has_record) {
+            seq += line;
+            continue;
+        } else {
+            if (!line.empty() && error.empty()) { error = "sequence line before any FASTA header"; }
+            continue;
+        }
+
+        // end of request
+        if (!error.empty()) {
+            out.clear();
+            fmt::format_to(std::back_inserter(out), "{}{}\n", SERVE_ERROR, error);
+        }
+        fmt::format_to(std::back_inserter(out), "{}\n", SERVE_END);
+        write_all(connection.fd, out.data(), out.size());
+
+        // metrics requests are not counted
+        if (!stats_request) {
+            double latency_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            metrics.record(nb_queries, latency_us);
+            spdlog::debug(fmt::format("request: {} queries in {:.1f} us", nb_queries, latency_us));
+        }
+        return true;
+    }
+    return false;
+}
+
+int main_serve(serve_options_t opt)
+{
+    spdlog::info(fmt::format("loading unitig index {}", opt->index_prefix));
+    UnitigIndex index;
+    index.load(opt->index_prefix);
+    spdlog::info(fmt::format("{} unitigs, {} samples, k={}", index.store->nb_unitigs(), index.store->nb_samples(), index.dict.k()));
+
+    // a socket left by a previous server is replaced, any other file is kept
+    struct stat st;
+    if (::lstat(opt->socket.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            throw std::runtime_error(fmt::format("{} exists and is not a socket", opt->socket));
+        }
+        ::unlink(opt->socket.c_str());
+    }
+
+    sockaddr_un addr = serve_address(opt->socket);
+    int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || ::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listen_fd, SOMAXCONN) != 0) {
+        int err = errno;
+        if (listen_fd >= 0) { ::close(listen_fd); }
+        throw std::runtime_error(fmt::format("cannot listen on {}: {}", opt->socket, std::strerror(err)));
+    }
+    int wake[2];
+    if (::pipe(wake) != 0) {
+        int err = errno;
+        ::close(listen_fd);
+        throw std::runtime_error(fmt::format("cannot create a pipe: {}", std::strerror(err)));
+    }
+
+    std::signal(SIGINT, stop_serving);
+    std::signal(SIGTERM, stop_serving);
+
+    // The main thread polls the idle connections. A connection with a pending request is
+    // queued for the workers, each with its own query state, and handed back once the
+    // request is answered, so any number of connections share the workers.
+    ServeMetrics metrics;
+    std::deque<ServeConnection*> ready;
+    std::deque<std::pair<ServeConnection*, bool>> answered; // <connection, still open>
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    size_t nb_threads = std::max(opt->nb_threads, 1);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < nb_threads; t++) {
+        workers.emplace_back([&]() {
+            UnitigQuery query(index);
+            while (true) {
+                ServeConnection* connection;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (ready.empty() && !serve_stop) {
+                        cv.wait_for(lock, std::chrono::milliseconds(200));
+                    }
+                    if (ready.empty()) { return; }
+                    connection = ready.front();
+                    ready.pop_front();
+                }
+                bool open = false;
+                try {
+                    // requests already buffered are answered right away
+                    do {
+                        open = serve_request(*connection, query, metrics);
+                    } while (open && connection->reader.buffered());
+                } catch (const std::exception& e) {
+                    spdlog::warn(fmt::format("connection closed: {}", e.what()));
+                    open = false;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    answered.emplace_back(connection, open);
+                }
+                char c = 0;
+                while (::write(wake[1], &c, 1) < 0 && errno == EINTR) {}
+            }
+        });
+    }
+
+    spdlog::info(fmt::format("serving on {} with {} worker threads", opt->socket, nb_threads));
+    std::unordered_map<int, std::unique_ptr<ServeConnection>> connections;
+    std::vector<ServeConnection*> idle;
+    std::vector<pollfd> pfds;
+    while (!serve_stop) {
+        pfds.clear();
+        pfds.push_back({listen_fd, POLLIN, 0});
+        pfds.push_back({wake[0], POLLIN, 0});
+        for (auto* connection : idle) { pfds.push_back({connection->fd, POLLIN, 0}); }
+        int nb_ready = ::poll(pfds.data(), pfds.size(), 200);
+        if (nb_ready <= 0) { continue; }
+
+        // connections with a request (or closed by their client) go to the workers
+        std::vector<ServeConnection*> still_idle;
+        size_t nb_queued{0};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < idle.size(); i++) {
+                if (pfds[i + 2].revents) {
+                    ready.push_back(idle[i]);
+                    nb_queued++;
+                } else {
+                    still_idle.push_back(idle[i]);
+                }
+            }
+        }
+        for (size_t i = 0; i < nb_queued; i++) { cv.notify_one(); }
+        idle.swap(still_idle);
+
+        if (pfds[1].revents) {
+            char buffer[256];
+            while (::read(wake[0], buffer, sizeof(buffer)) < 0 && errno == EINTR) {}
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto [connection, open] : answered) {
+                if (open) {
+                    idle.push_back(connection);
+                } else {
+                    ::close(connection->fd);
+                    connections.erase(connection->fd);
+                }
+            }
+            answered.clear();
+        }
+
+        if (pfds[0].revents) {
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd >= 0) {
+                auto connection = std::make_unique<ServeConnection>(fd);
+                idle.push_back(connection.get());
+                connections[fd] = std::move(connection);
+            }
+        }
+    }
+
+    spdlog::info("stopping");
+    ::close(listen_fd);
+    ::unlink(opt->socket.c_str());
+    cv.notify_all();
+    for (auto& worker : workers) { worker.join(); }
+    for (auto& [fd, connection] : connections) { ::close(fd); }
+    ::close(wake[0]);
+    ::close(wake[1]);
+
+    std::string report = metrics.report();
+    report.pop_back();
+    for (auto& c : report) { if (c == '\t') { c = ' '; } }
+    spdlog::info(fmt::format("metrics:\n{}", report));
+    return 0;
+}
+
+// Read a response until its end line, writing its lines to out
+static void read_response(SocketLineReader& reader, std::ostream& out)
+{
+    std::string line;
+    while (reader.getline(line)) {
+        if (line == SERVE_END) { return; }
+        if (line.compare(0, std::strlen(SERVE_ERROR), SERVE_ERROR) == 0) {
+            throw std::runtime_error(fmt::format("server error: {}", line.substr(std::strlen(SERVE_ERROR))));
+        }
+        out << line << '\n';
+    }
+    throw std::runtime_error("connection closed by the server");
+}
+
+int main_client(client_options_t opt)
+{
+    if (!fs::is_regular_file(opt->queries)) {
+        throw std::runtime_error(fmt::format("query file \"{}\" does not exist", opt->queries));
+    }
+
+    int fd = serve_connect(opt->socket);
+    SocketLineReader reader(fd);
+
+    std::ostream* fpout = &std::cout;
+    std::ofstream ofs;
+    if(!(opt->output).empty()) {
+        ofs.open((opt->output).c_str());
+        if(!ofs.good()) { throw std::runtime_error(fmt::format("cannot open {}", opt->output.c_str())); }
+        fpout = &ofs;
+    }
+    *fpout << "query\tsample\tabundance\tkmer_fraction\n";
+
+    klibpp::KSeq record;
+    klibpp::SeqStreamIn ssi(opt->queries.c_str());
+    fmt::memory_buffer request;
+    uint64_t nb_queries{0};
+    bool more = true;
+    while (more) {
+        request.clear();
+        uint32_t batch{0};
+        while (batch < opt->batch_size && (more = static_cast<bool>(ssi >> record))) {
+            fmt::format_to(std::back_inserter(request), ">{}\n{}\n", record.name, record.seq);
+            batch++;
+        }
+        if (batch == 0) { break; }
+        fmt::format_to(std::back_inserter(request), "{}\n", SERVE_END);
+        write_all(fd, request.data(), request.size());
+        read_response(reader, *fpout);
+        nb_queries += batch;
+    }
+    spdlog::info(fmt::format("{} queries", nb_queries));
+
+    if (opt->print_stats) {
+        std::string stats = fmt::format("{}\n", SERVE_STATS);
+        write_all(fd, stats.data(), stats.size());
+        std::ostringstream report;
+        read_response(reader, report);
+        spdlog::info(fmt::format("server metrics:\n{}", report.str()));
+    }
+    ::close(fd);
+
+    if(!(opt->output).empty()) {
+        ofs.close();
+    }
+
+    return 0;
+}
+
+};
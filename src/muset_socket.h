@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+// Line protocol of muset serve over a Unix domain socket
+//
+//   request  : FASTA records (">name" then sequence lines), then a line "."
+//              or a line "#stats" for the server metrics
+//   response : the "query sample abundance kmer_fraction" lines of the records, in order,
+//              then a line "."; a failed request gets a single "error<TAB>message" line
+//              before the "."
+//
+// A connection carries any number of requests, one at a time.
+
+namespace muset {
+
+constexpr const char* SERVE_END = ".";
+constexpr const char* SERVE_STATS = "#stats";
+constexpr const char* SERVE_ERROR = "error\t";
+
+inline sockaddr_un serve_address(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error(fmt::format("socket path \"{}\" is too long", path));
+    }
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+inline int serve_connect(const std::string& path) {
+    sockaddr_un addr = serve_address(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        int err = errno;
+        if (fd >= 0) { ::close(fd); }
+        throw std::runtime_error(fmt::format("cannot connect to {}: {}", path, std::strerror(err)));
+    }
+    return fd;
+}
+
+inline void write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            throw std::runtime_error(fmt::format("socket write failed: {}", std::strerror(errno)));
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+// Buffered line reader on a socket. With a stop flag, waiting for data is interrupted
+// (as an end of stream) once the flag is set.
+class SocketLineReader {
+
+  public:
+    SocketLineReader(int fd, const std::atomic<bool>* stop = nullptr) : m_fd(fd), m_stop(stop) {}
+
+    bool getline(std::string& line) {
+        while (true) {
+            size_t end = m_buffer.find('\n', m_pos);
+            if (end != std::string::npos) {
+                line.assign(m_buffer, m_pos, end - m_pos);
+                m_pos = end + 1;
+                return true;
+            }
+            m_buffer.erase(0, m_pos);
+            m_pos = 0;
+            if (!fill()) {
+                // a last line without newline
+                if (m_buffer.empty()) { return false; }
+                line.swap(m_buffer);
+                m_buffer.clear();
+                return true;
+            }
+        }
+    }
+
+    // whether lines are already buffered, i.e. can be read without waiting
+    bool buffered() const {
+        return m_pos < m_buffer.size();
+    }
+
+  private:
+    bool fill() {
+        if (m_stop) {
+            pollfd pfd{m_fd, POLLIN, 0};
+            int ready;
+            while ((ready = ::poll(&pfd, 1, 200)) == 0 || (ready < 0 && errno == EINTR)) {
+                if (m_stop->load()) { return false; }
+            }
+        }
+        char chunk[1 << 16];
+        ssize_t n;
+        while ((n = ::read(m_fd, chunk, sizeof(chunk))) < 0 && errno == EINTR) {}
+        if (n <= 0) { return false; }
+        m_buffer.append(chunk, n);
+        return true;
+    }
+
+    int m_fd;
+    const std::atomic<bool>* m_stop;
+    std::string m_buffer;
+    size_t m_pos{0};
+};
+
+};
@@ -284,3 +284,198 @@ TEST_F(AggregatorRandomTest, MedianAggregator_MinFraction_1000RandomTests) {
         }
     }
 }
+
+// Split a dense row into its non-zero sample indices and counts
+std::pair<std::vector<uint32_t>, std::vector<uint32_t>> to_sparse(const std::vector<uint32_t>& counts) {
+    std::vector<uint32_t> ids, values;
+    for (uint32_t i = 0; i < counts.size(); ++i) {
+        if (counts[i]) {
+            ids.push_back(i);
+            values.push_back(counts[i]);
+        }
+    }
+    return {ids, values};
+}
+
+// Sparse rows must give the same results as the equivalent dense rows
+TEST_F(AggregatorRandomTest, SparseMatchesDense_1000RandomTests) {
+    const size_t num_tests = 1000;
+    const size_t max_samples = 8;
+    const size_t max_kmers = 20;
+
+    for (size_t test_num = 0; test_num < num_tests; ++test_num) {
+        size_t num_samples = 1 + get_rng()() % max_samples;
+        size_t num_kmers = 1 + get_rng()() % max_kmers;
+        double min_fraction = (get_rng()() % 100) / 100.0;
+
+        MeanAggregator mean_dense(num_samples, 1, min_fraction), mean_sparse(num_samples, 1, min_fraction);
+        MedianAggregator median_dense(num_samples, 1, min_fraction), median_sparse(num_samples, 1, min_fraction);
+
+        std::bernoulli_distribution present_dist(0.3);
+        for (size_t i = 0; i < num_kmers; ++i) {
+            auto counts = random_counts(num_samples, 20);
+            for (auto& c : counts) {
+                if (!present_dist(get_rng())) c = 0;
+            }
+            auto [ids, values] = to_sparse(counts);
+
+            mean_dense.process_kmer(0, counts);
+            mean_sparse.process_kmer(0, ids, values);
+            median_dense.process_kmer(0, counts);
+            median_sparse.process_kmer(0, ids, values);
+        }
+
+        for (size_t sample = 0; sample < num_samples; ++sample) {
+            EXPECT_EQ(mean_dense.get_abundance_fraction(0, sample, num_kmers),
+                      mean_sparse.get_abundance_fraction(0, sample, num_kmers))
+                << "Test " << test_num << ", Sample " << sample;
+            EXPECT_EQ(median_dense.get_abundance_fraction(0, sample, num_kmers),
+                      median_sparse.get_abundance_fraction(0, sample, num_kmers))
+                << "Test " << test_num << ", Sample " << sample;
+        }
+    }
+}
+
+// One unitig at a time, the streaming aggregator gives the results of the per-unitig ones
+TEST_F(AggregatorRandomTest, UnitigAggregatorMatches_1000RandomTests) {
+    const size_t num_tests = 1000;
+    const size_t max_samples = 8;
+    const size_t max_kmers = 20;
+
+    for (size_t test_num = 0; test_num < num_tests; ++test_num) {
+        size_t num_samples = 1 + get_rng()() % max_samples;
+        size_t num_utgs = 1 + get_rng()() % 4;
+        double min_fraction = (get_rng()() % 100) / 100.0;
+
+        MeanAggregator mean(num_samples, num_utgs, min_fraction);
+        MedianAggregator median(num_samples, num_utgs, min_fraction);
+        UnitigAggregator unitig_mean(num_samples, false, min_fraction), unitig_median(num_samples, true, min_fraction);
+        std::vector<double> abundances(num_samples), fractions(num_samples);
+
+        std::bernoulli_distribution present_dist(0.3);
+        for (size_t utg = 0; utg < num_utgs; ++utg) {
+            size_t num_kmers = 1 + get_rng()() % max_kmers;
+            size_t num_rows = get_rng()() % (num_kmers + 1);
+            for (size_t i = 0; i < num_rows; ++i) {
+                auto counts = random_counts(num_samples, 20);
+                for (auto& c : counts) {
+                    if (!present_dist(get_rng())) c = 0;
+                }
+                auto [ids, values] = to_sparse(counts);
+                mean.process_kmer(utg, ids, values);
+                median.process_kmer(utg, ids, values);
+                unitig_mean.process_kmer(ids.data(), values.data(), ids.size());
+                unitig_median.process_kmer(ids.data(), values.data(), ids.size());
+            }
+
+            unitig_mean.finish_unitig(num_kmers, abundances, fractions);
+            for (size_t sample = 0; sample < num_samples; ++sample) {
+                EXPECT_EQ(mean.get_abundance_fraction(utg, sample, num_kmers), std::make_pair(abundances[sample], fractions[sample]))
+                    << "Test " << test_num << ", Unitig " << utg << ", Sample " << sample;
+            }
+            unitig_median.finish_unitig(num_kmers, abundances, fractions);
+            for (size_t sample = 0; sample < num_samples; ++sample) {
+                EXPECT_EQ(median.get_abundance_fraction(utg, sample, num_kmers), std::make_pair(abundances[sample], fractions[sample]))
+                    << "Test " << test_num << ", Unitig " << utg << ", Sample " << sample;
+            }
+        }
+    }
+}
+
+// Sums of narrow counts are 32-bit: they do not saturate at the count width
+TEST(AggregatorCountWidth, MeanAggregator_WideSums_uint8) {
+    const size_t num_kmers = 10;
+    MeanAggregator<uint8_t> agg(2, 1, 0.0);
+    MeanAggregator<uint32_t> ref(2, 1, 0.0);
+
+    for (size_t i = 0; i < num_kmers; ++i) {
+        agg.process_kmer(0, std::vector<uint8_t>{200, 3});
+        ref.process_kmer(0, std::vector<uint32_t>{200, 3});
+    }
+
+    // the sum of sample 0 (2000) does not fit in 8 bits
+    auto [abundance, fraction] = agg.get_abundance_fraction(0, 0, num_kmers);
+    EXPECT_DOUBLE_EQ(abundance, 200.0);
+    EXPECT_DOUBLE_EQ(fraction, 1.0);
+
+    for (size_t sample = 0; sample < 2; ++sample) {
+        EXPECT_EQ(agg.get_abundance_fraction(0, sample, num_kmers), ref.get_abundance_fraction(0, sample, num_kmers));
+    }
+}
+
+// 8 and 16-bit counts take 6 bytes of accumulators per unitig and sample, 32-bit counts 8
+TEST(AggregatorCountWidth, MeanAggregator_NarrowWidthsUseLessMemory) {
+    const size_t num_samples = 100, num_utgs = 1000;
+    MeanAggregator<uint8_t> agg8(num_samples, num_utgs, 0.0);
+    MeanAggregator<uint16_t> agg16(num_samples, num_utgs, 0.0);
+    MeanAggregator<uint32_t> agg32(num_samples, num_utgs, 0.0);
+
+    EXPECT_EQ(agg32.memory_bytes(), 8 * num_samples * num_utgs);
+    EXPECT_EQ(agg16.memory_bytes(), 6 * num_samples * num_utgs);
+    EXPECT_EQ(agg8.memory_bytes(), agg16.memory_bytes());
+    EXPECT_LT(agg16.memory_bytes(), agg32.memory_bytes());
+}
+
+// Sums of 32-bit counts saturate at the 32-bit maximum, as the counts do
+TEST(AggregatorCountWidth, MeanAggregator_SaturatedSums_uint32) {
+    MeanAggregator<uint32_t> agg(1, 1, 0.0);
+    for (size_t i = 0; i < 3; ++i) {
+        agg.process_kmer(0, std::vector<uint32_t>{UINT32_MAX / 2});
+    }
+
+    auto [abundance, fraction] = agg.get_abundance_fraction(0, 0, 3);
+    EXPECT_DOUBLE_EQ(abundance, UINT32_MAX / 3.0);
+    EXPECT_DOUBLE_EQ(fraction, 1.0);
+}
+
+TEST(AggregatorCountWidth, UnitigAggregator_WideSums_uint8) {
+    const size_t num_kmers = 10;
+    UnitigAggregator<uint8_t> agg(2, false, 0.0);
+    MeanAggregator<uint32_t> ref(2, 1, 0.0);
+    std::vector<uint32_t> ids {0, 1};
+    std::vector<double> abundances(2), fractions(2);
+
+    for (size_t i = 0; i < num_kmers; ++i) {
+        std::vector<uint8_t> counts {250, 3};
+        agg.process_kmer(ids.data(), counts.data(), ids.size());
+        ref.process_kmer(0, std::vector<uint32_t>{250, 3});
+    }
+    agg.finish_unitig(num_kmers, abundances, fractions);
+
+    // the sum of sample 0 (2500) does not fit in 8 bits
+    EXPECT_DOUBLE_EQ(abundances[0], 250.0);
+    for (size_t sample = 0; sample < 2; ++sample) {
+        EXPECT_EQ(std::make_pair(abundances[sample], fractions[sample]), ref.get_abundance_fraction(0, sample, num_kmers));
+    }
+}
+
+// The unitig engine has the accumulators of MeanAggregator, with the same limits
+TEST(AggregatorCountWidth, UnitigAggregator_MatchesMeanAggregator_uint32) {
+    const size_t num_kmers = 3;
+    UnitigAggregator<uint32_t> agg(1, false, 0.0);
+    MeanAggregator<uint32_t> ref(1, 1, 0.0);
+    std::vector<uint32_t> ids {0};
+    std::vector<double> abundances(1), fractions(1);
+
+    // the sum saturates at the 32-bit maximum in both aggregators
+    for (size_t i = 0; i < num_kmers; ++i) {
+        std::vector<uint32_t> counts {UINT32_MAX / 2};
+        agg.process_kmer(ids.data(), counts.data(), ids.size());
+        ref.process_kmer(0, counts);
+    }
+    agg.finish_unitig(num_kmers, abundances, fractions);
+
+    EXPECT_EQ(std::make_pair(abundances[0], fractions[0]), ref.get_abundance_fraction(0, 0, num_kmers));
+}
+
+TEST(AggregatorCountWidth, MedianAggregator_uint16_MatchesUint32) {
+    MedianAggregator<uint16_t> agg(1, 1, 0.0);
+    MedianAggregator<uint32_t> ref(1, 1, 0.0);
+
+    for (uint32_t c : {5u, 0u, 9u, 1000u, 7u}) {
+        agg.process_kmer(0, std::vector<uint16_t>{static_cast<uint16_t>(c)});
+        ref.process_kmer(0, std::vector<uint32_t>{c});
+    }
+
+    EXPECT_EQ(agg.get_abundance_fraction(0, 0, 5), ref.get_abundance_fraction(0, 0, 5));
+}
@@ -0,0 +1,671 @@
+#include <kmat_tools/cmd/convert.h>
+#include <kmat_tools/cmd/diff.h>
+#include <kmat_tools/cmd/merge.h>
+#include <kmat_tools/cmd/select.h>
+#include <kmat_tools/cmd/sort.h>
+#include <kmat_tools/csr.h>
+#include <kmat_tools/ggcat.h>
+#include <kmat_tools/kmer_index.h>
+#include <kmat_tools/pa_matrix.h>
+#include <kmat_tools/packed_kmer.h>
+#include <kmat_tools/revcomp.h>
+#include <kmat_tools/unitig_index.h>
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// Temporary directory removed at the end of each test, also used as the kmat tmp dir
+class KmatCommandTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        spdlog::set_level(spdlog::level::warn);
+        const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+        dir = fs::temp_directory_path() / fmt::format("kmat_tools_tests.{}.{}", getpid(), info->name());
+        fs::remove_all(dir);
+        fs::create_directories(dir / "tmp");
+    }
+
+    void TearDown() override {
+        fs::remove_all(dir);
+    }
+
+    std::string path(const std::string& name) const {
+        return (dir / name).string();
+    }
+
+    bool tmp_empty() const {
+        return fs::is_empty(dir / "tmp");
+    }
+
+    fs::path dir;
+};
+
+struct matrix_line {
+    std::string kmer;
+    std::vector<uint64_t> counts;
+};
+
+static std::string random_kmer(std::mt19937_64& rng, size_t k = 31) {
+    std::string kmer(k, 'A');
+    for (auto& c : kmer) { c = "ACGT"[rng() % 4]; }
+    return kmer;
+}
+
+// rank of a k-mer character in A<C<G<T or A<C<T<G
+static std::string order_key(const std::string& kmer, bool actg_order) {
+    std::string key(kmer);
+    if (actg_order) {
+        for (auto& c : key) { c = c == 'T' ? 'G' : c == 'G' ? 'T' : c; }
+    }
+    return key;
+}
+
+static std::string reverse_complement(const std::string& kmer) {
+    std::string rc(kmer.rbegin(), kmer.rend());
+    for (auto& c : rc) { c = c == 'A' ? 'T' : c == 'C' ? 'G' : c == 'G' ? 'C' : 'A'; }
+    return rc;
+}
+
+static void write_matrix(const std::string& path, const std::vector<matrix_line>& lines) {
+    std::ofstream out(path);
+    for (const auto& line : lines) {
+        out << line.kmer;
+        for (auto c : line.counts) { out << ' ' << c; }
+        out << '\n';
+    }
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static std::string to_text(const std::vector<matrix_line>& lines) {
+    std::string text;
+    for (const auto& line : lines) {
+        text += line.kmer;
+        for (auto c : line.counts) { text += fmt::format(" {}", c); }
+        text += '\n';
+    }
+    return text;
+}
+
+// (actg order, fan-in, threads, through -l)
+class KmatMerge : public KmatCommandTest, public ::testing::WithParamInterface<std::tuple<bool, size_t, size_t, bool>> {};
+
+TEST_P(KmatMerge, MatchesReference) {
+    auto [actg_order, fanin, nb_threads, use_list] = GetParam();
+    std::mt19937_64 rng(5);
+
+    // k-mers drawn from a shared pool, so that most k-mers are in several inputs
+    std::vector<std::string> pool(2000);
+    for (auto& kmer : pool) { kmer = random_kmer(rng); }
+
+    const size_t nb_inputs = 7;
+    std::vector<std::string> paths;
+    std::map<std::string, std::vector<uint64_t>> expected;
+    size_t total_samples = 0;
+    std::vector<std::pair<size_t, std::map<std::string, std::vector<uint64_t>>>> inputs;
+    for (size_t i = 0; i < nb_inputs; i++) {
+        size_t nb_samples = 1 + i % 3;
+        std::map<std::string, std::vector<uint64_t>> rows;
+        for (size_t r = 0; r < 500; r++) {
+            std::vector<uint64_t> counts(nb_samples);
+            for (auto& c : counts) { c = 1 + rng() % 50; }
+            rows[pool[rng() % pool.size()]] = counts;
+        }
+        std::vector<matrix_line> lines;
+        for (const auto& [kmer, counts] : rows) { lines.push_back({kmer, counts}); }
+        std::stable_sort(lines.begin(), lines.end(), [&](const matrix_line& a, const matrix_line& b) {
+            return order_key(a.kmer, actg_order) < order_key(b.kmer, actg_order);
+        });
+        paths.push_back(path(fmt::format("in{}.mat", i)));
+        write_matrix(paths.back(), lines);
+        inputs.emplace_back(total_samples, std::move(rows));
+        total_samples += nb_samples;
+    }
+    for (const auto& [offset, rows] : inputs) {
+        for (const auto& [kmer, counts] : rows) {
+            auto& row = expected[kmer];
+            row.resize(total_samples, 0);
+            std::copy(counts.begin(), counts.end(), row.begin() + offset);
+        }
+    }
+    std::vector<matrix_line> expected_lines;
+    for (const auto& [kmer, counts] : expected) { expected_lines.push_back({kmer, counts}); }
+    std::sort(expected_lines.begin(), expected_lines.end(), [&](const matrix_line& a, const matrix_line& b) {
+        return order_key(a.kmer, actg_order) < order_key(b.kmer, actg_order);
+    });
+
+    auto opt = std::make_shared<kmat::merge_options>();
+    if (use_list) {
+        // the first inputs as arguments, the others in the list, after them
+        opt->inputs.assign(paths.begin(), paths.begin() + 2);
+        std::ofstream list(path("list.txt"));
+        for (size_t i = 2; i < paths.size(); i++) { list << paths[i] << '\n'; }
+        opt->input_list = path("list.txt");
+    } else {
+        opt->inputs = paths;
+    }
+    opt->output = path("out.mat");
+    opt->actg_order = actg_order;
+    opt->fanin = fanin;
+    opt->nb_threads = nb_threads;
+    opt->tmp_dir = (dir / "tmp").string();
+    ASSERT_EQ(kmat::main_merge(opt), 0);
+
+    EXPECT_EQ(read_file(opt->output), to_text(expected_lines));
+    EXPECT_TRUE(tmp_empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(Options, KmatMerge, ::testing::Values(
+    std::make_tuple(false, 64, 1, false),
+    std::make_tuple(true, 64, 1, false),
+    std::make_tuple(false, 2, 1, true),
+    std::make_tuple(true, 3, 2, true),
+    std::make_tuple(false, 2, 3, false)
+));
+
+// (actg order, canonicalize, sum duplicates, threads)
+class KmatSort : public KmatCommandTest, public ::testing::WithParamInterface<std::tuple<bool, bool, bool, size_t>> {};
+
+TEST_P(KmatSort, MultiPassMatchesReference) {
+    auto [actg_order, canonicalize, sum_duplicates, nb_threads] = GetParam();
+    std::mt19937_64 rng(9);
+
+    // about 5 MB of lines, with duplicated k-mers: several 1 MiB runs, merged 2 by 2
+    std::vector<std::string> pool(40000);
+    for (auto& kmer : pool) { kmer = random_kmer(rng); }
+    std::vector<matrix_line> lines(100000);
+    for (auto& line : lines) {
+        line.kmer = pool[rng() % pool.size()];
+        line.counts = {1 + rng() % 100, rng() % 100, 1 + rng() % 100000};
+    }
+    write_matrix(path("in.mat"), lines);
+
+    std::vector<matrix_line> expected = lines;
+    if (canonicalize) {
+        for (auto& line : expected) {
+            std::string rc = reverse_complement(line.kmer);
+            if (order_key(rc, actg_order) < order_key(line.kmer, actg_order)) { line.kmer = rc; }
+        }
+    }
+    std::stable_sort(expected.begin(), expected.end(), [&](const matrix_line& a, const matrix_line& b) {
+        return order_key(a.kmer, actg_order) < order_key(b.kmer, actg_order);
+    });
+    if (sum_duplicates) {
+        std::vector<matrix_line> sums;
+        for (const auto& line : expected) {
+            if (!sums.empty() && sums.back().kmer == line.kmer) {
+                for (size_t c = 0; c < line.counts.size(); c++) { sums.back().counts[c] += line.counts[c]; }
+            } else {
+                sums.push_back(line);
+            }
+        }
+        expected = std::move(sums);
+    }
+
+    auto opt = std::make_shared<kmat::sort_options>();
+    opt->inputs = {path("in.mat")};
+    opt->output = path("out.mat");
+    opt->actg_order = actg_order;
+    opt->canonicalize = canonicalize;
+    opt->sum_duplicates = sum_duplicates;
+    opt->max_memory = 1;
+    opt->fanin = 2;
+    opt->nb_threads = nb_threads;
+    opt->tmp_dir = (dir / "tmp").string();
+    ASSERT_EQ(kmat::main_sort(opt), 0);
+
+    EXPECT_EQ(read_file(opt->output), to_text(expected));
+    EXPECT_TRUE(tmp_empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(Options, KmatSort, ::testing::Values(
+    std::make_tuple(false, false, false, 1),
+    std::make_tuple(true, false, false, 1),
+    std::make_tuple(false, true, true, 1),
+    std::make_tuple(true, true, true, 2),
+    std::make_tuple(true, false, true, 3)
+));
+
+TEST_F(KmatCommandTest, SortInMemory) {
+    write_matrix(path("in.mat"), {{"TTTT", {1}}, {"AAAA", {2}}, {"GGGG", {3}}, {"AAAA", {4}}, {"CCCC", {5}}});
+
+    auto opt = std::make_shared<kmat::sort_options>();
+    opt->inputs = {path("in.mat")};
+    opt->output = path("out.mat");
+    opt->actg_order = true;
+    opt->sum_duplicates = true;
+    opt->tmp_dir = (dir / "tmp").string();
+    ASSERT_EQ(kmat::main_sort(opt), 0);
+
+    EXPECT_EQ(read_file(opt->output), "AAAA 6\nCCCC 5\nTTTT 1\nGGGG 3\n");
+    EXPECT_TRUE(tmp_empty());
+}
+
+// (threads, query lines, output format)
+class KmatConvert : public KmatCommandTest, public ::testing::WithParamInterface<std::tuple<size_t, size_t, std::string>> {
+protected:
+    std::string convert(size_t nb_threads, const std::string& output_format) {
+        auto opt = std::make_shared<kmat::convert_options>();
+        opt->inputs = {path("unitigs.fa"), path("dump.jsonl"), path("query.jsonl")};
+        opt->out_fname = path(fmt::format("out{}.{}", nb_threads, output_format));
+        opt->output_format = output_format;
+        opt->nb_threads = nb_threads;
+        EXPECT_EQ(kmat::main_convert(opt), 0);
+        return opt->out_fname;
+    }
+};
+
+TEST_P(KmatConvert, MatchesSingleThread) {
+    auto [nb_threads, nb_lines, output_format] = GetParam();
+    const size_t nb_colors = 20;
+    std::mt19937_64 rng(3);
+
+    std::ofstream dump(path("dump.jsonl"));
+    for (size_t c = 0; c < nb_colors; c++) { dump << fmt::format(R"({{"color_index": {}, "color_name": "s{}"}})", c, c) << '\n'; }
+    dump.close();
+
+    // Chunks end on their size (4 MB) or line count (4096): in the first half, one line out of
+    // 50 is padded to 200 KB, so that chunks are cut on their size there and on their count
+    // afterwards. The last line has no newline.
+    std::ofstream unitigs(path("unitigs.fa"));
+    std::ofstream query(path("query.jsonl"));
+    for (size_t i = 0; i < nb_lines; i++) {
+        unitigs << ">u" << i << "\n" << random_kmer(rng) << "\n";
+        std::string pad = i < nb_lines / 2 && i % 50 == 7 ? std::string(200000, ' ') : "";
+        query << "{\"query_index\":" << i << ",\"matches\":{";
+        for (size_t c = rng() % 3, first = 1; c < nb_colors; c += 1 + rng() % 4, first = 0) {
+            query << (first ? "" : ",") << '"' << c << "\":" << pad << (1 + rng() % 100) / 100.0;
+        }
+        query << "}}" << (i + 1 < nb_lines ? "\n" : "");
+    }
+    unitigs.close();
+    query.close();
+
+    std::string single = convert(1, output_format);
+    std::string multi = convert(nb_threads, output_format);
+    EXPECT_EQ(read_file(multi), read_file(single));
+
+    // one row per query line, in input order (coo: consecutive rows of a unitig, csr: the index)
+    std::string rows_path = single;
+    if (output_format == "csr") {
+        EXPECT_EQ(read_file(kmat::csr_index_path(multi)), read_file(kmat::csr_index_path(single)));
+        rows_path = kmat::csr_index_path(single);
+    }
+    std::istringstream rows(read_file(rows_path));
+    std::string line;
+    if (output_format != "csr") { std::getline(rows, line); }
+    std::vector<std::string> ids;
+    while (std::getline(rows, line)) {
+        std::string id = line.substr(0, line.find(' '));
+        if (ids.empty() || ids.back() != id) { ids.push_back(id); }
+    }
+    ASSERT_EQ(ids.size(), nb_lines);
+    for (size_t i = 0; i < nb_lines; i++) { EXPECT_EQ(ids[i], fmt::format("u{}", i)); }
+}
+
+INSTANTIATE_TEST_SUITE_P(Options, KmatConvert, ::testing::Values(
+    std::make_tuple(2, 10000, "txt"),
+    std::make_tuple(3, 10000, "coo"),
+    std::make_tuple(8, 10000, "csr"),
+    std::make_tuple(8, 3, "txt"),
+    std::make_tuple(4, 1, "csr")
+));
+
+// (select rather than diff, actg order, threads, distinct k-mers, lines per input)
+class KmatDiffSelect : public KmatCommandTest,
+                       public ::testing::WithParamInterface<std::tuple<bool, bool, size_t, size_t, size_t>> {
+protected:
+    std::string run(bool select, bool actg_order, size_t nb_threads) {
+        std::string output = path(fmt::format("out{}.mat", nb_threads));
+        if (select) {
+            auto opt = std::make_shared<kmat::select_options>();
+            opt->inputs = {path("a.mat"), path("b.mat")};
+            opt->output = output;
+            opt->actg_order = actg_order;
+            opt->nb_threads = nb_threads;
+            opt->tmp_dir = (dir / "tmp").string();
+            EXPECT_EQ(kmat::main_select(opt), 0);
+        } else {
+            auto opt = std::make_shared<kmat::diff_options>();
+            opt->inputs = {path("a.mat"), path("b.mat")};
+            opt->output = output;
+            opt->actg_order = actg_order;
+            opt->nb_threads = nb_threads;
+            opt->tmp_dir = (dir / "tmp").string();
+            EXPECT_EQ(kmat::main_diff(opt), 0);
+        }
+        return read_file(output);
+    }
+};
+
+TEST_P(KmatDiffSelect, KeyRangesMatchSingleThread) {
+    auto [select, actg_order, nb_threads, nb_distinct, nb_lines] = GetParam();
+    std::mt19937_64 rng(13);
+
+    // few distinct k-mers make long runs of the same key, whose samples collapse the splits
+    std::vector<std::string> pool(nb_distinct);
+    for (auto& kmer : pool) { kmer = random_kmer(rng); }
+    for (const char* name : {"a.mat", "b.mat"}) {
+        std::vector<matrix_line> lines(nb_lines);
+        for (auto& line : lines) {
+            line.kmer = pool[rng() % pool.size()];
+            line.counts = {1 + rng() % 100, rng() % 100};
+        }
+        std::stable_sort(lines.begin(), lines.end(), [&](const matrix_line& a, const matrix_line& b) {
+            return order_key(a.kmer, actg_order) < order_key(b.kmer, actg_order);
+        });
+        write_matrix(path(name), lines);
+    }
+
+    std::string expected = run(select, actg_order, 1);
+    EXPECT_EQ(run(select, actg_order, nb_threads), expected);
+    EXPECT_TRUE(tmp_empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(Options, KmatDiffSelect, ::testing::Values(
+    // distinct k-mers
+    std::make_tuple(false, false, 4, 200000, 20000),
+    std::make_tuple(true, true, 4, 200000, 20000),
+    std::make_tuple(false, true, 3, 20000, 20000),
+    std::make_tuple(true, false, 3, 20000, 20000),
+    // heavily duplicated keys
+    std::make_tuple(false, false, 8, 3, 20000),
+    std::make_tuple(true, true, 8, 3, 20000),
+    std::make_tuple(false, true, 5, 40, 20000),
+    std::make_tuple(true, false, 5, 40, 20000),
+    // fewer lines than partitions
+    std::make_tuple(false, false, 8, 1000, 3),
+    std::make_tuple(true, true, 8, 1, 3),
+    std::make_tuple(false, false, 4, 1000, 0),
+    std::make_tuple(true, false, 4, 1, 1)
+));
+
+TEST(GgcatQueryScanner, MatchesJsonParser) {
+    std::vector<std::pair<uint64_t, float>> got;
+    auto collect = [&](uint64_t i, float v) { got.emplace_back(i, v); };
+
+    std::string line = R"({"query_index":7,"matches":{"0":1.0,"12":0.5,"3":2e-1}})";
+    ASSERT_TRUE(kmat::scan_ggcat_query_line(line, collect));
+    std::vector<std::pair<uint64_t, float>> expected {{0, 1.0f}, {12, 0.5f}, {3, 0.2f}};
+    EXPECT_EQ(got, expected);
+
+    got.clear();
+    ASSERT_TRUE(kmat::scan_ggcat_query_line(std::string(R"({ "query_index": 0, "matches": {} })"), collect));
+    EXPECT_TRUE(got.empty());
+
+    // Anything else is left to the general parser
+    EXPECT_FALSE(kmat::scan_ggcat_query_line(std::string(R"({"matches":{"0":1.0},"query_index":7})"), collect));
+    EXPECT_FALSE(kmat::scan_ggcat_query_line(std::string(R"({"query_index":7,"matches":{"a":1.0}})"), collect));
+    EXPECT_FALSE(kmat::scan_ggcat_query_line(std::string(R"({"query_index":7,"matches":{"0":1.0})"), collect));
+}
+
+TEST(GgcatQueryScanner, ValueFormatMatchesOstream) {
+    std::vector<float> values {0.0f, 1.0f, 0.5f, 0.6666667f, 1e-7f, 123456789.0f, 2.0f};
+    std::ostringstream expected;
+    fmt::memory_buffer got;
+    for (float v : values) {
+        expected << v << " ";
+        kmat::append_value(got, v);
+        got.push_back(' ');
+    }
+    EXPECT_EQ(fmt::to_string(got), expected.str());
+}
+
+TEST(CsrMatrix, RowsRoundTrip) {
+    std::string path = (std::filesystem::temp_directory_path() / "kmat_csr_test.csr").string();
+    std::vector<std::vector<uint32_t>> rows_colors {{0, 3, 7}, {}, {5}};
+    std::vector<std::vector<float>> rows_values {{0.5f, 1.0f, 0.25f}, {}, {0.75f}};
+
+    kmat::CsrMatrixHeader header;
+    header.nb_colors = 8;
+    header.nb_rows = rows_colors.size();
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::vector<uint64_t> offsets;
+    for (size_t r = 0; r < rows_colors.size(); r++) {
+        offsets.push_back(data.size());
+        kmat::append_csr_row(data, rows_colors[r], rows_values[r], false);
+    }
+    std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+
+    kmat::CsrMatrixReader reader(path);
+    EXPECT_EQ(reader.header().nb_colors, 8u);
+    EXPECT_FALSE(reader.header().presence_absence());
+    std::vector<uint32_t> colors;
+    std::vector<float> values;
+    for (size_t r = 0; r < rows_colors.size(); r++) {
+        ASSERT_TRUE(reader.read(colors, values));
+        EXPECT_EQ(colors, rows_colors[r]);
+        EXPECT_EQ(values, rows_values[r]);
+    }
+    EXPECT_FALSE(reader.read(colors, values));
+
+    reader.seek(offsets[2]);
+    ASSERT_TRUE(reader.read(colors, values));
+    EXPECT_EQ(colors, rows_colors[2]);
+    std::filesystem::remove(path);
+}
+
+TEST(PaMatrix, TransposeMatchesRows) {
+    std::mt19937 rng(77);
+    std::string path = (std::filesystem::temp_directory_path() / "kmat_pa_test.bit").string();
+    const size_t nb_rows = 200, nb_cols = 70;
+    std::bernoulli_distribution coin(0.3);
+    std::vector<std::vector<uint32_t>> rows(nb_rows);
+    for (auto& row : rows) {
+        for (uint32_t c = 0; c < nb_cols; c++) {
+            if (coin(rng)) { row.push_back(c); }
+        }
+    }
+
+    kmat::PaMatrixHeader header;
+    header.nb_rows = nb_rows;
+    header.nb_cols = nb_cols;
+    header.row_bytes = kmat::pa_row_bytes(nb_cols);
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::vector<uint64_t> words(header.row_bytes / sizeof(uint64_t));
+    for (const auto& row : rows) {
+        kmat::append_pa_row(data, words, row);
+    }
+    std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+
+    // several blocks, the last one partial
+    kmat::transpose_pa_matrix(path, 64);
+
+    kmat::PaMatrixReader reader(kmat::pa_transposed_path(path));
+    EXPECT_TRUE(reader.header().transposed());
+    EXPECT_EQ(reader.header().nb_rows, nb_cols);
+    EXPECT_EQ(reader.header().nb_cols, nb_rows);
+    for (uint32_t c = 0; c < nb_cols; c++) {
+        ASSERT_TRUE(reader.read(words));
+        for (size_t r = 0; r < nb_rows; r++) {
+            bool expected = std::find(rows[r].begin(), rows[r].end(), c) != rows[r].end();
+            ASSERT_EQ(static_cast<bool>((words[r / 64] >> (r % 64)) & 1), expected);
+        }
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(kmat::pa_transposed_path(path));
+}
+
+TEST(GgcatQueryScanner, ColorAnnotations) {
+    std::vector<std::pair<uint64_t, uint64_t>> runs;
+    auto collect = [&](uint64_t subset, uint64_t count) { runs.emplace_back(subset, count); };
+    EXPECT_EQ(kmat::scan_ggcat_color_annotations("LN:i:61 C:3a:20 C:0:11 L:+:2:-", collect), 2u);
+    std::vector<std::pair<uint64_t, uint64_t>> expected {{0x3a, 20}, {0, 11}};
+    EXPECT_EQ(runs, expected);
+    EXPECT_EQ(kmat::scan_ggcat_color_annotations("LN:i:61", collect), 0u);
+}
+
+TEST(PackedKmer, OrderMatchesStrings) {
+    std::mt19937 rng(22);
+    std::uniform_int_distribution<size_t> size_dist(1, 70);
+    std::uniform_int_distribution<int> nt_dist(0, 3);
+    const char nt[4] = {'A', 'C', 'G', 'T'};
+    auto sign = [](int x) { return (x > 0) - (x < 0); };
+
+    for (size_t test_num = 0; test_num < 10000; ++test_num) {
+        std::string a(size_dist(rng), 'A');
+        for (auto& c : a) { c = nt[nt_dist(rng)]; }
+        // b shares a prefix of a, so that most pairs differ late or only in size
+        std::string b = a.substr(0, std::uniform_int_distribution<size_t>(0, a.size())(rng));
+        b.resize(size_dist(rng), 'A');
+        for (size_t i = std::min(a.size(), b.size()); i < b.size(); ++i) { b[i] = nt[nt_dist(rng)]; }
+        if (test_num % 7 == 0) { b[nt_dist(rng) % b.size()] = 'N'; }
+
+        for (bool actg_order : {false, true}) {
+            kmat::PackedKmer pa, pb;
+            pa.assign(a, actg_order);
+            pb.assign(b, actg_order);
+            EXPECT_EQ(pb.packed, b.size() <= kmat::PackedKmer::max_size && b.find('N') == std::string::npos);
+            int expected = actg_order ? kmat::actg_compare(a, b) : a.compare(b);
+            EXPECT_EQ(sign(kmat::compare_kmers(a, pa, b, pb, actg_order)), sign(expected))
+                << a << " " << b << " actg: " << actg_order;
+        }
+    }
+}
+
+TEST(ReverseComplement, MatchesScalar) {
+    std::mt19937 rng(59);
+    const std::string alphabet = "ACGTACGTACGTNacgtnX-";
+    std::uniform_int_distribution<size_t> size_dist(0, 100);
+    std::uniform_int_distribution<size_t> char_dist(0, alphabet.size() - 1);
+
+    for (size_t test_num = 0; test_num < 10000; ++test_num) {
+        std::string seq(size_dist(rng), 'A');
+        for (auto& c : seq) { c = alphabet[char_dist(rng)]; }
+        // palindromic sequences test the end of the canonical check
+        if (test_num % 5 == 0) {
+            std::string rc(seq.rbegin(), seq.rend());
+            for (auto& c : rc) { c = kmat::rctable[static_cast<unsigned char>(c)]; }
+            seq += rc;
+        }
+
+        std::string expected(seq.rbegin(), seq.rend());
+        for (auto& c : expected) { c = kmat::rctable[static_cast<unsigned char>(c)]; }
+
+        std::string out(seq.size(), ' ');
+        kmat::reverse_complement(seq.data(), seq.size(), out.data());
+        EXPECT_EQ(out, expected);
+        std::string inplace = seq;
+        kmat::reverse_complement_inplace(inplace);
+        EXPECT_EQ(inplace, expected);
+
+        for (bool actg_order : {false, true}) {
+            int cmp = 0;
+            for (size_t i = 0; i < seq.size() && cmp == 0; ++i) {
+                if (seq[i] != expected[i]) {
+                    int kt = actg_order ? kmat::n2kt[static_cast<unsigned char>(seq[i])] - kmat::n2kt[static_cast<unsigned char>(expected[i])] : 0;
+                    cmp = kt != 0 ? kt : int(static_cast<unsigned char>(seq[i])) - int(static_cast<unsigned char>(expected[i]));
+                }
+            }
+            EXPECT_EQ(kmat::is_canonical(seq, actg_order), cmp <= 0) << seq << " actg: " << actg_order;
+        }
+    }
+}
+
+TEST(ReverseComplement, PackedMatchesStrings) {
+    std::mt19937 rng(91);
+    std::uniform_int_distribution<size_t> size_dist(1, 64);
+    std::uniform_int_distribution<int> nt_dist(0, 3);
+    const char nt[4] = {'A', 'C', 'G', 'T'};
+
+    for (size_t test_num = 0; test_num < 10000; ++test_num) {
+        std::string kmer(size_dist(rng), 'A');
+        for (auto& c : kmer) { c = nt[nt_dist(rng)]; }
+        std::string rc = kmer;
+        kmat::reverse_complement_inplace(rc);
+
+        for (bool actg_order : {false, true}) {
+            kmat::PackedKmer packed, expected;
+            packed.assign(kmer, actg_order);
+            expected.assign(rc, actg_order);
+            kmat::PackedKmer result = kmat::reverse_complement(packed, actg_order);
+            EXPECT_EQ(result.hi, expected.hi) << kmer;
+            EXPECT_EQ(result.lo, expected.lo) << kmer;
+            EXPECT_EQ(result.size, expected.size);
+            EXPECT_EQ(kmat::canonical(packed, actg_order).compare(kmat::is_canonical(kmer, actg_order) ? packed : expected), 0);
+        }
+    }
+}
+
+TEST(UnitigIndex, AbundanceStoreRoundTrip) {
+    std::string path = kmat::index_abundance_path((std::filesystem::temp_directory_path() / "kmat_index_test").string());
+    std::vector<std::vector<double>> rows {{0.0, 2.5, 0.0, 1.0}, {0.0, 0.0, 0.0, 0.0}, {3.0, 0.0, 0.0, 0.5}};
+
+    kmat::AbundanceStoreWriter writer(path, 31, rows.size(), 4);
+    for (const auto& row : rows) { writer.write_row(row); }
+    writer.close();
+
+    kmat::AbundanceStore store(path);
+    EXPECT_EQ(store.header().kmer_size, 31u);
+    EXPECT_EQ(store.nb_unitigs(), rows.size());
+    EXPECT_EQ(store.nb_samples(), 4u);
+    EXPECT_EQ(store.header().nnz, 4u);
+    for (size_t u = 0; u < rows.size(); u++) {
+        auto row = store.row(u);
+        std::vector<double> dense(4, 0.0);
+        for (uint64_t j = 0; j < row.size; j++) {
+            if (j > 0) { EXPECT_LT(row.samples[j - 1], row.samples[j]); }
+            dense[row.samples[j]] = row.abundances[j];
+        }
+        EXPECT_EQ(dense, rows[u]);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(KmerRowIndex, FindsCanonicalKmers) {
+    const size_t k = 21;
+    std::mt19937 gen(11);
+    auto random_seq = [&gen](size_t n) {
+        std::string seq(n, 'A');
+        for (auto& c : seq) { c = "ACGT"[gen() % 4]; }
+        return seq;
+    };
+    auto revcomp = [](std::string seq) {
+        std::reverse(seq.begin(), seq.end());
+        for (auto& c : seq) { c = c == 'A' ? 'T' : c == 'C' ? 'G' : c == 'G' ? 'C' : c == 'T' ? 'A' : c; }
+        return seq;
+    };
+
+    // rows in either orientation, row i has count i + 1 in sample 0
+    std::string seq = random_seq(200);
+    kmat::KmerRowIndex<uint32_t> index(k);
+    for (size_t i = 0; i + k <= seq.size(); i += 2) {
+        std::string kmer = seq.substr(i, k);
+        EXPECT_TRUE(index.add_row(i % 4 ? kmer : revcomp(kmer), {0}, {static_cast<uint32_t>(i + 1)}));
+    }
+    EXPECT_FALSE(index.add_row(std::string(k - 1, 'A') + "N", {0}, {1}));
+    index.build();
+
+    // a N makes the k overlapping k-mers invalid
+    seq[150] = 'N';
+    size_t i = 0;
+    kmat::KmerRowIndex<uint32_t>::Row row;
+    kmat::for_each_canonical_kmer(seq, k, [&](kmat::kmer_key key, bool valid) {
+        bool has_n = i + k > 150 && i <= 150;
+        EXPECT_EQ(valid, !has_n) << "k-mer " << i;
+        bool found = valid && index.find(key, row);
+        EXPECT_EQ(found, valid && i % 2 == 0) << "k-mer " << i;
+        if (found) {
+            ASSERT_EQ(row.size, 1u);
+            EXPECT_EQ(row.counts[0], i + 1);
+        }
+        i++;
+    });
+    EXPECT_EQ(i, seq.size() - k + 1);
+}
@@ -0,0 +1,355 @@
+#include <kmtricks/merge.hpp>
+#include <kmtricks/io/async_file.hpp>
+#include <gtest/gtest.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+constexpr size_t MAX_C = 4294967295;
+using count_type = typename km::selectC<MAX_C>::type;
+
+// Temporary directory removed at the end of each test
+class KmtricksTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+        dir = fs::temp_directory_path() / fmt::format("kmtricks_tests.{}.{}", getpid(), info->name());
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+    }
+
+    void TearDown() override {
+        fs::remove_all(dir);
+    }
+
+    std::string path(const std::string& name) const {
+        return (dir / name).string();
+    }
+
+    fs::path dir;
+};
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// One k-mer file per sample, as written by the count step: sorted k-mers drawn from a shared
+// pool, so that k-mers are found in several samples, with counts in [1, 10]
+static std::vector<std::string> write_kmer_files(const fs::path& dir, size_t nb_samples, bool lz4) {
+    std::mt19937_64 rng(7);
+    std::vector<uint64_t> pool(500);
+    for (auto& kmer : pool) { kmer = rng() >> 2; }
+
+    std::vector<std::string> paths;
+    for (size_t s = 0; s < nb_samples; s++) {
+        std::set<uint64_t> kmers;
+        for (size_t i = 0; i < 200; i++) { kmers.insert(pool[rng() % pool.size()]); }
+        paths.push_back((dir / fmt::format("sample{}.kmer", s)).string());
+        km::KmerWriter<8192> writer(paths.back(), 31, sizeof(count_type), s, 0, lz4);
+        for (uint64_t kmer : kmers) {
+            writer.write_raw<MAX_C>(&kmer, static_cast<count_type>(1 + rng() % 10));
+        }
+    }
+    return paths;
+}
+
+class HierarchicalMerge : public KmtricksTest, public ::testing::WithParamInterface<bool> {};
+
+TEST_P(HierarchicalMerge, FanIn2MatchesFlatMerge) {
+    bool lz4 = GetParam();
+    const size_t nb_samples = 7;
+    std::vector<std::string> paths = write_kmer_files(dir, nb_samples, lz4);
+    std::vector<uint32_t> abundance_min(nb_samples, 3);
+
+    // flat merge, with the abundance, recurrence and rescue thresholds
+    km::KmerMerger<32, MAX_C> flat(paths, abundance_min, 31, 2, 1);
+    flat.write_as_text(path("flat.txt"));
+
+    // fan-in 2: 4 runs of samples, then 2 runs of runs, merged with the same thresholds
+    std::vector<std::string> runs = km::merge_runs<32, MAX_C>(
+        paths, 2, 31, lz4,
+        [this](uint32_t level, uint32_t id) { return path(fmt::format("run{}_{}", level, id)); });
+    ASSERT_EQ(runs.size(), 2u);
+    EXPECT_FALSE(fs::exists(path("run0_0")));
+    km::KmerRunMerger<32, MAX_C> hierarchical(runs, abundance_min, 31, 2, 1);
+    hierarchical.write_as_text(path("hierarchical.txt"));
+
+    std::string expected = read_file(path("flat.txt"));
+    EXPECT_FALSE(expected.empty());
+    EXPECT_EQ(read_file(path("hierarchical.txt")), expected);
+
+    auto* a = flat.get_infos();
+    auto* b = hierarchical.get_infos();
+    EXPECT_EQ(b->get_non_solid(), a->get_non_solid());
+    EXPECT_EQ(b->get_rescued(), a->get_rescued());
+    EXPECT_EQ(b->get_unique_w_rescue(), a->get_unique_w_rescue());
+    EXPECT_EQ(b->get_total_w_rescue(), a->get_total_w_rescue());
+}
+
+INSTANTIATE_TEST_SUITE_P(Lz4, HierarchicalMerge, ::testing::Bool());
+
+// (sparse file, lz4)
+class MatrixRoundTrip : public KmtricksTest, public ::testing::WithParamInterface<std::tuple<bool, bool>> {};
+
+TEST_P(MatrixRoundTrip, DenseAndSparseRows) {
+    auto [sparse, lz4] = GetParam();
+    const uint32_t nb_counts = 40;
+    std::mt19937_64 rng(11);
+
+    // rows from empty to full, so that both row encodings are written to sparse files
+    std::vector<uint64_t> kmers;
+    std::vector<std::vector<count_type>> rows;
+    for (uint32_t r = 0; r < 200; r++) {
+        kmers.push_back(rng() >> 2);
+        std::vector<count_type> row(nb_counts, 0);
+        uint32_t present = r % (nb_counts + 1);
+        for (uint32_t i = 0; i < present; i++) { row[rng() % nb_counts] = 1 + rng() % 1000; }
+        rows.push_back(row);
+    }
+
+    // even rows through the dense write, odd rows through the sparse write
+    {
+        km::MatrixWriter<8192> writer(path("m.mat"), 31, sizeof(count_type), nb_counts, 0, 0, lz4, sparse);
+        km::Kmer<32> kmer;
+        kmer.set_k(31);
+        for (size_t r = 0; r < rows.size(); r++) {
+            kmer.set64(kmers[r]);
+            if (r % 2 == 0) {
+                writer.write<32, MAX_C>(kmer, rows[r]);
+                continue;
+            }
+            std::vector<uint32_t> indices;
+            std::vector<count_type> counts;
+            for (uint32_t i = 0; i < nb_counts; i++) {
+                if (rows[r][i]) { indices.push_back(i); counts.push_back(rows[r][i]); }
+            }
+            writer.write<32, MAX_C>(kmer, indices, counts);
+        }
+    }
+
+    km::Kmer<32> kmer;
+    kmer.set_k(31);
+    {
+        km::MatrixReader<8192> reader(path("m.mat"));
+        EXPECT_EQ(reader.infos().sparse(), sparse);
+        std::vector<count_type> counts(nb_counts);
+        for (size_t r = 0; r < rows.size(); r++) {
+            ASSERT_TRUE((reader.read<32, MAX_C>(kmer, counts)));
+            EXPECT_EQ(kmer.get64(), kmers[r]);
+            EXPECT_EQ(counts, rows[r]);
+        }
+        EXPECT_FALSE((reader.read<32, MAX_C>(kmer, counts)));
+    }
+    {
+        km::MatrixReader<8192> reader(path("m.mat"));
+        std::vector<uint32_t> indices;
+        std::vector<count_type> counts;
+        for (size_t r = 0; r < rows.size(); r++) {
+            ASSERT_TRUE((reader.read<32, MAX_C>(kmer, indices, counts)));
+            EXPECT_EQ(kmer.get64(), kmers[r]);
+            std::vector<count_type> dense(nb_counts, 0);
+            for (size_t i = 0; i < indices.size(); i++) { dense[indices[i]] = counts[i]; }
+            EXPECT_EQ(dense, rows[r]);
+        }
+        EXPECT_FALSE((reader.read<32, MAX_C>(kmer, indices, counts)));
+    }
+    {
+        // a prefix of the counts: the rest of each row is still consumed
+        const size_t n = 5;
+        km::MatrixReader<8192> reader(path("m.mat"));
+        std::vector<count_type> counts(n);
+        for (size_t r = 0; r < rows.size(); r++) {
+            ASSERT_TRUE((reader.read<32, MAX_C>(kmer, counts, n)));
+            EXPECT_EQ(kmer.get64(), kmers[r]);
+            EXPECT_EQ(counts, std::vector<count_type>(rows[r].begin(), rows[r].begin() + n));
+        }
+        EXPECT_FALSE((reader.read<32, MAX_C>(kmer, counts, n)));
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(SparseLz4, MatrixRoundTrip, ::testing::Combine(::testing::Bool(), ::testing::Bool()));
+
+// A sparse matrix of 40 samples whose single row has everything after its k-mer (tag,
+// idx_bytes, index deltas and counts) replaced by the given bytes
+static void write_sparse_row(const std::string& path, const std::vector<uint8_t>& row) {
+    {
+        km::MatrixWriter<8192> writer(path, 31, sizeof(count_type), 40, 0, 0, false, true);
+        km::Kmer<32> kmer;
+        kmer.set_k(31);
+        kmer.set64(42);
+        writer.write<32, MAX_C>(kmer, std::vector<uint32_t>{3, 20}, std::vector<count_type>{5, 6});
+    }
+    // k-mer (8 bytes), tag, idx_bytes, 2 deltas and 2 counts
+    size_t row_start = fs::file_size(path) - 20;
+    std::string data = read_file(path);
+    ASSERT_EQ(static_cast<uint8_t>(data[row_start + 8]), 2u << 1);
+    data.resize(row_start + 8);
+    data.append(row.begin(), row.end());
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << data;
+}
+
+static void read_sparse_rows(const std::string& path) {
+    km::MatrixReader<8192> reader(path);
+    km::Kmer<32> kmer;
+    kmer.set_k(31);
+    std::vector<uint32_t> indices;
+    std::vector<count_type> counts;
+    while (reader.read<32, MAX_C>(kmer, indices, counts)) {}
+}
+
+TEST_F(KmtricksTest, SparseRowChecks) {
+    const std::vector<uint8_t> counts {5, 0, 0, 0, 6, 0, 0, 0};
+    auto row = [&](std::vector<uint8_t> header) {
+        header.insert(header.end(), counts.begin(), counts.end());
+        return header;
+    };
+
+    write_sparse_row(path("ok.mat"), row({4, 2, 3, 17}));
+    EXPECT_NO_THROW(read_sparse_rows(path("ok.mat")));
+
+    // second index at 3 + 37 = 40, past the last sample
+    write_sparse_row(path("index.mat"), row({4, 2, 3, 37}));
+    EXPECT_THROW(read_sparse_rows(path("index.mat")), km::IOError);
+
+    // 41 entries for 40 samples
+    write_sparse_row(path("nnz.mat"), row({41 << 1, 2, 3, 17}));
+    EXPECT_THROW(read_sparse_rows(path("nnz.mat")), km::IOError);
+
+    // the last delta does not end within idx_bytes
+    write_sparse_row(path("varint.mat"), row({4, 2, 3, 0x91}));
+    EXPECT_THROW(read_sparse_rows(path("varint.mat")), km::IOError);
+
+    // a delta not ending within 5 bytes
+    write_sparse_row(path("long.mat"), row({2, 5, 0x80, 0x80, 0x80, 0x80, 0x80}));
+    EXPECT_THROW(read_sparse_rows(path("long.mat")), km::IOError);
+
+    // repeated sample index
+    write_sparse_row(path("repeat.mat"), row({4, 2, 3, 0}));
+    EXPECT_THROW(read_sparse_rows(path("repeat.mat")), km::IOError);
+
+    // file cut in the indices, then in the counts
+    write_sparse_row(path("cut_indices.mat"), {4, 2, 3});
+    EXPECT_THROW(read_sparse_rows(path("cut_indices.mat")), km::IOError);
+    write_sparse_row(path("cut_counts.mat"), {4, 2, 3, 17, 5, 0});
+    EXPECT_THROW(read_sparse_rows(path("cut_counts.mat")), km::IOError);
+}
+
+// (engine, block size, lz4), the process-wide engine is reset to fstream after each test
+class AsyncKmerRoundTrip : public KmtricksTest,
+                           public ::testing::WithParamInterface<std::tuple<km::IO_ENGINE, size_t, bool>> {
+protected:
+    void TearDown() override {
+        km::AsyncIO::get().set(km::IO_ENGINE::FSTREAM);
+        KmtricksTest::TearDown();
+    }
+};
+
+TEST_P(AsyncKmerRoundTrip, ReadsWrittenKmers) {
+    auto [engine, block_size, lz4] = GetParam();
+    if (engine == km::IO_ENGINE::URING && !km::Uring::available()) { GTEST_SKIP() << "io_uring is not available"; }
+    km::AsyncIO::get().set(engine, block_size);
+
+    // from an empty file to files of several blocks, most of them with a partial last block
+    for (size_t n : {0, 1, 341, 100000}) {
+        std::mt19937_64 rng(n);
+        std::vector<std::pair<uint64_t, count_type>> kmers(n);
+        for (auto& [kmer, count] : kmers) { kmer = rng() >> 2; count = static_cast<count_type>(rng()); }
+        {
+            km::KmerWriter<8192> writer(path("k.kmer"), 31, sizeof(count_type), 1, 2, lz4);
+            for (auto& [kmer, count] : kmers) { writer.write_raw<MAX_C>(&kmer, count); }
+        }
+
+        km::KmerReader<8192> reader(path("k.kmer"));
+        EXPECT_EQ(reader.infos().id, 1u);
+        EXPECT_EQ(reader.infos().partition, 2u);
+        km::Kmer<32> kmer;
+        kmer.set_k(31);
+        count_type count;
+        for (size_t i = 0; i < n; i++) {
+            ASSERT_TRUE((reader.read<32, MAX_C>(kmer, count))) << n << " k-mers, at " << i;
+            EXPECT_EQ(kmer.get64(), kmers[i].first);
+            EXPECT_EQ(count, kmers[i].second);
+        }
+        EXPECT_FALSE((reader.read<32, MAX_C>(kmer, count))) << n << " k-mers";
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(EngineBlockLz4, AsyncKmerRoundTrip, ::testing::Combine(
+    ::testing::Values(km::IO_ENGINE::FSTREAM, km::IO_ENGINE::PREAD, km::IO_ENGINE::URING),
+    ::testing::Values(4096, 65536, 1 << 20),
+    ::testing::Bool()
+));
+
+// (engine, block size) of an async_fstream
+class AsyncFile : public KmtricksTest, public ::testing::WithParamInterface<std::tuple<km::IO_ENGINE, size_t>> {
+protected:
+    void SetUp() override {
+        if (std::get<0>(GetParam()) == km::IO_ENGINE::URING && !km::Uring::available()) {
+            GTEST_SKIP() << "io_uring is not available";
+        }
+        KmtricksTest::SetUp();
+    }
+};
+
+TEST_P(AsyncFile, SeekAndTell) {
+    auto [engine, block_size] = GetParam();
+    std::vector<char> data(3 * block_size + 123);
+    for (size_t i = 0; i < data.size(); i++) { data[i] = static_cast<char>(i * 7 + 3); }
+    {
+        km::async_fstream out(path("raw"), std::ios::out | std::ios::binary, engine, block_size);
+        ASSERT_TRUE(out.good());
+        out.write(data.data(), data.size());
+        EXPECT_EQ(static_cast<size_t>(out.tellp()), data.size());
+        EXPECT_EQ(engine == km::IO_ENGINE::URING, out.uring());
+    }
+    ASSERT_EQ(fs::file_size(path("raw")), data.size());
+
+    // within the current block, in the next ones, back to the start and across the end
+    km::async_fstream in(path("raw"), std::ios::in | std::ios::binary, engine, block_size);
+    ASSERT_TRUE(in.good());
+    for (size_t pos : {size_t{5}, size_t{20}, block_size + 7, size_t{0}, 3 * block_size + 100,
+                       block_size - 1, 2 * block_size}) {
+        in.clear();
+        in.seekg(pos);
+        char buf[30];
+        in.read(buf, sizeof(buf));
+        size_t got = in.gcount();
+        EXPECT_EQ(got, std::min(sizeof(buf), data.size() - pos)) << "at " << pos;
+        EXPECT_EQ(std::memcmp(buf, data.data() + pos, got), 0) << "at " << pos;
+        in.clear();
+        EXPECT_EQ(static_cast<size_t>(in.tellg()), pos + got) << "at " << pos;
+    }
+    in.clear();
+    in.seekg(-10, std::ios::end);
+    EXPECT_EQ(static_cast<size_t>(in.tellg()), data.size() - 10);
+    EXPECT_EQ(in.get(), static_cast<unsigned char>(data[data.size() - 10]));
+}
+
+TEST_P(AsyncFile, WriteErrorOnFullDevice) {
+    auto [engine, block_size] = GetParam();
+    if (!fs::exists("/dev/full")) { GTEST_SKIP() << "no /dev/full"; }
+    km::async_fstream out("/dev/full", std::ios::out | std::ios::binary, engine, block_size);
+    ASSERT_TRUE(out.good());
+    std::string data(2 * block_size + 10, 'x');
+    out.write(data.data(), data.size());
+    out.flush();
+    EXPECT_FALSE(out.good());
+    EXPECT_EQ(out.rdbuf()->close(), nullptr);
+}
+
+INSTANTIATE_TEST_SUITE_P(EngineBlock, AsyncFile, ::testing::Combine(
+    ::testing::Values(km::IO_ENGINE::PREAD, km::IO_ENGINE::URING),
+    ::testing::Values(4096, 65536, 1 << 20)
+));
@@ -0,0 +1,108 @@
+#include "../src/muset_report.h"
+#include <gtest/gtest.h>
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+class StageReportTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+        path = fs::temp_directory_path() / fmt::format("muset_report_tests.{}.{}.json", getpid(), info->name());
+    }
+
+    void TearDown() override {
+        fs::remove(path);
+    }
+
+    json read_report() const {
+        std::ifstream in(path);
+        return json::parse(in);
+    }
+
+    fs::path path;
+};
+
+TEST_F(StageReportTest, KeysAndValues) {
+    const size_t alloc_size = 64 << 20;
+    muset::StageReport report;
+    report.set_info("muset_version", "0.0.0");
+    report.set_info("command", "muset \"a\\b\"\t-o out");
+
+    report.run("outer", [&]() {
+        report.run("alloc", [&]() {
+            // touched pages raise the high-water mark
+            auto buffer = std::make_unique<char[]>(alloc_size);
+            std::memset(buffer.get(), 1, alloc_size);
+            ASSERT_EQ(buffer[alloc_size - 1], 1);
+        });
+        report.run("sleep", [&]() { std::this_thread::sleep_for(std::chrono::milliseconds(50)); });
+    });
+    report.add_counter("outer/sleep", "kmers", 1000);
+    report.add_counter("outer/sleep", "input_bytes", 1 << 20);
+    EXPECT_THROW(report.run("failing", []() { throw std::runtime_error("failure"); }), std::runtime_error);
+    report.write(path, "success");
+
+    json r = read_report();
+    EXPECT_EQ(r["muset_version"], "0.0.0");
+    EXPECT_EQ(r["command"], "muset \"a\\b\"\t-o out");
+    EXPECT_EQ(r["status"], "success");
+    EXPECT_GE(r["wall_s"].get<double>(), 0.05);
+    EXPECT_GE(r["peak_rss_bytes"].get<uint64_t>(), alloc_size);
+    EXPECT_FALSE(r.contains("peak_rss_scope"));
+
+    const json& stages = r["stages"];
+    ASSERT_EQ(stages.size(), 4u);
+    std::vector<std::string> names;
+    for (const auto& s : stages) { names.push_back(s["name"]); }
+    EXPECT_EQ(names, (std::vector<std::string>{"outer", "outer/alloc", "outer/sleep", "failing"}));
+    for (const char* key : {"depth", "completed", "wall_s", "cpu_s", "user_s", "sys_s", "children_cpu_s",
+                            "peak_rss_bytes", "peak_rss_increase_bytes", "io_read_bytes", "io_write_bytes",
+                            "storage_read_bytes", "storage_write_bytes"}) {
+        for (const auto& s : stages) { EXPECT_TRUE(s.contains(key)) << s["name"] << " has no " << key; }
+    }
+
+    const json& outer = stages[0];
+    const json& alloc = stages[1];
+    const json& sleep = stages[2];
+    const json& failing = stages[3];
+    EXPECT_EQ(outer["depth"], 0);
+    EXPECT_EQ(alloc["depth"], 1);
+    EXPECT_TRUE(outer["completed"].get<bool>());
+    EXPECT_FALSE(failing["completed"].get<bool>());
+
+    // the allocation raised the peak of its stage and of the enclosing one, not the later stages
+    EXPECT_GE(alloc["peak_rss_increase_bytes"].get<uint64_t>(), alloc_size * 9 / 10);
+    EXPECT_GE(outer["peak_rss_increase_bytes"].get<uint64_t>(), alloc["peak_rss_increase_bytes"].get<uint64_t>());
+    EXPECT_LT(sleep["peak_rss_increase_bytes"].get<uint64_t>(), alloc_size / 2);
+    EXPECT_LT(failing["peak_rss_increase_bytes"].get<uint64_t>(), alloc_size / 2);
+    EXPECT_GE(sleep["peak_rss_bytes"].get<uint64_t>(), alloc["peak_rss_bytes"].get<uint64_t>());
+
+    EXPECT_GE(sleep["wall_s"].get<double>(), 0.05);
+    EXPECT_GE(outer["wall_s"].get<double>(), sleep["wall_s"].get<double>());
+    EXPECT_EQ(sleep["kmers"], 1000);
+    EXPECT_EQ(sleep["input_bytes"], 1 << 20);
+    // throughputs use the unrounded wall time
+    EXPECT_NEAR(sleep["kmers_per_s"].get<double>() * sleep["wall_s"].get<double>() / 1000, 1.0, 0.02);
+    EXPECT_NEAR(sleep["input_mb_per_s"].get<double>() * sleep["wall_s"].get<double>(), 1.0, 0.02);
+    EXPECT_FALSE(alloc.contains("kmers_per_s"));
+}
+
+TEST_F(StageReportTest, ErrorStatus) {
+    muset::StageReport report;
+    EXPECT_THROW(report.run("kmtricks", []() { throw std::runtime_error("no space left"); }), std::runtime_error);
+    report.write(path, "IOError - \"tmp\" is full\n");
+
+    json r = read_report();
+    EXPECT_EQ(r["status"], "IOError - \"tmp\" is full\n");
+    ASSERT_EQ(r["stages"].size(), 1u);
+    EXPECT_EQ(r["stages"][0]["name"], "kmtricks");
+    EXPECT_FALSE(r["stages"][0]["completed"].get<bool>());
+}
@@ -0,0 +1,130 @@
+#!/bin/bash
+# Integration test of muset serve and muset client: the answers of the server must match
+# muset query, over one or several persistent connections, with the protocol framing
+# ("." end line, "#stats" requests and "error" lines).
+#
+#   serve_test.sh <kmat_tools> <muset>
+
+set -euo pipefail
+
+kmat_tools=$1
+muset=$2
+
+dir=$(mktemp -d)
+server=""
+cleanup() {
+    if [[ -n "${server}" ]]; then kill "${server}" 2> /dev/null || true; wait "${server}" 2> /dev/null || true; fi
+    rm -rf "${dir}"
+}
+trap cleanup EXIT
+
+fail() {
+    echo "FAILED: $*" >&2
+    exit 1
+}
+
+# 20 random unitigs of 80 nt, their 31-mers with 2 samples, and queries drawn from them
+awk -v dir="${dir}" 'BEGIN {
+    srand(3);
+    for (u = 0; u < 20; u++) {
+        seq = "";
+        for (i = 0; i < 80; i++) { seq = seq substr("ACGT", int(rand() * 4) + 1, 1); }
+        print ">" u > (dir "/unitigs.fa");
+        print seq > (dir "/unitigs.fa");
+        for (i = 1; i + 30 <= 80; i++) {
+            print substr(seq, i, 31), u + 1, (u % 3 == 0 ? 0 : 2 * u) > (dir "/matrix.txt");
+        }
+        print ">q" u " query" > (dir "/queries.fa");
+        print substr(seq, 1 + u, 50) > (dir "/queries.fa");
+    }
+}'
+
+"${kmat_tools}" unitig -k 31 -m 15 --index -p "${dir}/unitigs" "${dir}/unitigs.fa" "${dir}/matrix.txt" > /dev/null
+"${muset}" query -o "${dir}/expected.tsv" "${dir}/unitigs" "${dir}/queries.fa"
+[[ $(wc -l < "${dir}/expected.tsv") -gt 1 ]] || fail "muset query found no hit"
+
+# a single worker: the concurrent connections below must share it
+"${muset}" serve -t 1 -s "${dir}/muset.sock" "${dir}/unitigs" 2> "${dir}/serve.log" &
+server=$!
+for _ in $(seq 100); do
+    [[ -S "${dir}/muset.sock" ]] && break
+    sleep 0.1
+done
+[[ -S "${dir}/muset.sock" ]] || fail "the server did not start: $(cat "${dir}/serve.log")"
+
+# muset client, with requests of several sizes
+for batch in 1 3 64; do
+    "${muset}" client -s "${dir}/muset.sock" -b "${batch}" --stats -o "${dir}/client.tsv" "${dir}/queries.fa" 2> /dev/null
+    cmp -s "${dir}/client.tsv" "${dir}/expected.tsv" || fail "muset client -b ${batch} differs from muset query"
+done
+
+# the protocol, on raw connections
+python3 - "${dir}" <<'PYTHON'
+import socket
+import sys
+
+directory = sys.argv[1]
+expected = open(f"{directory}/expected.tsv").read().splitlines()[1:]
+records = open(f"{directory}/queries.fa").read().splitlines()
+
+
+def connect():
+    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client.settimeout(10)
+    client.connect(f"{directory}/muset.sock")
+    return client, client.makefile("r")
+
+
+def response(reader):
+    lines = []
+    while True:
+        line = reader.readline()
+        assert line, "connection closed by the server"
+        line = line.rstrip("\n")
+        if line == ".":
+            return lines
+        lines.append(line)
+
+
+def check(condition, message):
+    if not condition:
+        print(f"FAILED: {message}", file=sys.stderr)
+        sys.exit(1)
+
+
+# two persistent connections answered in turn by the single worker
+first, first_reader = connect()
+second, second_reader = connect()
+first.sendall(("\n".join(records[:2]) + "\n.\n").encode())
+second.sendall(("\n".join(records) + "\n.\n").encode())
+check(response(second_reader) == expected, "answer on a second persistent connection")
+check(response(first_reader) == [l for l in expected if l.startswith("q0\t")], "answer on the first connection")
+
+# pipelined requests, one split across writes, the last record ended by "." only
+first.sendall(("\n".join(records[:4]) + "\n.\n" + records[4]).encode())
+first.sendall(("\n" + records[5] + "\r\n.\n").encode())
+check(response(first_reader) == [l for l in expected if l.split("\t")[0] in ("q0", "q1")], "first pipelined request")
+check(response(first_reader) == [l for l in expected if l.startswith("q2\t")], "split request")
+
+# metrics request
+first.sendall(b"#stats\n")
+stats = response(first_reader)
+check(any(l.startswith("requests\t") for l in stats), f"#stats answer: {stats}")
+
+# "#stats" inside a request is an error ending with the request, the connection stays usable
+first.sendall(("\n".join(records[:2]) + "\n#stats\n.\n").encode())
+check(response(first_reader) == ["error\t#stats inside a request"], "#stats inside a request")
+first.sendall(b"ACGT\n.\n")
+check(response(first_reader) == ["error\tsequence line before any FASTA header"], "sequence without a header")
+first.sendall(("\n".join(records[:2]) + "\n.\n").encode())
+check(response(first_reader) == [l for l in expected if l.startswith("q0\t")], "request after an error")
+
+first.close()
+second.close()
+PYTHON
+
+kill -TERM "${server}"
+wait "${server}" || fail "the server did not stop cleanly"
+server=""
+[[ ! -e "${dir}/muset.sock" ]] || fail "the socket was not removed"
+echo "serve_test: OK"